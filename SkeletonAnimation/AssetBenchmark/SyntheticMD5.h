@@ -0,0 +1,195 @@
+#ifndef _SYNTHETICMD5_H_INCLUDED
+#define _SYNTHETICMD5_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Generadores de archivos MD5 sinteticos para medir los loaders con
+*	modelos mucho mas grandes que los incluidos en el proyecto.
+*	Los datos son pseudoaleatorios pero deterministas, asi que dos
+*	corridas con los mismos parametros generan archivos identicos.
+**/
+
+float SyntheticRandom(unsigned int *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) / 16777216.0f;
+}
+
+float SyntheticRange(unsigned int *state, float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * SyntheticRandom(state);
+}
+
+// Arbol de tres hijos por joint: profundo para que la jerarquia importe, pero balanceado
+int SyntheticParent(int joint)
+{
+	return joint == 0 ? -1 : (joint - 1) / 3;
+}
+
+// Redondea como %f para que el generador use los mismos valores que leera el loader
+float SyntheticRound(float value)
+{
+	char text[32];
+	sprintf(text, "%f", value);
+	return (float)atof(text);
+}
+
+// Lleva un punto de espacio de modelo al espacio del joint: inverso de q^-1 * v * q, como en el skinning
+void SyntheticToJointSpace(const float *jointPosition, const float *q, const float *point, float *result)
+{
+	float v[3] = { point[0] - jointPosition[0], point[1] - jointPosition[1], point[2] - jointPosition[2] };
+	float t[3] = { 2 * (q[1] * v[2] - q[2] * v[1]), 2 * (q[2] * v[0] - q[0] * v[2]), 2 * (q[0] * v[1] - q[1] * v[0]) };
+
+	result[0] = v[0] + q[3] * t[0] + (q[1] * t[2] - q[2] * t[1]);
+	result[1] = v[1] + q[3] * t[1] + (q[2] * t[0] - q[0] * t[2]);
+	result[2] = v[2] + q[3] * t[2] + (q[0] * t[1] - q[1] * t[0]);
+}
+
+// Cada malla es una reticula de gridSize x gridSize vertices con weightsPerVertex pesos por vertice.
+// Los pesos de un vertice coinciden en la misma posicion de bind pose, como en una malla exportada.
+bool WriteSyntheticMesh(string path, int numJoints, int numMeshes, int gridSize, int weightsPerVertex)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL)
+		return false;
+
+	unsigned int state = 12345;
+	vector<float> jointPositions(numJoints * 3);
+	vector<float> jointOrientations(numJoints * 4);
+
+	fprintf(file, "MD5Version 10\ncommandline \"\"\n\nnumJoints %d\nnumMeshes %d\n\njoints {\n", numJoints, numMeshes);
+
+	for (int i = 0; i < numJoints; i++)
+	{
+		// El archivo guarda x z y; en memoria se leen como x y z
+		float *position = &jointPositions[i * 3];
+		float *orientation = &jointOrientations[i * 4];
+
+		position[0] = SyntheticRound(SyntheticRange(&state, -10, 10));
+		position[2] = SyntheticRound(SyntheticRange(&state, -10, 10));
+		position[1] = SyntheticRound(SyntheticRange(&state, -10, 10));
+		orientation[0] = SyntheticRound(SyntheticRange(&state, -0.5f, 0.5f));
+		orientation[2] = SyntheticRound(SyntheticRange(&state, -0.5f, 0.5f));
+		orientation[1] = SyntheticRound(SyntheticRange(&state, -0.5f, 0.5f));
+		orientation[3] = -sqrtf(1.0f - orientation[0] * orientation[0] - orientation[1] * orientation[1] - orientation[2] * orientation[2]);
+
+		fprintf(file, "\t\"joint%d\"\t%d ( %f %f %f ) ( %f %f %f )\t\t// \n", i, SyntheticParent(i),
+			position[0], position[2], position[1], orientation[0], orientation[2], orientation[1]);
+	}
+
+	fprintf(file, "}\n\n");
+
+	int numVertices = gridSize * gridSize;
+	int numTriangles = (gridSize - 1) * (gridSize - 1) * 2;
+	int numWeights = numVertices * weightsPerVertex;
+
+	for (int m = 0; m < numMeshes; m++)
+	{
+		fprintf(file, "mesh {\n\t// meshes: synthetic%d\n\tshader \"synthetic.jpg\"\n\n\tnumverts %d\n", m, numVertices);
+
+		for (int i = 0; i < numVertices; i++)
+		{
+			float u = (float)(i % gridSize) / (gridSize - 1);
+			float v = (float)(i / gridSize) / (gridSize - 1);
+			fprintf(file, "\tvert %d ( %f %f ) %d %d\n", i, u, v, i * weightsPerVertex, weightsPerVertex);
+		}
+
+		fprintf(file, "\n\tnumtris %d\n", numTriangles);
+
+		int triangle = 0;
+		for (int row = 0; row < gridSize - 1; row++)
+		{
+			for (int column = 0; column < gridSize - 1; column++)
+			{
+				int corner = row * gridSize + column;
+				fprintf(file, "\ttri %d %d %d %d\n", triangle++, corner, corner + gridSize, corner + 1);
+				fprintf(file, "\ttri %d %d %d %d\n", triangle++, corner + 1, corner + gridSize, corner + gridSize + 1);
+			}
+		}
+
+		fprintf(file, "\n\tnumweights %d\n", numWeights);
+
+		for (int i = 0; i < numWeights; i++)
+		{
+			int vertex = i / weightsPerVertex;
+			float point[3] = { 50.0f * (vertex % gridSize) / (gridSize - 1) - 25.0f, 50.0f * (vertex / gridSize) / (gridSize - 1) - 25.0f, m * 10.0f };
+			float offset[3];
+
+			int joint = (int)(SyntheticRandom(&state) * numJoints) % numJoints;
+			SyntheticToJointSpace(&jointPositions[joint * 3], &jointOrientations[joint * 4], point, offset);
+
+			fprintf(file, "\tweight %d %d %f ( %f %f %f )\n", i, joint, 1.0f / weightsPerVertex, offset[0], offset[2], offset[1]);
+		}
+
+		fprintf(file, "}\n\n");
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Los primeros joints animan sus 6 componentes (flags = 63). Los ultimos
+// numStaticJoints son hojas sin canales animados (flags = 0), como los
+// huesos auxiliares de un rig real.
+bool WriteSyntheticAnimation(string path, int numJoints, int numFrames, int frameRate, int numStaticJoints = 0)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL)
+		return false;
+
+	unsigned int state = 54321;
+	int numAnimatedJoints = numJoints - numStaticJoints;
+	int numAnimatedComponents = numAnimatedJoints * 6;
+
+	fprintf(file, "MD5Version 10\ncommandline \"\"\n\nnumFrames %d\nnumJoints %d\nframeRate %d\nnumAnimatedComponents %d\n\nhierarchy {\n",
+		numFrames, numJoints, frameRate, numAnimatedComponents);
+
+	for (int i = 0; i < numJoints; i++)
+		fprintf(file, "\t\"joint%d\"\t%d %d %d\t//\n", i, SyntheticParent(i), i < numAnimatedJoints ? 63 : 0, i < numAnimatedJoints ? i * 6 : 0);
+
+	fprintf(file, "}\n\nbounds {\n");
+
+	for (int i = 0; i < numFrames; i++)
+		fprintf(file, "\t( %f %f %f ) ( %f %f %f )\n", -50.0f, -50.0f, -50.0f, 50.0f, 50.0f, 50.0f);
+
+	fprintf(file, "}\n\nbaseframe {\n");
+
+	for (int i = 0; i < numJoints; i++)
+		fprintf(file, "\t( %f %f %f ) ( %f %f %f )\n",
+			SyntheticRange(&state, -10, 10), SyntheticRange(&state, -10, 10), SyntheticRange(&state, -10, 10),
+			SyntheticRange(&state, -0.5f, 0.5f), SyntheticRange(&state, -0.5f, 0.5f), SyntheticRange(&state, -0.5f, 0.5f));
+
+	fprintf(file, "}\n\n");
+
+	for (int f = 0; f < numFrames; f++)
+	{
+		fprintf(file, "frame %d {\n", f);
+
+		for (int i = 0; i < numAnimatedJoints; i++)
+			fprintf(file, "\t%f %f %f %f %f %f\n",
+				SyntheticRange(&state, -10, 10), SyntheticRange(&state, -10, 10), SyntheticRange(&state, -10, 10),
+				SyntheticRange(&state, -0.5f, 0.5f), SyntheticRange(&state, -0.5f, 0.5f), SyntheticRange(&state, -0.5f, 0.5f));
+
+		fprintf(file, "}\n\n");
+	}
+
+	fclose(file);
+	return true;
+}
+
+#endif
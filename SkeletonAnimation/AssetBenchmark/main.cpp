@@ -0,0 +1,2277 @@
+#include <Windows.h>
+#include <Psapi.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <map>
+#include "MD5Mesh.h"
+#include "MD5Anim.h"
+#include "MD5Binary.h"
+#include "MD5CompressedAnim.h"
+#include "AnimationRegistry.h"
+#include "SyntheticMD5.h"
+
+#pragma comment(lib, "psapi.lib")
+
+using namespace std;
+
+/**
+*	Benchmark de carga de assets. No crea ventana ni dispositivo D3D:
+*	solo mide el parseo y el preprocesamiento de MD5Mesh y MD5Anim.
+*
+*	Uso: AssetBenchmark [directorio de modelos] [--quick]
+*
+*	Cada benchmark imprime una linea JSON con ns/op, MB/s (bytes de
+*	entrada por segundo), asignaciones y bytes asignados por operacion,
+*	la memoria que retiene cada animacion cargada y el pico de memoria
+*	residente del proceso hasta ese momento.
+*
+*	Luego se verifica que cada clip cargado del .md5animbin sea identico
+*	bit a bit al cargado del texto, incluyendo las poses muestreadas.
+*
+*	Despues se comprimen las animaciones con varias tolerancias y se
+*	reporta la razon de compresion y el error maximo de los joints
+*	contra el muestreo sin comprimir en espacio local.
+*
+*	El reporte de muestreo cuenta los joints y componentes que el clip
+*	no evalua porque no cambian, y mide cuanto cuesta muestrear una
+*	pose con los esqueletos precalculados y en espacio local.
+*
+*	El reporte de skinning compara el skinning por pesos MD5 contra la
+*	paleta de matrices: costo por actualizacion y por vertice, y la
+*	diferencia maxima entre los vertices que produce cada uno, junto con
+*	los bytes que se suben por actualizacion (solo el stream dinamico de
+*	posiciones y normales). El reporte de cuaterniones duales los compara
+*	con ambos en velocidad y en cuanto se separan. Luego se mide cada kernel de la paleta
+*	(escalar, SSE2, AVX) en vertices por segundo y se verifica que todos
+*	produzcan los mismos vertices, tambien contra las mismas streams sin
+*	agrupar por numero de influencias.
+*
+*	Los reportes de escalamiento repiten la actualizacion con pools de 1
+*	a N hilos, para un personaje pesado (bloques de vertices en paralelo)
+*	y para muchos personajes (modelos en paralelo), y verifican que los
+*	vertices no dependan del numero de hilos.
+*
+*	El reporte de destino de salida mide cuanto ahorra escribir los
+*	vertices directo en el buffer de destino en lugar de copiarlos.
+*
+*	El reporte de recorte de influencias carga cada modelo con 1 a 4
+*	influencias por vertice y mide cuanto se mueven los vertices en todo
+*	el clip contra el skinning con todos los pesos MD5.
+*
+*	El reporte de cuantizacion mide el error de las posiciones de 16 bits
+*	y las normales octaedricas, primero en vectores aleatorios y luego
+*	contra la salida en float del modelo, y los bytes que se suben.
+*
+*	El reporte de marcos tangentes compara, con cada metodo de skinning,
+*	la salida en float contra la de un cuaternion por vertice: costo por
+*	actualizacion, bytes que se suben, cuanto se separa la normal del
+*	marco de la normal en float y si el marco sigue ortonormal y con la
+*	orientacion de la bitangente de la carga.
+*
+*	El reporte de orden de indices carga cada malla en el orden del
+*	archivo y optimizada, y compara el ACMR con una cache post-transform
+*	FIFO simulada, los bytes que se leen de los vertex buffers, el tamano
+*	del index buffer y el costo de la carga y de la actualizacion.
+*
+*	El reporte de duplicados carga cada malla con y sin unir vertices y
+*	compartir pesos repetidos: cuantos se quitaron, el costo de la carga
+*	y de la actualizacion y que las esquinas de los triangulos no se muevan.
+*
+*	El reporte de animacion horneada hornea el clip a varias frecuencias
+*	y compara la reproduccion horneada con el skinning en vivo: memoria,
+*	error de los vertices interpolados y costo por modelo en una multitud.
+*
+*	El reporte de cache de skinning actualiza una multitud con y sin el
+*	cache para varios tamanos de intervalo: costo por modelo, aciertos,
+*	memoria, desalojos y el error contra el skinning de cada instancia.
+*
+*	El reporte de niveles de detalle simplifica cada malla en varios
+*	niveles y reporta por nivel vertices, triangulos, pesos, la cota de
+*	error de las cuadricas, la distancia medida a la superficie completa
+*	(en bind pose y animada) y el costo de la actualizacion.
+*
+*	Al final se crean cientos de instancias del mismo modelo para
+*	verificar que comparten un solo clip y medir su actualizacion.
+*
+*	Las verificaciones (vertices iguales entre kernels, hilos y destinos,
+*	errores dentro de su cota) se imprimen en el JSON y, si alguna falla,
+*	tambien en stderr; en ese caso el programa regresa EXIT_FAILURE.
+**/
+
+#define BENCHMARK_MIN_TIME_SECONDS	1.0
+#define BENCHMARK_MAX_ITERATIONS	100
+
+#pragma region Allocation counting
+
+volatile LONG g_allocationCount = 0;
+volatile LONGLONG g_allocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+	InterlockedIncrement(&g_allocationCount);
+	InterlockedExchangeAdd64(&g_allocatedBytes, (LONGLONG)size);
+
+	void *memory = malloc(size > 0 ? size : 1);
+	if (memory == NULL)
+		throw bad_alloc();
+
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *memory)
+{
+	free(memory);
+}
+
+void operator delete[](void *memory)
+{
+	free(memory);
+}
+
+#pragma endregion
+
+#pragma region Checks
+
+// Diferencia maxima entre dos metodos de skinning que deben dar la misma mezcla lineal
+#define SKINNING_CHECK_TOLERANCE	1e-4f
+
+bool g_hasFailedChecks = false;
+
+// Regresa condition; si es false lo reporta en stderr y main termina con EXIT_FAILURE
+bool Check(bool condition, const string &benchmark, const char *check)
+{
+	if (!condition)
+	{
+		fprintf(stderr, "Fallo la verificacion %s de %s.\n", check, benchmark.c_str());
+		g_hasFailedChecks = true;
+	}
+
+	return condition;
+}
+
+#pragma endregion
+
+#pragma region Benchmark cases
+
+enum BenchmarkKind
+{
+	BENCHMARK_MESH,
+	BENCHMARK_ANIMATION
+};
+
+struct BenchmarkCase
+{
+	string name;
+	string path;
+	BenchmarkKind kind;
+	unsigned int loadFlags;
+	size_t inputBytes;
+};
+
+size_t GetAssetSize(string path)
+{
+	MD5MappedFile file;
+	return file.Open(path) ? file.GetSize() : 0;
+}
+
+// Regresa la memoria que retiene la animacion cargada (0 para mallas)
+size_t LoadAsset(const BenchmarkCase &benchmark)
+{
+	size_t retainedBytes = 0;
+
+	if (benchmark.kind == BENCHMARK_MESH)
+	{
+		delete new MD5Mesh(benchmark.path, NULL, benchmark.loadFlags);
+	}
+	else
+	{
+		MD5Anim *animation = new MD5Anim(benchmark.path, benchmark.loadFlags);
+		retainedBytes = animation->GetMemoryUsage();
+		delete animation;
+	}
+
+	return retainedBytes;
+}
+
+/**
+*	Costo de copiar los arreglos de un .md5meshbin ya mapeado a los
+*	vectores de Mesh, como hace LoadCompiledMesh: los bytes copiados, las
+*	reservas y el tiempo por carga. Es lo que se ahorraria leyendo los
+*	rangos en su lugar.
+**/
+bool MeasureCompiledMeshCopy(string binaryPath, double *copyNanoseconds, size_t *copiedBytes, double *copyAllocations)
+{
+	MD5MappedFile binaryFile;
+	if (!binaryFile.Open(binaryPath))
+		return false;
+
+	const MD5MeshBinaryHeader *header = binaryFile.At<MD5MeshBinaryHeader>(0, 1);
+	const MD5MeshBinaryMesh *binaryMeshes = header != NULL ? binaryFile.At<MD5MeshBinaryMesh>(header->meshesOffset, header->numMeshes) : NULL;
+	if (binaryMeshes == NULL)
+		return false;
+
+	int copies = 100;
+	LONG startAllocations = g_allocationCount;
+	LARGE_INTEGER frequency, start, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	for (int c = 0; c < copies; c++)
+	{
+		vector<Mesh> meshes(header->numMeshes);
+		*copiedBytes = 0;
+
+		for (int i = 0; i < header->numMeshes; i++)
+		{
+			const MD5MeshBinaryMesh &binaryMesh = binaryMeshes[i];
+			const Vertex *vertices = binaryFile.At<Vertex>(binaryMesh.verticesOffset, binaryMesh.numVertices);
+			const StaticVertex *staticVertices = binaryFile.At<StaticVertex>(binaryMesh.staticVerticesOffset, binaryMesh.numVertices);
+			const VertexInfo *vertexInfo = binaryFile.At<VertexInfo>(binaryMesh.vertexInfoOffset, binaryMesh.numVertices);
+			const Triangle *triangles = binaryFile.At<Triangle>(binaryMesh.trianglesOffset, binaryMesh.numTriangles);
+			const Weight *weights = binaryFile.At<Weight>(binaryMesh.weightsOffset, binaryMesh.numWeights);
+			const int *indices = binaryFile.At<int>(binaryMesh.indicesOffset, binaryMesh.numTriangles * 3);
+
+			if (vertices == NULL || staticVertices == NULL || vertexInfo == NULL || triangles == NULL || weights == NULL || indices == NULL)
+				return false;
+
+			meshes[i].vertices.assign(vertices, vertices + binaryMesh.numVertices);
+			meshes[i].staticVertices.assign(staticVertices, staticVertices + binaryMesh.numVertices);
+			meshes[i].vertexInfo.assign(vertexInfo, vertexInfo + binaryMesh.numVertices);
+			meshes[i].triangles.assign(triangles, triangles + binaryMesh.numTriangles);
+			meshes[i].weights.assign(weights, weights + binaryMesh.numWeights);
+			meshes[i].indices.assign(indices, indices + binaryMesh.numTriangles * 3);
+
+			*copiedBytes += binaryMesh.numVertices * (sizeof(Vertex) + sizeof(StaticVertex) + sizeof(VertexInfo)) +
+							binaryMesh.numTriangles * (sizeof(Triangle) + 3 * sizeof(int)) + binaryMesh.numWeights * sizeof(Weight);
+		}
+	}
+
+	QueryPerformanceCounter(&now);
+	*copyNanoseconds = (double)(now.QuadPart - start.QuadPart) * 1e9 / frequency.QuadPart / copies;
+	*copyAllocations = (double)(g_allocationCount - startAllocations) / copies;
+
+	return true;
+}
+
+void RunBenchmark(BenchmarkCase benchmark)
+{
+	// La primera carga no se mide: calienta el cache del sistema de archivos
+	// y, si el benchmark usa los binarios compilados, los genera
+	size_t retainedBytes = LoadAsset(benchmark);
+
+	if (!(benchmark.loadFlags & MD5_LOAD_SKIP_CACHE))
+	{
+		string extension = benchmark.kind == BENCHMARK_MESH ? ".md5meshbin" : ".md5animbin";
+		benchmark.inputBytes = GetAssetSize(benchmark.path + extension);
+	}
+
+	LARGE_INTEGER frequency, start, now;
+	QueryPerformanceFrequency(&frequency);
+
+	LONG startAllocations = g_allocationCount;
+	LONGLONG startBytes = g_allocatedBytes;
+	double elapsed = 0.0;
+	int iterations = 0;
+
+	QueryPerformanceCounter(&start);
+
+	while (iterations < BENCHMARK_MAX_ITERATIONS && (iterations == 0 || elapsed < BENCHMARK_MIN_TIME_SECONDS))
+	{
+		LoadAsset(benchmark);
+		iterations++;
+
+		QueryPerformanceCounter(&now);
+		elapsed = (double)(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+	}
+
+	double allocations = (double)(g_allocationCount - startAllocations) / iterations;
+	double bytes = (double)(g_allocatedBytes - startBytes) / iterations;
+	double nsPerOp = elapsed * 1e9 / iterations;
+	double mbPerSecond = elapsed > 0.0 ? benchmark.inputBytes * (double)iterations / elapsed / (1024.0 * 1024.0) : 0.0;
+
+	PROCESS_MEMORY_COUNTERS memoryCounters;
+	ZeroMemory(&memoryCounters, sizeof(memoryCounters));
+	GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters));
+
+	// Las mallas compiladas se copian a vectores propios; se reporta cuanto de la carga es esa copia
+	char copyFields[128] = "";
+	double copyNanoseconds, copyAllocations;
+	size_t copiedBytes;
+
+	if (benchmark.kind == BENCHMARK_MESH && !(benchmark.loadFlags & MD5_LOAD_SKIP_CACHE) &&
+		MeasureCompiledMeshCopy(benchmark.path + ".md5meshbin", &copyNanoseconds, &copiedBytes, &copyAllocations))
+	{
+		sprintf(copyFields, ",\"copy_ns\":%.0f,\"copied_bytes\":%lu,\"copy_allocations\":%.1f",
+				copyNanoseconds, (unsigned long)copiedBytes, copyAllocations);
+	}
+
+	printf("{\"benchmark\":\"%s\",\"iterations\":%d,\"ns_per_op\":%.0f,\"mb_per_s\":%.2f,"
+		   "\"input_bytes\":%lu,\"allocations_per_op\":%.1f,\"bytes_allocated_per_op\":%.0f,\"retained_bytes\":%lu,\"peak_rss_bytes\":%lu%s}\n",
+		   benchmark.name.c_str(), iterations, nsPerOp, mbPerSecond,
+		   (unsigned long)benchmark.inputBytes, allocations, bytes, (unsigned long)retainedBytes, (unsigned long)memoryCounters.PeakWorkingSetSize,
+		   copyFields);
+	fflush(stdout);
+}
+
+void AddMeshCases(vector<BenchmarkCase> &cases, string name, string path)
+{
+	BenchmarkCase benchmark;
+	benchmark.path = path;
+	benchmark.kind = BENCHMARK_MESH;
+
+	benchmark.name = name + "_mesh_text";
+	benchmark.loadFlags = MD5_LOAD_SKIP_CACHE;
+	benchmark.inputBytes = GetAssetSize(path + ".md5mesh") + GetAssetSize(path + ".md5anim");
+	cases.push_back(benchmark);
+
+	benchmark.name = name + "_mesh_binary";
+	benchmark.loadFlags = MD5_LOAD_SERIAL;
+	cases.push_back(benchmark);
+}
+
+void AddAnimationCases(vector<BenchmarkCase> &cases, string name, string path)
+{
+	BenchmarkCase benchmark;
+	benchmark.path = path;
+	benchmark.kind = BENCHMARK_ANIMATION;
+	benchmark.inputBytes = GetAssetSize(path + ".md5anim");
+
+	benchmark.name = name + "_anim_text_serial";
+	benchmark.loadFlags = MD5_LOAD_SKIP_CACHE;
+	cases.push_back(benchmark);
+
+	benchmark.name = name + "_anim_text_parallel";
+	benchmark.loadFlags = MD5_LOAD_SKIP_CACHE | MD5_LOAD_PARALLEL;
+	cases.push_back(benchmark);
+
+	benchmark.name = name + "_anim_binary";
+	benchmark.loadFlags = MD5_LOAD_SERIAL;
+	cases.push_back(benchmark);
+
+	benchmark.name = name + "_anim_binary_local";
+	benchmark.loadFlags = MD5_LOAD_SAMPLE_LOCAL;
+	cases.push_back(benchmark);
+}
+
+#pragma endregion
+
+#pragma region Binary round trip report
+
+bool HaveSameHierarchy(const vector<HierarchyInfo> &a, const vector<HierarchyInfo> &b)
+{
+	for (int i = 0; i < (int)a.size() && a.size() == b.size(); i++)
+	{
+		if (a[i].name != b[i].name || a[i].parent != b[i].parent || a[i].flags != b[i].flags || a[i].startIndex != b[i].startIndex)
+			return false;
+	}
+
+	return a.size() == b.size();
+}
+
+bool HaveSameFrames(const vector<Frame> &a, const vector<Frame> &b)
+{
+	for (int i = 0; i < (int)a.size() && a.size() == b.size(); i++)
+	{
+		const vector<float> &parametersA = a[i].parameters;
+		const vector<float> &parametersB = b[i].parameters;
+
+		if (a[i].frameIndex != b[i].frameIndex || parametersA.size() != parametersB.size() ||
+			(!parametersA.empty() && memcmp(&parametersA[0], &parametersB[0], sizeof(float) * parametersA.size()) != 0))
+			return false;
+	}
+
+	return a.size() == b.size();
+}
+
+template <class T>
+bool HaveSameBytes(const vector<T> &a, const vector<T> &b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], sizeof(T) * a.size()) == 0);
+}
+
+bool HaveSamePose(const PoseBuffer &a, const PoseBuffer &b)
+{
+	return a.GetNumJoints() == b.GetNumJoints() &&
+		   memcmp(a.GetPositions(0), b.GetPositions(0), sizeof(XMFLOAT4A) * a.GetNumJoints()) == 0 &&
+		   memcmp(a.GetOrientations(0), b.GetOrientations(0), sizeof(XMFLOAT4A) * a.GetNumJoints()) == 0;
+}
+
+/**
+*	Carga el clip del texto (MD5_LOAD_SKIP_CACHE) y del .md5animbin, que se
+*	borra antes para que la segunda carga lo compile y la tercera lo lea
+*	validando tambien el hash del texto. Jerarquia, bounds, base frame,
+*	parametros de cada frame y las poses muestreadas (con esqueletos
+*	precalculados y en espacio local) deben coincidir bit a bit.
+**/
+void RunAnimationRoundTripReport(string name, string path)
+{
+	DeleteFileA((path + ".md5animbin").c_str());
+	delete new MD5Anim(path, MD5_LOAD_SERIAL);
+
+	const char *modeNames[] = { "baked", "local" };
+	unsigned int modeFlags[] = { MD5_LOAD_SERIAL, MD5_LOAD_SAMPLE_LOCAL };
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		MD5Anim text(path, modeFlags[mode] | MD5_LOAD_SKIP_CACHE);
+		MD5Anim binary(path, modeFlags[mode] | MD5_LOAD_VERIFY_SOURCE);
+
+		bool isSameData = HaveSameHierarchy(text.GetHierarchy(), binary.GetHierarchy()) &&
+						  HaveSameBytes(text.GetBounds(), binary.GetBounds()) &&
+						  HaveSameBytes(text.GetBaseFrame(), binary.GetBaseFrame()) &&
+						  HaveSameFrames(text.GetFrameData(), binary.GetFrameData()) &&
+						  text.GetFrameRate() == binary.GetFrameRate() &&
+						  text.GetNumAnimatedComponents() == binary.GetNumAnimatedComponents();
+
+		PoseBuffer textPose, binaryPose;
+		textPose.Allocate(1, text.GetNumJoints());
+		binaryPose.Allocate(1, binary.GetNumJoints());
+		bool isSamePose = text.GetNumJoints() == binary.GetNumJoints();
+		int samples = text.GetNumFrames() * 4;
+
+		for (int i = 0; i < samples && isSamePose; i++)
+		{
+			float time = text.GetTotalAnimationTime() * i / samples;
+			text.SamplePose(time, &textPose);
+			binary.SamplePose(time, &binaryPose);
+			isSamePose = HaveSamePose(textPose, binaryPose);
+		}
+
+		string benchmark = name + "_anim_roundtrip_" + modeNames[mode];
+		Check(binary.IsLoadedFromBinary(), benchmark, "loaded_from_binary");
+		Check(isSameData, benchmark, "same_data");
+		Check(isSamePose, benchmark, "same_poses");
+
+		printf("{\"benchmark\":\"%s_anim_roundtrip\",\"mode\":\"%s\",\"joints\":%d,\"frames\":%d,\"sampled_poses\":%d,"
+			   "\"loaded_from_binary\":%s,\"same_data\":%s,\"same_poses\":%s}\n",
+			   name.c_str(), modeNames[mode], text.GetNumJoints(), text.GetNumFrames(), samples,
+			   binary.IsLoadedFromBinary() ? "true" : "false", isSameData ? "true" : "false", isSamePose ? "true" : "false");
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Compression report
+
+double GetElapsedNanoseconds(const LARGE_INTEGER &start)
+{
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+
+	return (double)(now.QuadPart - start.QuadPart) * 1e9 / frequency.QuadPart;
+}
+
+void RunCompressionReport(string name, string path, float tolerance)
+{
+	MD5Anim source(path, MD5_LOAD_SAMPLE_LOCAL);
+	MD5CompressedAnim compressed;
+	LARGE_INTEGER start;
+
+	QueryPerformanceCounter(&start);
+	if (!compressed.Compress(source, tolerance, tolerance))
+		return;
+	double compressNanoseconds = GetElapsedNanoseconds(start);
+
+	float maxPositionError, maxRotationError;
+	compressed.MeasureError(source, 4, &maxPositionError, &maxRotationError);
+
+	PoseBuffer pose;
+	pose.Allocate(1, compressed.GetNumJoints());
+	int samples = 1000;
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < samples; i++)
+		compressed.SamplePose(source.GetTotalAnimationTime() * i / samples, &pose);
+	double sampleNanoseconds = GetElapsedNanoseconds(start) / samples;
+
+	// Fuera del clip se toma el primer o el ultimo frame, igual que MD5Anim::GetFrames
+	PoseBuffer outside;
+	outside.Allocate(1, compressed.GetNumJoints());
+	float duration = source.GetTotalAnimationTime();
+
+	compressed.SamplePose(0, &pose);
+	compressed.SamplePose(-duration, &outside);
+	bool clampsTime = HaveSamePose(pose, outside);
+
+	compressed.SamplePose(2.0f * duration, &pose);
+	compressed.SamplePose(10.0f * duration, &outside);
+	clampsTime = clampsTime && HaveSamePose(pose, outside);
+
+	Check(clampsTime, name + "_anim_compression", "clamps_time");
+
+	printf("{\"benchmark\":\"%s_anim_compression\",\"tolerance\":%g,\"uncompressed_bytes\":%lu,\"compressed_bytes\":%lu,"
+		   "\"compression_ratio\":%.2f,\"kept_keys\":%d,\"total_keys\":%d,\"max_position_error\":%g,\"max_rotation_error\":%g,"
+		   "\"compress_ns\":%.0f,\"sample_ns\":%.0f,\"clamps_time\":%s}\n",
+		   name.c_str(), tolerance, (unsigned long)compressed.GetUncompressedSize(), (unsigned long)compressed.GetCompressedSize(),
+		   (double)compressed.GetUncompressedSize() / compressed.GetCompressedSize(), compressed.GetNumKeys(), compressed.GetNumUncompressedKeys(),
+		   maxPositionError, maxRotationError, compressNanoseconds, sampleNanoseconds, clampsTime ? "true" : "false");
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Sampling report
+
+/**
+*	Muestrea el clip en medio de cada par de frames y compara con la
+*	interpolacion directa de las poses precalculadas (lerp de posiciones
+*	y slerp de orientaciones en espacio de modelo), que es lo que hacia el
+*	muestreo horneado antes de saltarse los joints estaticos. Solo los
+*	joints fijos cambian de camino, asi que la diferencia debe ser de
+*	redondeo. Regresa el error maximo de posicion.
+**/
+float MeasureBakedSamplingError(const MD5Anim &animation)
+{
+	const PoseBuffer &frameSkeletons = animation.GetFrameSkeletons();
+	int numJoints = animation.GetNumJoints();
+	PoseBuffer pose;
+	pose.Allocate(1, numJoints);
+	float maxError = 0;
+
+	for (int i = 0; i < animation.GetNumFrames(); i++)
+	{
+		int frame0, frame1;
+		float interpolation;
+		float time = (i + 0.37f) / animation.GetFrameRate();
+		animation.GetFrames(time, &frame0, &frame1, &interpolation);
+		animation.SamplePose(time, &pose);
+
+		for (int j = 0; j < numJoints; j++)
+		{
+			const XMFLOAT4A &position0 = frameSkeletons.GetPositions(frame0)[j];
+			const XMFLOAT4A &position1 = frameSkeletons.GetPositions(frame1)[j];
+			const XMFLOAT4A &position = pose.GetPositions(0)[j];
+			XMFLOAT4 orientation;
+			XMStoreFloat4(&orientation, XMQuaternionSlerp(XMLoadFloat4A(&frameSkeletons.GetOrientations(frame0)[j]),
+														 XMLoadFloat4A(&frameSkeletons.GetOrientations(frame1)[j]), interpolation));
+			const XMFLOAT4A &sampled = pose.GetOrientations(0)[j];
+
+			maxError = max(maxError, fabsf(position1.x * interpolation + (1 - interpolation) * position0.x - position.x));
+			maxError = max(maxError, fabsf(position1.y * interpolation + (1 - interpolation) * position0.y - position.y));
+			maxError = max(maxError, fabsf(position1.z * interpolation + (1 - interpolation) * position0.z - position.z));
+			maxError = max(maxError, fabsf(fabsf(orientation.x * sampled.x + orientation.y * sampled.y + orientation.z * sampled.z + orientation.w * sampled.w) - 1));
+		}
+	}
+
+	return maxError;
+}
+
+void RunSamplingReport(string name, string path)
+{
+	const char *modeNames[] = { "baked", "local" };
+	unsigned int modeFlags[] = { MD5_LOAD_SERIAL, MD5_LOAD_SAMPLE_LOCAL };
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		MD5Anim animation(path, modeFlags[mode]);
+		if (animation.GetNumFrames() == 0)
+			return;
+
+		PoseBuffer pose;
+		pose.Allocate(1, animation.GetNumJoints());
+		int samples = 10000;
+		LARGE_INTEGER start;
+
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < samples; i++)
+			animation.SamplePose(animation.GetTotalAnimationTime() * i / samples, &pose);
+		double sampleNanoseconds = GetElapsedNanoseconds(start) / samples;
+
+		// El muestreo local interpola en espacio local y no tiene poses precalculadas con que compararse
+		float maxFrameError = modeFlags[mode] & MD5_LOAD_SAMPLE_LOCAL ? 0 : MeasureBakedSamplingError(animation);
+		Check(maxFrameError <= SKINNING_CHECK_TOLERANCE, name + "_anim_sampling_" + modeNames[mode], "max_frame_skeleton_error");
+
+		printf("{\"benchmark\":\"%s_anim_sampling_%s\",\"joints\":%d,\"static_joints\":%d,\"fixed_joints\":%d,"
+			   "\"animated_components\":%d,\"skipped_components\":%d,\"sample_ns\":%.0f,\"max_frame_skeleton_error\":%g}\n",
+			   name.c_str(), modeNames[mode], animation.GetNumJoints(), animation.GetNumStaticJoints(), animation.GetNumFixedJoints(),
+			   animation.GetNumAnimatedComponents(), animation.GetNumSkippedComponents(), sampleNanoseconds, maxFrameError);
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Skinning report
+
+int GetNumVertices(const MD5Mesh &model)
+{
+	int numVertices = 0;
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+		numVertices += model.meshes[i].vertices.size();
+
+	return numVertices;
+}
+
+void RunSkinningReport(string name, string path, int updates)
+{
+	MD5Mesh reference(path, NULL);
+	MD5Mesh palette(path, NULL);
+	palette.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+
+	if (reference.animation->GetNumFrames() == 0)
+		return;
+
+	// Ambos modelos avanzan igual; se compara cada vertice en varios tiempos del clip
+	float maxPositionError = 0, maxNormalError = 0;
+
+	for (int step = 0; step < 16; step++)
+	{
+		float deltaTime = reference.animation->GetTotalAnimationTime() / 16 + 0.001f * step;
+		reference.UpdateModel(deltaTime);
+		palette.UpdateModel(deltaTime);
+
+		for (int i = 0; i < (int)reference.meshes.size(); i++)
+		{
+			for (int j = 0; j < (int)reference.meshes[i].vertices.size(); j++)
+			{
+				const Vertex &expected = reference.meshes[i].vertices[j];
+				const Vertex &actual = palette.meshes[i].vertices[j];
+
+				maxPositionError = max(maxPositionError, fabsf(expected.position.x - actual.position.x));
+				maxPositionError = max(maxPositionError, fabsf(expected.position.y - actual.position.y));
+				maxPositionError = max(maxPositionError, fabsf(expected.position.z - actual.position.z));
+				maxNormalError = max(maxNormalError, fabsf(expected.normal.x - actual.normal.x));
+				maxNormalError = max(maxNormalError, fabsf(expected.normal.y - actual.normal.y));
+				maxNormalError = max(maxNormalError, fabsf(expected.normal.z - actual.normal.z));
+			}
+		}
+	}
+
+	MD5Mesh *models[] = { &reference, &palette };
+	double updateNanoseconds[2];
+	LARGE_INTEGER start;
+
+	for (int m = 0; m < 2; m++)
+	{
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < updates; i++)
+			models[m]->UpdateModel(1.0f / 60.0f);
+		updateNanoseconds[m] = GetElapsedNanoseconds(start) / updates;
+	}
+
+	int numVertices = GetNumVertices(reference);
+
+	Check(maxPositionError <= SKINNING_CHECK_TOLERANCE, name + "_skinning", "max_position_error");
+	Check(maxNormalError <= SKINNING_CHECK_TOLERANCE, name + "_skinning", "max_normal_error");
+
+	// Solo el stream dinamico se sube en cada actualizacion; el estatico se sube al crear los buffers
+	printf("{\"benchmark\":\"%s_skinning\",\"vertices\":%d,\"weights_update_ns\":%.0f,\"palette_update_ns\":%.0f,"
+		   "\"weights_ns_per_vertex\":%.2f,\"palette_ns_per_vertex\":%.2f,\"speedup\":%.2f,\"max_position_error\":%g,\"max_normal_error\":%g,"
+		   "\"upload_bytes_per_update\":%d,\"static_bytes\":%d}\n",
+		   name.c_str(), numVertices, updateNanoseconds[0], updateNanoseconds[1],
+		   updateNanoseconds[0] / numVertices, updateNanoseconds[1] / numVertices, updateNanoseconds[0] / updateNanoseconds[1],
+		   maxPositionError, maxNormalError, numVertices * (int)sizeof(Vertex), numVertices * (int)sizeof(StaticVertex));
+	fflush(stdout);
+}
+
+/**
+*	Mide cada kernel de la paleta por separado, sin muestrear animacion:
+*	la pose es la bind pose con cada joint girado y desplazado un poco, asi
+*	que sirve tambien para mallas sin clip como boy.
+**/
+bool HaveSamePositionsAndNormals(const vector<Vertex> &a, const vector<Vertex> &b)
+{
+	for (int i = 0; i < (int)a.size(); i++)
+	{
+		if (memcmp(&a[i].position, &b[i].position, sizeof(XMFLOAT3)) != 0 || memcmp(&a[i].normal, &b[i].normal, sizeof(XMFLOAT3)) != 0)
+			return false;
+	}
+
+	return a.size() == b.size();
+}
+
+float GetVectorLength(const XMFLOAT3 &v)
+{
+	return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+
+/**
+*	Cuaterniones duales contra el skinning por pesos (la referencia) y la
+*	paleta de matrices. Donde un vertice tiene un solo joint los tres
+*	metodos deben coincidir; donde mezcla varios, los cuaterniones duales
+*	se separan a proposito de la mezcla lineal, asi que se reporta aparte.
+*	Tambien se reporta la normal mas corta: la mezcla lineal acorta las
+*	normales en las articulaciones y los cuaterniones duales no.
+**/
+void RunDualQuaternionReport(string name, string path, int updates)
+{
+	MD5Mesh reference(path, NULL);
+	MD5Mesh palette(path, NULL);
+	MD5Mesh dualQuaternion(path, NULL);
+	palette.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+	dualQuaternion.SetSkinningMethod(SKINNING_DUAL_QUATERNION);
+
+	if (reference.animation->GetNumFrames() == 0)
+		return;
+
+	float maxRigidError = 0, maxBlendedError = 0, totalBlendedError = 0;
+	float minPaletteNormal = 1.0f, minDualQuaternionNormal = 1.0f;
+	int numBlended = 0;
+
+	for (int step = 0; step < 16; step++)
+	{
+		float deltaTime = reference.animation->GetTotalAnimationTime() / 16 + 0.001f * step;
+		reference.UpdateModel(deltaTime);
+		palette.UpdateModel(deltaTime);
+		dualQuaternion.UpdateModel(deltaTime);
+
+		for (int i = 0; i < (int)reference.meshes.size(); i++)
+		{
+			const InfluenceStreams &influences = dualQuaternion.meshes[i].influences;
+
+			for (int j = 0; j < (int)reference.meshes[i].vertices.size(); j++)
+			{
+				const Vertex &expected = reference.meshes[i].vertices[j];
+				const Vertex &actual = dualQuaternion.meshes[i].vertices[j];
+				XMFLOAT3 difference(actual.position.x - expected.position.x, actual.position.y - expected.position.y, actual.position.z - expected.position.z);
+				float error = GetVectorLength(difference);
+
+				if (influences.numInfluences < 2 || influences.weights[1][j] == 0)
+					maxRigidError = max(maxRigidError, error);
+				else
+				{
+					maxBlendedError = max(maxBlendedError, error);
+					totalBlendedError += error;
+					numBlended++;
+				}
+
+				minPaletteNormal = min(minPaletteNormal, GetVectorLength(palette.meshes[i].vertices[j].normal));
+				minDualQuaternionNormal = min(minDualQuaternionNormal, GetVectorLength(actual.normal));
+			}
+		}
+	}
+
+	MD5Mesh *models[] = { &reference, &palette, &dualQuaternion };
+	double updateNanoseconds[3];
+	LARGE_INTEGER start;
+
+	for (int m = 0; m < 3; m++)
+	{
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < updates; i++)
+			models[m]->UpdateModel(1.0f / 60.0f);
+		updateNanoseconds[m] = GetElapsedNanoseconds(start) / updates;
+	}
+
+	int numVertices = GetNumVertices(reference);
+
+	Check(maxRigidError <= SKINNING_CHECK_TOLERANCE, name + "_dual_quaternion", "max_rigid_error");
+
+	printf("{\"benchmark\":\"%s_dual_quaternion\",\"vertices\":%d,\"weights_update_ns\":%.0f,\"palette_update_ns\":%.0f,\"dual_quaternion_update_ns\":%.0f,"
+		   "\"dual_quaternion_vertices_per_s\":%.0f,\"speedup_vs_weights\":%.2f,\"max_rigid_error\":%g,\"blended_vertices\":%d,"
+		   "\"max_blended_difference\":%g,\"average_blended_difference\":%g,\"min_palette_normal_length\":%.4f,\"min_dual_quaternion_normal_length\":%.4f}\n",
+		   name.c_str(), numVertices, updateNanoseconds[0], updateNanoseconds[1], updateNanoseconds[2],
+		   numVertices * 1e9 / updateNanoseconds[2], updateNanoseconds[0] / updateNanoseconds[2], maxRigidError, numBlended / 16,
+		   maxBlendedError, numBlended > 0 ? totalBlendedError / numBlended : 0.0f, minPaletteNormal, minDualQuaternionNormal);
+	fflush(stdout);
+}
+
+void RunSkinningKernelReport(string name, string path, int passes)
+{
+	MD5Mesh model(path, NULL);
+	int numJoints = model.joints.size();
+
+	if (numJoints == 0)
+		return;
+
+	PoseBuffer pose;
+	pose.Allocate(1, numJoints);
+
+	for (int i = 0; i < numJoints; i++)
+	{
+		const Joint &joint = model.joints[i];
+		XMVECTOR axis = XMVector3Normalize(XMVectorSet(1.0f + i % 3, 0.5f + i % 5, 1.0f, 0.0f));
+		XMVECTOR orientation = XMQuaternionMultiply(XMLoadFloat4(&joint.orientation), XMQuaternionRotationAxis(axis, 0.05f * (i % 7 + 1)));
+
+		XMStoreFloat4A(&pose.GetOrientations(0)[i], XMQuaternionNormalize(orientation));
+		pose.GetPositions(0)[i] = XMFLOAT4A(joint.position.x + 0.01f * (i % 4), joint.position.y, joint.position.z - 0.01f * (i % 3), 1.0f);
+	}
+
+	model.palette.ComputePalette(pose);
+
+	// Mismas streams con un solo tramo al maximo de influencias, como antes de agrupar los vertices
+	vector<InfluenceStreams> paddedInfluences(model.meshes.size());
+	int numRuns = 0;
+
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+	{
+		const InfluenceStreams &influences = model.meshes[i].influences;
+		InfluenceRun run;
+		run.first = 0;
+		run.count = influences.numVertices;
+		run.numInfluences = influences.numInfluences > 0 ? influences.numInfluences : 1;
+
+		paddedInfluences[i] = influences;
+		paddedInfluences[i].runs.assign(1, run);
+		numRuns += influences.runs.size();
+	}
+
+	int numVertices = GetNumVertices(model);
+	vector<vector<Vertex> > scalarVertices;
+
+	for (int isa = SKINNING_ISA_SCALAR; isa <= GetSupportedSkinningISA(); isa++)
+	{
+		model.palette.SetISA((SkinningISA)isa);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (int i = 0; i < (int)model.meshes.size(); i++)
+				model.palette.SkinVertices(model.meshes[i].influences, &model.meshes[i].vertices[0]);
+		}
+		double nanoseconds = GetElapsedNanoseconds(start) / passes;
+
+		vector<Vertex> paddedVertices;
+		bool matchesPadded = true;
+
+		QueryPerformanceCounter(&start);
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (int i = 0; i < (int)model.meshes.size(); i++)
+			{
+				paddedVertices.resize(model.meshes[i].vertices.size());
+				model.palette.SkinVertices(paddedInfluences[i], &paddedVertices[0]);
+
+				if (pass == 0)
+					matchesPadded = matchesPadded && HaveSamePositionsAndNormals(paddedVertices, model.meshes[i].vertices);
+			}
+		}
+		double paddedNanoseconds = GetElapsedNanoseconds(start) / passes;
+
+		// Los kernels no usan FMA, asi que deben coincidir bit a bit con el escalar
+		bool matchesScalar = true;
+
+		for (int i = 0; i < (int)model.meshes.size(); i++)
+		{
+			if (isa == SKINNING_ISA_SCALAR)
+			{
+				scalarVertices.push_back(model.meshes[i].vertices);
+				continue;
+			}
+
+			for (int j = 0; j < (int)model.meshes[i].vertices.size(); j++)
+			{
+				const Vertex &expected = scalarVertices[i][j];
+				const Vertex &actual = model.meshes[i].vertices[j];
+
+				if (memcmp(&expected.position, &actual.position, sizeof(XMFLOAT3)) != 0 ||
+					memcmp(&expected.normal, &actual.normal, sizeof(XMFLOAT3)) != 0)
+					matchesScalar = false;
+			}
+		}
+
+		Check(matchesPadded, name + "_skinning_kernel", "matches_padded");
+		Check(matchesScalar, name + "_skinning_kernel", "matches_scalar");
+
+		printf("{\"benchmark\":\"%s_skinning_kernel\",\"isa\":\"%s\",\"vertices\":%d,\"influences\":%d,\"runs\":%d,\"ns_per_vertex\":%.2f,"
+			   "\"vertices_per_s\":%.0f,\"padded_ns_per_vertex\":%.2f,\"bucketing_speedup\":%.2f,\"matches_padded\":%s,\"matches_scalar\":%s}\n",
+			   name.c_str(), GetSkinningISAName((SkinningISA)isa), numVertices, model.meshes[0].influences.numInfluences, numRuns,
+			   nanoseconds / numVertices, numVertices * 1e9 / nanoseconds, paddedNanoseconds / numVertices, paddedNanoseconds / nanoseconds,
+			   matchesPadded ? "true" : "false", matchesScalar ? "true" : "false");
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Scaling report
+
+int GetNumProcessors()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return (int)systemInfo.dwNumberOfProcessors;
+}
+
+// 1, 2, 4, ... hasta el numero de procesadores, que siempre se incluye
+vector<int> GetThreadCounts()
+{
+	vector<int> threadCounts;
+	int numProcessors = GetNumProcessors();
+
+	for (int threads = 1; threads < numProcessors; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(numProcessors);
+
+	return threadCounts;
+}
+
+bool HaveSameVertices(const MD5Mesh &model, const vector<vector<Vertex> > &expected)
+{
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+	{
+		if (memcmp(&model.meshes[i].vertices[0], &expected[i][0], sizeof(Vertex) * expected[i].size()) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+void SaveVertices(const MD5Mesh &model, vector<vector<Vertex> > *vertices)
+{
+	vertices->resize(model.meshes.size());
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+		(*vertices)[i] = model.meshes[i].vertices;
+}
+
+/**
+*	Un solo personaje pesado: sus bloques de vertices se reparten entre
+*	pools de 1 a N hilos. Cada corrida reinicia el clip y compara los
+*	vertices finales contra la de un hilo, que deben coincidir bit a bit.
+**/
+void RunSingleModelScalingReport(string name, string path, SkinningMethod method, int updates)
+{
+	MD5Mesh model(path, NULL);
+	model.SetSkinningMethod(method);
+
+	if (model.animation->GetNumFrames() == 0)
+		return;
+
+	vector<int> threadCounts = GetThreadCounts();
+	vector<vector<Vertex> > serialVertices;
+	double serialNanoseconds = 0;
+
+	for (int t = 0; t < (int)threadCounts.size(); t++)
+	{
+		WorkerPool pool(threadCounts[t] - 1);
+		model.SetWorkerPool(&pool);
+		model.GetPlayback().SetTime(0);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < updates; i++)
+			model.UpdateModel(1.0f / 60.0f);
+		double nanoseconds = GetElapsedNanoseconds(start) / updates;
+
+		if (t == 0)
+		{
+			SaveVertices(model, &serialVertices);
+			serialNanoseconds = nanoseconds;
+		}
+
+		bool isDeterministic = Check(HaveSameVertices(model, serialVertices), name + "_scaling_single", "deterministic");
+
+		printf("{\"benchmark\":\"%s_scaling_single\",\"method\":\"%s\",\"threads\":%d,\"vertices\":%d,\"chunks\":%d,"
+			   "\"update_ns\":%.0f,\"speedup\":%.2f,\"deterministic\":%s}\n",
+			   name.c_str(), method == SKINNING_MATRIX_PALETTE ? "palette" : "weights", threadCounts[t], GetNumVertices(model),
+			   model.GetNumSkinningChunks(), nanoseconds, serialNanoseconds / nanoseconds, isDeterministic ? "true" : "false");
+		fflush(stdout);
+	}
+
+	model.SetWorkerPool(WorkerPool::GetShared());
+}
+
+// Muchos personajes: cada hilo anima modelos completos con MD5Mesh::UpdateModels
+void RunCrowdScalingReport(string name, string path, int numModels, int updates)
+{
+	vector<MD5Mesh*> models(numModels);
+	for (int i = 0; i < numModels; i++)
+		models[i] = new MD5Mesh(path, NULL);
+
+	vector<int> threadCounts = GetThreadCounts();
+	vector<vector<vector<Vertex> > > serialVertices(numModels);
+	double serialNanoseconds = 0;
+
+	for (int t = 0; t < (int)threadCounts.size() && models[0]->animation->GetNumFrames() > 0; t++)
+	{
+		WorkerPool pool(threadCounts[t] - 1);
+
+		for (int i = 0; i < numModels; i++)
+			models[i]->GetPlayback().SetTime(0.037f * i);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < updates; i++)
+			MD5Mesh::UpdateModels(&models[0], numModels, 1.0f / 60.0f, &pool);
+		double nanoseconds = GetElapsedNanoseconds(start) / updates;
+
+		bool isDeterministic = true;
+
+		for (int i = 0; i < numModels; i++)
+		{
+			if (t == 0)
+				SaveVertices(*models[i], &serialVertices[i]);
+			else if (!HaveSameVertices(*models[i], serialVertices[i]))
+				isDeterministic = false;
+		}
+
+		if (t == 0)
+			serialNanoseconds = nanoseconds;
+
+		Check(isDeterministic, name + "_scaling_crowd", "deterministic");
+
+		printf("{\"benchmark\":\"%s_scaling_crowd\",\"threads\":%d,\"models\":%d,\"update_ns\":%.0f,\"ns_per_model\":%.0f,"
+			   "\"speedup\":%.2f,\"deterministic\":%s}\n",
+			   name.c_str(), threadCounts[t], numModels, nanoseconds, nanoseconds / numModels, serialNanoseconds / nanoseconds,
+			   isDeterministic ? "true" : "false");
+		fflush(stdout);
+	}
+
+	for (int i = 0; i < numModels; i++)
+		delete models[i];
+}
+
+#pragma endregion
+
+#pragma region Output sink report
+
+/**
+*	Compara el camino anterior (skinning sobre meshes[i].vertices y luego
+*	una copia completa al buffer de destino, como el memcpy al vertex
+*	buffer mapeado) contra escribir directo en el destino con
+*	CPUVertexSink. Ambos deben producir los mismos vertices.
+**/
+void RunOutputSinkReport(string name, string path, SkinningMethod method, int updates)
+{
+	MD5Mesh copied(path, NULL);
+	MD5Mesh direct(path, NULL);
+	CPUVertexSink sink;
+
+	copied.SetSkinningMethod(method);
+	direct.SetSkinningMethod(method);
+	direct.SetOutputSink(&sink);
+
+	if (copied.animation->GetNumFrames() == 0)
+		return;
+
+	vector<vector<Vertex> > uploaded(copied.meshes.size());
+	for (int i = 0; i < (int)copied.meshes.size(); i++)
+		uploaded[i].resize(copied.meshes[i].vertices.size());
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	for (int update = 0; update < updates; update++)
+	{
+		copied.UpdateModel(1.0f / 60.0f);
+
+		for (int i = 0; i < (int)copied.meshes.size(); i++)
+			memcpy(&uploaded[i][0], &copied.meshes[i].vertices[0], sizeof(Vertex) * uploaded[i].size());
+	}
+	double copiedNanoseconds = GetElapsedNanoseconds(start) / updates;
+
+	QueryPerformanceCounter(&start);
+	for (int update = 0; update < updates; update++)
+		direct.UpdateModel(1.0f / 60.0f);
+	double directNanoseconds = GetElapsedNanoseconds(start) / updates;
+
+	bool isSame = sink.GetNumCompletedMeshes() == updates * (int)direct.meshes.size();
+
+	for (int i = 0; i < (int)direct.meshes.size() && isSame; i++)
+	{
+		const vector<Vertex> *output = sink.GetVertices(&direct.meshes[i]);
+		isSame = output != NULL && memcmp(&(*output)[0], &uploaded[i][0], sizeof(Vertex) * uploaded[i].size()) == 0;
+	}
+
+	Check(isSame, name + "_output_sink", "same_vertices");
+
+	printf("{\"benchmark\":\"%s_output_sink\",\"method\":\"%s\",\"vertices\":%d,\"copy_update_ns\":%.0f,\"direct_update_ns\":%.0f,"
+		   "\"speedup\":%.2f,\"same_vertices\":%s}\n",
+		   name.c_str(), method == SKINNING_MATRIX_PALETTE ? "palette" : "weights", GetNumVertices(direct),
+		   copiedNanoseconds, directNanoseconds, copiedNanoseconds / directNanoseconds, isSame ? "true" : "false");
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Influence pruning report
+
+// Limita las influencias de la paleta a 1..MAX_BONE_INFLUENCES y mide el costo de skinning y el desplazamiento que causa
+void RunInfluencePruningReport(string name, string path, int updates)
+{
+	for (int maxInfluences = 1; maxInfluences <= MAX_BONE_INFLUENCES; maxInfluences++)
+	{
+		MD5Mesh model(path, NULL, MD5_LOAD_MAX_INFLUENCES(maxInfluences));
+
+		if (model.animation->GetNumFrames() == 0)
+			return;
+
+		model.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		for (int update = 0; update < updates; update++)
+			model.UpdateModel(1.0f / 60.0f);
+		double nanoseconds = GetElapsedNanoseconds(start) / updates;
+
+		InfluencePruningStats stats = model.MeasureInfluencePruning();
+
+		printf("{\"benchmark\":\"%s_influence_pruning\",\"max_influences\":%d,\"vertices\":%d,\"pruned_vertices\":%d,\"frames\":%d,"
+			   "\"palette_update_ns\":%.0f,\"max_displacement\":%g,\"average_displacement\":%g}\n",
+			   name.c_str(), stats.maxInfluences, stats.numVertices, stats.numPrunedVertices, stats.numFrames,
+			   nanoseconds, stats.maxDisplacement, stats.averageDisplacement);
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Quantization report
+
+// Generador congruencial fijo para que las normales de prueba sean las mismas en cada corrida
+float NextRandom(unsigned int *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) / 16777216.0f * 2.0f - 1.0f;
+}
+
+float GetAngleBetween(const XMFLOAT3 &a, const XMFLOAT3 &b)
+{
+	float lengths = sqrtf((a.x * a.x + a.y * a.y + a.z * a.z) * (b.x * b.x + b.y * b.y + b.z * b.z));
+	if (lengths == 0)
+		return 0;
+
+	float cosine = (a.x * b.x + a.y * b.y + a.z * b.z) / lengths;
+	return acosf(cosine > 1.0f ? 1.0f : (cosine < -1.0f ? -1.0f : cosine));
+}
+
+// Error de posicion en pasos de 16 bits del eje con mayor error; un valor > 0.5 indica recorte
+float GetPositionErrorInSteps(const XMFLOAT3 &decoded, const XMFLOAT3 &expected, const QuantizationBounds &bounds)
+{
+	float errors[3] =
+	{
+		fabsf(decoded.x - expected.x) / bounds.extent.x,
+		fabsf(decoded.y - expected.y) / bounds.extent.y,
+		fabsf(decoded.z - expected.z) / bounds.extent.z
+	};
+
+	float maxError = errors[0] > errors[1] ? errors[0] : errors[1];
+	return (maxError > errors[2] ? maxError : errors[2]) * QUANTIZED_POSITION_STEPS;
+}
+
+/**
+*	Primero codifica y decodifica vectores aleatorios para acotar el error
+*	del formato por si solo. Luego anima el modelo con salida cuantizada y
+*	compara cada vertice decodificado contra la salida en float del mismo
+*	frame, que queda en meshes[i].vertices.
+**/
+void RunQuantizationReport(string name, string path, int updates)
+{
+	unsigned int state = 12345;
+	QuantizationBounds unitBounds;
+	unitBounds.min = XMFLOAT4(-1.0f, -1.0f, -1.0f, 0.0f);
+	unitBounds.extent = XMFLOAT4(2.0f, 2.0f, 2.0f, 0.0f);
+
+	float maxRoundTripSteps = 0, maxRoundTripAngle = 0;
+
+	for (int i = 0; i < 100000; i++)
+	{
+		Vertex vertex;
+		vertex.position = XMFLOAT3(NextRandom(&state), NextRandom(&state), NextRandom(&state));
+		vertex.normal = XMFLOAT3(NextRandom(&state), NextRandom(&state), NextRandom(&state));
+
+		QuantizedVertex quantized;
+		EncodeVertices(&vertex, 1, unitBounds, &quantized);
+		Vertex decoded = DecodeVertex(quantized, unitBounds);
+
+		float steps = GetPositionErrorInSteps(decoded.position, vertex.position, unitBounds);
+		float angle = GetAngleBetween(decoded.normal, vertex.normal);
+		maxRoundTripSteps = steps > maxRoundTripSteps ? steps : maxRoundTripSteps;
+		maxRoundTripAngle = angle > maxRoundTripAngle ? angle : maxRoundTripAngle;
+	}
+
+	MD5Mesh floatModel(path, NULL);
+	MD5Mesh referenceModel(path, NULL);
+	MD5Mesh quantizedModel(path, NULL);
+	CPUVertexSink sink;
+
+	if (floatModel.animation->GetNumFrames() == 0)
+		return;
+
+	floatModel.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+	referenceModel.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+	quantizedModel.SetSkinningMethod(SKINNING_MATRIX_PALETTE);
+	quantizedModel.SetOutputSink(&sink);
+
+	// La salida cuantizada no debe tocar los vertices en bind pose de la malla
+	vector<vector<Vertex> > bindVertices;
+	SaveVertices(quantizedModel, &bindVertices);
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	quantizedModel.SetOutputFormat(VERTEX_OUTPUT_QUANTIZED);
+	double boundsNanoseconds = GetElapsedNanoseconds(start);
+
+	QueryPerformanceCounter(&start);
+	for (int update = 0; update < updates; update++)
+		floatModel.UpdateModel(1.0f / 60.0f);
+	double floatNanoseconds = GetElapsedNanoseconds(start) / updates;
+
+	float maxSteps = 0, maxAngle = 0;
+	int numClamped = 0;
+	double quantizedNanoseconds = 0;
+
+	for (int update = 0; update < updates; update++)
+	{
+		QueryPerformanceCounter(&start);
+		quantizedModel.UpdateModel(1.0f / 60.0f);
+		quantizedNanoseconds += GetElapsedNanoseconds(start);
+
+		// Sin destino, el modelo de referencia deja la salida en float en sus meshes[i].vertices
+		referenceModel.UpdateModel(1.0f / 60.0f);
+
+		const QuantizationBounds &bounds = quantizedModel.GetQuantizationBounds();
+
+		for (int i = 0; i < (int)quantizedModel.meshes.size(); i++)
+		{
+			const Mesh &mesh = quantizedModel.meshes[i];
+			const Mesh &reference = referenceModel.meshes[i];
+			const QuantizedVertex *output = sink.GetQuantizedVertices(&mesh);
+
+			for (int j = 0; output != NULL && j < (int)mesh.vertices.size(); j++)
+			{
+				Vertex decoded = DecodeVertex(output[j], bounds);
+				float steps = GetPositionErrorInSteps(decoded.position, reference.vertices[j].position, bounds);
+				float angle = GetAngleBetween(decoded.normal, reference.vertices[j].normal);
+
+				if (steps > 0.5f + 1e-2f)
+					numClamped++;
+
+				maxSteps = steps > maxSteps ? steps : maxSteps;
+				maxAngle = angle > maxAngle ? angle : maxAngle;
+			}
+		}
+	}
+	quantizedNanoseconds /= updates;
+
+	bool keepsBindPose = HaveSameVertices(quantizedModel, bindVertices);
+
+	int numVertices = GetNumVertices(quantizedModel);
+
+	// Medio paso mas el redondeo en float, el mismo margen con el que se cuentan los vertices recortados
+	Check(maxRoundTripSteps <= 0.5f + 1e-2f, "quantization_roundtrip", "max_position_error_steps");
+	Check(numClamped == 0, name + "_quantized_output", "within_bounds");
+	Check(keepsBindPose, name + "_quantized_output", "keeps_bind_pose");
+
+	printf("{\"benchmark\":\"quantization_roundtrip\",\"samples\":100000,\"max_position_error_steps\":%.3f,\"max_normal_error_rad\":%.6f}\n",
+		   maxRoundTripSteps, maxRoundTripAngle);
+	printf("{\"benchmark\":\"%s_quantized_output\",\"vertices\":%d,\"frame_bounds_ns\":%.0f,\"float_update_ns\":%.0f,\"quantized_update_ns\":%.0f,"
+		   "\"float_upload_bytes\":%d,\"quantized_upload_bytes\":%d,\"max_position_error_steps\":%.3f,\"max_normal_error_rad\":%.6f,"
+		   "\"clamped_vertices\":%d,\"within_bounds\":%s,\"keeps_bind_pose\":%s}\n",
+		   name.c_str(), numVertices, boundsNanoseconds, floatNanoseconds, quantizedNanoseconds,
+		   numVertices * (int)sizeof(Vertex), numVertices * (int)sizeof(QuantizedVertex), maxSteps, maxAngle,
+		   numClamped, numClamped == 0 ? "true" : "false", keepsBindPose ? "true" : "false");
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Tangent frame report
+
+/**
+*	Anima el mismo modelo con salida en float y con marcos tangentes
+*	(CPUVertexSink) para cada metodo de skinning. Con cuaterniones duales
+*	la normal del marco debe coincidir con la de la salida en float salvo
+*	por los 16 bits; con pesos y paleta los marcos mezclan rotaciones y
+*	las normales mezclan vectores, asi que se separan en las articulaciones.
+**/
+void RunTangentFrameReport(string name, string path, int updates)
+{
+	SkinningMethod methods[] = { SKINNING_WEIGHTS, SKINNING_MATRIX_PALETTE, SKINNING_DUAL_QUATERNION };
+	const char *methodNames[] = { "weights", "palette", "dual_quaternion" };
+
+	for (int m = 0; m < 3; m++)
+	{
+		MD5Mesh floatModel(path, NULL);
+		MD5Mesh frameModel(path, NULL);
+		CPUVertexSink sink;
+
+		if (floatModel.animation->GetNumFrames() == 0)
+			return;
+
+		floatModel.SetSkinningMethod(methods[m]);
+		frameModel.SetSkinningMethod(methods[m]);
+		frameModel.SetOutputSink(&sink);
+		frameModel.SetOutputFormat(VERTEX_OUTPUT_TANGENT_FRAME);
+
+		vector<vector<Vertex> > bindVertices;
+		SaveVertices(frameModel, &bindVertices);
+
+		float maxNormalAngle = 0, totalNormalAngle = 0, maxPositionError = 0, maxTangentDot = 0;
+		int numSamples = 0, numFlipped = 0;
+
+		for (int step = 0; step < 16; step++)
+		{
+			float deltaTime = floatModel.animation->GetTotalAnimationTime() / 16 + 0.001f * step;
+			floatModel.UpdateModel(deltaTime);
+			frameModel.UpdateModel(deltaTime);
+
+			for (int i = 0; i < (int)frameModel.meshes.size(); i++)
+			{
+				const Mesh &mesh = frameModel.meshes[i];
+				const TangentFrameVertex *output = sink.GetTangentFrameVertices(&mesh);
+
+				for (int j = 0; output != NULL && j < (int)mesh.vertices.size(); j++)
+				{
+					const Vertex &expected = floatModel.meshes[i].vertices[j];
+					XMFLOAT3 normal;
+					XMFLOAT4 tangent;
+					DecodeTangentFrame(output[j].tangentFrame, &normal, &tangent);
+
+					float angle = GetAngleBetween(normal, expected.normal);
+					maxNormalAngle = max(maxNormalAngle, angle);
+					totalNormalAngle += angle;
+					numSamples++;
+
+					maxPositionError = max(maxPositionError, fabsf(output[j].position.x - expected.position.x));
+					maxPositionError = max(maxPositionError, fabsf(output[j].position.y - expected.position.y));
+					maxPositionError = max(maxPositionError, fabsf(output[j].position.z - expected.position.z));
+					maxTangentDot = max(maxTangentDot, fabsf(normal.x * tangent.x + normal.y * tangent.y + normal.z * tangent.z));
+
+					if ((tangent.w < 0) != (mesh.staticVertices[j].tangent.w < 0))
+						numFlipped++;
+				}
+			}
+		}
+
+		bool keepsBindPose = HaveSameVertices(frameModel, bindVertices);
+
+		MD5Mesh *models[] = { &floatModel, &frameModel };
+		double updateNanoseconds[2];
+		LARGE_INTEGER start;
+
+		for (int k = 0; k < 2; k++)
+		{
+			QueryPerformanceCounter(&start);
+			for (int i = 0; i < updates; i++)
+				models[k]->UpdateModel(1.0f / 60.0f);
+			updateNanoseconds[k] = GetElapsedNanoseconds(start) / updates;
+		}
+
+		int numVertices = GetNumVertices(floatModel);
+		string benchmark = name + "_tangent_frame_" + methodNames[m];
+
+		Check(maxPositionError <= SKINNING_CHECK_TOLERANCE, benchmark, "max_position_error");
+		Check(maxTangentDot <= 1e-3f, benchmark, "max_tangent_normal_dot");
+		Check(numFlipped == 0, benchmark, "flipped_bitangents");
+		Check(keepsBindPose, benchmark, "keeps_bind_pose");
+
+		// Con cuaterniones duales el marco y la normal en float giran igual; solo queda el error de los 16 bits
+		if (methods[m] == SKINNING_DUAL_QUATERNION)
+			Check(maxNormalAngle <= 1e-3f, benchmark, "max_normal_angle_rad");
+
+		printf("{\"benchmark\":\"%s_tangent_frame\",\"method\":\"%s\",\"vertices\":%d,\"float_update_ns\":%.0f,\"tangent_frame_update_ns\":%.0f,"
+			   "\"float_upload_bytes\":%d,\"tangent_frame_upload_bytes\":%d,\"max_position_error\":%g,\"max_normal_angle_rad\":%.6f,"
+			   "\"average_normal_angle_rad\":%.6f,\"max_tangent_normal_dot\":%.6f,\"flipped_bitangents\":%d,\"keeps_bind_pose\":%s}\n",
+			   name.c_str(), methodNames[m], numVertices, updateNanoseconds[0], updateNanoseconds[1],
+			   numVertices * (int)sizeof(Vertex), numVertices * (int)sizeof(TangentFrameVertex), maxPositionError, maxNormalAngle,
+			   numSamples > 0 ? totalNormalAngle / numSamples : 0.0f, maxTangentDot, numFlipped, keepsBindPose ? "true" : "false");
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Index order report
+
+struct IndexOrderStats
+{
+	int numTriangles;
+	int numVertices;
+	int misses[2];
+	float dynamicOverfetch;
+	float staticOverfetch;
+	int indexBytes;
+};
+
+// Tamanos de cache post-transform que se simulan y cache de lectura de vertices
+const int simulatedCacheSizes[2] = { 16, 32 };
+const int simulatedFetchCacheBytes = 1024;
+
+IndexOrderStats MeasureIndexOrder(const MD5Mesh &model)
+{
+	IndexOrderStats stats;
+	ZeroMemory(&stats, sizeof(stats));
+	float dynamicOverfetch = 0, staticOverfetch = 0;
+
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+	{
+		const Mesh &mesh = model.meshes[i];
+		int numVertices = mesh.vertices.size();
+
+		stats.numTriangles += mesh.indices.size() / 3;
+		stats.numVertices += numVertices;
+
+		for (int c = 0; c < 2; c++)
+			stats.misses[c] += SimulateVertexCache(mesh.indices, numVertices, simulatedCacheSizes[c]);
+
+		// Mismo criterio que CreateDirectXResources para los indices de 16 bits
+		stats.indexBytes += mesh.indices.size() * (numVertices <= 65536 ? sizeof(unsigned short) : sizeof(int));
+		dynamicOverfetch += SimulateVertexFetch(mesh.indices, numVertices, sizeof(Vertex), simulatedFetchCacheBytes) * numVertices;
+		staticOverfetch += SimulateVertexFetch(mesh.indices, numVertices, sizeof(StaticVertex), simulatedFetchCacheBytes) * numVertices;
+	}
+
+	stats.dynamicOverfetch = stats.numVertices > 0 ? dynamicOverfetch / stats.numVertices : 0;
+	stats.staticOverfetch = stats.numVertices > 0 ? staticOverfetch / stats.numVertices : 0;
+
+	return stats;
+}
+
+// Compara los vertices de ambos modelos por su indice en el archivo
+bool HaveSameVerticesByFileIndex(const MD5Mesh &a, const MD5Mesh &b)
+{
+	for (int i = 0; i < (int)a.meshes.size(); i++)
+	{
+		const Mesh &meshA = a.meshes[i];
+		const Mesh &meshB = b.meshes[i];
+		// Con vertices unidos los indices del archivo tienen huecos
+		map<int, int> fileOrderB;
+
+		for (int j = 0; j < (int)meshB.vertices.size(); j++)
+			fileOrderB[meshB.vertexInfo[j].vertexIndex] = j;
+
+		for (int j = 0; j < (int)meshA.vertices.size(); j++)
+		{
+			const Vertex &vertexA = meshA.vertices[j];
+			const Vertex &vertexB = meshB.vertices[fileOrderB[meshA.vertexInfo[j].vertexIndex]];
+
+			if (memcmp(&vertexA, &vertexB, sizeof(Vertex)) != 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+*	Las dos cargas son del texto (sin binario), asi que la diferencia de
+*	tiempo es lo que cuesta optimizar. El skinning de ambas debe dar los
+*	mismos vertices una vez que se comparan por indice del archivo.
+**/
+void RunIndexOrderReport(string name, string path, int loads, int updates)
+{
+	unsigned int flags[2] = { MD5_LOAD_SKIP_CACHE | MD5_LOAD_KEEP_FILE_ORDER, MD5_LOAD_SKIP_CACHE };
+	double loadNanoseconds[2];
+	LARGE_INTEGER start;
+
+	for (int m = 0; m < 2; m++)
+	{
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < loads; i++)
+			MD5Mesh model(path, NULL, flags[m]);
+		loadNanoseconds[m] = GetElapsedNanoseconds(start) / loads;
+	}
+
+	MD5Mesh fileOrder(path, NULL, flags[0]);
+	MD5Mesh optimized(path, NULL, flags[1]);
+	MD5Mesh *models[] = { &fileOrder, &optimized };
+	IndexOrderStats stats[2] = { MeasureIndexOrder(fileOrder), MeasureIndexOrder(optimized) };
+	double updateNanoseconds[2] = { 0, 0 };
+	bool isSame = true;
+
+	if (fileOrder.animation->GetNumFrames() > 0)
+	{
+		for (int m = 0; m < 2; m++)
+		{
+			models[m]->UpdateModel(0.3f);
+
+			QueryPerformanceCounter(&start);
+			for (int i = 0; i < updates; i++)
+				models[m]->UpdateModel(1.0f / 60.0f);
+			updateNanoseconds[m] = GetElapsedNanoseconds(start) / updates;
+		}
+
+		isSame = HaveSameVerticesByFileIndex(fileOrder, optimized);
+	}
+
+	Check(isSame, name + "_index_order", "same_vertices");
+
+	printf("{\"benchmark\":\"%s_index_order\",\"triangles\":%d,\"vertices\":%d,\"file_load_ns\":%.0f,\"optimized_load_ns\":%.0f,"
+		   "\"acmr_fifo16_before\":%.3f,\"acmr_fifo16_after\":%.3f,\"acmr_fifo32_before\":%.3f,\"acmr_fifo32_after\":%.3f,"
+		   "\"atvr_fifo16_before\":%.3f,\"atvr_fifo16_after\":%.3f,\"dynamic_overfetch_before\":%.3f,\"dynamic_overfetch_after\":%.3f,"
+		   "\"static_overfetch_before\":%.3f,\"static_overfetch_after\":%.3f,\"index_bytes_32bit\":%d,\"index_bytes\":%d,"
+		   "\"weights_update_ns_before\":%.0f,\"weights_update_ns_after\":%.0f,\"same_vertices\":%s}\n",
+		   name.c_str(), stats[1].numTriangles, stats[1].numVertices, loadNanoseconds[0], loadNanoseconds[1],
+		   (float)stats[0].misses[0] / stats[0].numTriangles, (float)stats[1].misses[0] / stats[1].numTriangles,
+		   (float)stats[0].misses[1] / stats[0].numTriangles, (float)stats[1].misses[1] / stats[1].numTriangles,
+		   (float)stats[0].misses[0] / stats[0].numVertices, (float)stats[1].misses[0] / stats[1].numVertices,
+		   stats[0].dynamicOverfetch, stats[1].dynamicOverfetch, stats[0].staticOverfetch, stats[1].staticOverfetch,
+		   stats[1].numTriangles * 3 * (int)sizeof(int), stats[1].indexBytes, updateNanoseconds[0], updateNanoseconds[1],
+		   isSame ? "true" : "false");
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Duplicate report
+
+// Cuenta vertices y pesos de todas las mallas
+void CountVerticesAndWeights(const MD5Mesh &model, int *numVertices, int *numWeights)
+{
+	*numVertices = *numWeights = 0;
+
+	for (int i = 0; i < (int)model.meshes.size(); i++)
+	{
+		*numVertices += model.meshes[i].vertices.size();
+		*numWeights += model.meshes[i].weights.size();
+	}
+}
+
+/**
+*	Compara las esquinas de cada triangulo (por triangleIndex, que no
+*	cambia al unir ni al reordenar): la posicion debe ser identica y se
+*	reporta el angulo maximo entre normales, que cambia donde se unieron
+*	vertices y la normal promedia ahora los triangulos de todas las copias.
+**/
+void CompareTriangleCorners(const MD5Mesh &a, const MD5Mesh &b, float *maxPositionError, float *maxNormalAngle)
+{
+	for (int i = 0; i < (int)a.meshes.size(); i++)
+	{
+		const Mesh &meshA = a.meshes[i];
+		const Mesh &meshB = b.meshes[i];
+		vector<int> trianglesB(meshB.triangles.size());
+
+		for (int t = 0; t < (int)meshB.triangles.size(); t++)
+			trianglesB[meshB.triangles[t].triangleIndex] = t;
+
+		for (int t = 0; t < (int)meshA.triangles.size(); t++)
+		{
+			const Triangle &triangleA = meshA.triangles[t];
+			const Triangle &triangleB = meshB.triangles[trianglesB[triangleA.triangleIndex]];
+
+			for (int k = 0; k < 3; k++)
+			{
+				const Vertex &vertexA = meshA.vertices[triangleA.vertexIndices[k]];
+				const Vertex &vertexB = meshB.vertices[triangleB.vertexIndices[k]];
+				XMFLOAT3 difference(vertexA.position.x - vertexB.position.x, vertexA.position.y - vertexB.position.y, vertexA.position.z - vertexB.position.z);
+
+				*maxPositionError = max(*maxPositionError, GetVectorLength(difference));
+				*maxNormalAngle = max(*maxNormalAngle, GetAngleBetween(vertexA.normal, vertexB.normal));
+			}
+		}
+	}
+}
+
+/**
+*	Carga cada malla con y sin MD5_LOAD_KEEP_DUPLICATES: cuantos vertices
+*	y pesos se quitaron, el costo de la carga y de la actualizacion con
+*	cada metodo, y la verificacion de que las esquinas de los triangulos
+*	quedan en la misma posicion en todo el clip.
+**/
+void RunDuplicateReport(string name, string path, int loads, int updates)
+{
+	unsigned int flags[2] = { MD5_LOAD_SKIP_CACHE | MD5_LOAD_KEEP_DUPLICATES, MD5_LOAD_SKIP_CACHE };
+	double loadNanoseconds[2];
+	LARGE_INTEGER start;
+
+	for (int m = 0; m < 2; m++)
+	{
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < loads; i++)
+			MD5Mesh model(path, NULL, flags[m]);
+		loadNanoseconds[m] = GetElapsedNanoseconds(start) / loads;
+	}
+
+	MD5Mesh original(path, NULL, flags[0]);
+	MD5Mesh welded(path, NULL, flags[1]);
+	MD5Mesh *models[] = { &original, &welded };
+	int numVertices[2], numWeights[2];
+
+	for (int m = 0; m < 2; m++)
+		CountVerticesAndWeights(*models[m], &numVertices[m], &numWeights[m]);
+
+	SkinningMethod methods[] = { SKINNING_WEIGHTS, SKINNING_MATRIX_PALETTE };
+	double updateNanoseconds[2][2] = { { 0, 0 }, { 0, 0 } };
+	float maxPositionError = 0, maxNormalAngle = 0;
+
+	if (original.animation->GetNumFrames() > 0)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			for (int m = 0; m < 2; m++)
+			{
+				models[m]->SetSkinningMethod(methods[k]);
+				models[m]->GetPlayback().SetTime(0);
+			}
+
+			for (int step = 0; step < 16; step++)
+			{
+				for (int m = 0; m < 2; m++)
+					models[m]->UpdateModel(original.animation->GetTotalAnimationTime() / 16 + 0.001f * step);
+
+				CompareTriangleCorners(original, welded, &maxPositionError, &maxNormalAngle);
+			}
+
+			for (int m = 0; m < 2; m++)
+			{
+				QueryPerformanceCounter(&start);
+				for (int i = 0; i < updates; i++)
+					models[m]->UpdateModel(1.0f / 60.0f);
+				updateNanoseconds[k][m] = GetElapsedNanoseconds(start) / updates;
+			}
+		}
+	}
+
+	Check(maxPositionError == 0, name + "_duplicates", "max_corner_position_error");
+
+	printf("{\"benchmark\":\"%s_duplicates\",\"vertices_before\":%d,\"vertices_after\":%d,\"weights_before\":%d,\"weights_after\":%d,"
+		   "\"load_ns_before\":%.0f,\"load_ns_after\":%.0f,\"weights_update_ns_before\":%.0f,\"weights_update_ns_after\":%.0f,"
+		   "\"palette_update_ns_before\":%.0f,\"palette_update_ns_after\":%.0f,\"max_corner_position_error\":%g,"
+		   "\"max_corner_normal_angle_rad\":%.6f}\n",
+		   name.c_str(), numVertices[0], numVertices[1], numWeights[0], numWeights[1], loadNanoseconds[0], loadNanoseconds[1],
+		   updateNanoseconds[0][0], updateNanoseconds[0][1], updateNanoseconds[1][0], updateNanoseconds[1][1], maxPositionError, maxNormalAngle);
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Baked animation report
+
+/**
+*	Hornea el clip del modelo y compara la reproduccion horneada contra el
+*	skinning en vivo: bytes del horneado contra los que retiene el clip,
+*	cuanto tarda el horneado, el error de los vertices interpolados contra
+*	el skinning por pesos en tiempos fuera de las muestras y el costo por
+*	modelo de actualizar una multitud con cada modo.
+*
+*	Se verifica en pasos de cuantizacion de la caja de cada frame: en las
+*	muestras el horneado debe dar el skinning en vivo a medio paso, y
+*	entre ellas la interpolacion lineal de los vertices en vivo de sus dos
+*	muestras, tambien a medio paso. La diferencia contra el skinning en
+*	vivo entre muestras solo se reporta: depende de cuanto giran los
+*	joints entre muestras (el clip sintetico tiene una pose al azar en
+*	cada frame).
+**/
+void RunBakedAnimationReport(string name, string path, float sampleRate, int numModels, int updates)
+{
+	MD5Mesh reference(path, NULL);
+
+	if (reference.animation->GetNumFrames() == 0)
+		return;
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	bool isBaked = reference.BakeAnimation(path + ".md5bake", sampleRate);
+	double bakeNanoseconds = GetElapsedNanoseconds(start);
+
+	BakedAnimation baked;
+	if (!isBaked || !reference.LoadBakedAnimation(&baked, sampleRate))
+	{
+		fprintf(stderr, "No se pudo hornear %s.\n", path.c_str());
+		return;
+	}
+
+	// Error contra el skinning por pesos sobre las muestras (solo cuantizacion) y a la mitad entre
+	// ellas, donde se interpolan vertices en lugar de joints
+	MD5Mesh bakedModel(path, NULL);
+	bakedModel.SetBakedAnimation(&baked);
+	reference.SetBakedAnimation(NULL);
+
+	float duration = reference.animation->GetTotalAnimationTime();
+	float maxPositionError[2] = { 0, 0 }, totalPositionError[2] = { 0, 0 }, maxNormalAngle[2] = { 0, 0 }, maxSteps[2] = { 0, 0 };
+	int numSamples[2] = { 0, 0 };
+	int numSteps = baked.GetNumFrames() * 2;
+
+	// Vertices en vivo de cada muestra, para comparar la interpolacion entre muestras
+	vector<vector<vector<Vertex> > > sampleVertices(baked.GetNumFrames());
+
+	for (int step = 0; step < numSteps; step += 2)
+	{
+		reference.GetPlayback().SetTime(step * duration / numSteps);
+		reference.UpdateModel(0);
+		SaveVertices(reference, &sampleVertices[step / 2]);
+	}
+
+	for (int step = 0; step < numSteps; step++)
+	{
+		float time = step * duration / numSteps;
+		int between = step % 2;
+		reference.GetPlayback().SetTime(time);
+		bakedModel.GetPlayback().SetTime(time);
+		reference.UpdateModel(0);
+		bakedModel.UpdateModel(0);
+
+		int frame0, frame1;
+		float interpolation;
+		baked.GetFrames(time, &frame0, &frame1, &interpolation);
+
+		// Con la caja mas grande de las dos muestras, medio paso acota el error de ambas
+		QuantizationBounds bounds = baked.GetFrameBounds(frame0);
+		const QuantizationBounds &bounds1 = baked.GetFrameBounds(frame1);
+		bounds.extent = XMFLOAT4(max(bounds.extent.x, bounds1.extent.x), max(bounds.extent.y, bounds1.extent.y), max(bounds.extent.z, bounds1.extent.z), 0);
+
+		for (int i = 0; i < (int)reference.meshes.size(); i++)
+		{
+			for (int j = 0; j < (int)reference.meshes[i].vertices.size(); j++)
+			{
+				const Vertex &expected = reference.meshes[i].vertices[j];
+				const Vertex &actual = bakedModel.meshes[i].vertices[j];
+				XMFLOAT3 difference(actual.position.x - expected.position.x, actual.position.y - expected.position.y, actual.position.z - expected.position.z);
+
+				float error = GetVectorLength(difference);
+				maxPositionError[between] = max(maxPositionError[between], error);
+				totalPositionError[between] += error;
+				maxNormalAngle[between] = max(maxNormalAngle[between], GetAngleBetween(actual.normal, expected.normal));
+				numSamples[between]++;
+
+				const XMFLOAT3 &position0 = sampleVertices[frame0][i][j].position;
+				const XMFLOAT3 &position1 = sampleVertices[frame1][i][j].position;
+				XMFLOAT3 interpolated(position0.x + (position1.x - position0.x) * interpolation,
+									  position0.y + (position1.y - position0.y) * interpolation,
+									  position0.z + (position1.z - position0.z) * interpolation);
+				maxSteps[between] = max(maxSteps[between], GetPositionErrorInSteps(actual.position, interpolated, bounds));
+			}
+		}
+	}
+
+	// Multitud: misma carga para los tres modos, cada modelo en un tiempo distinto y sin pool
+	// para medir solo el trabajo de cada modelo
+	const char *modeNames[] = { "weights", "palette", "baked" };
+	double updateNanoseconds[3];
+	vector<MD5Mesh*> models(numModels);
+
+	for (int i = 0; i < numModels; i++)
+	{
+		models[i] = new MD5Mesh(path, NULL);
+		models[i]->SetWorkerPool(NULL);
+	}
+
+	for (int m = 0; m < 3; m++)
+	{
+		for (int i = 0; i < numModels; i++)
+		{
+			models[i]->SetSkinningMethod(m == 1 ? SKINNING_MATRIX_PALETTE : SKINNING_WEIGHTS);
+			models[i]->SetBakedAnimation(m == 2 ? &baked : NULL);
+			models[i]->GetPlayback().SetTime(0.037f * i);
+		}
+
+		QueryPerformanceCounter(&start);
+		for (int k = 0; k < updates; k++)
+		{
+			for (int i = 0; i < numModels; i++)
+				models[i]->UpdateModel(1.0f / 60.0f);
+		}
+		updateNanoseconds[m] = GetElapsedNanoseconds(start) / ((double)updates * numModels);
+	}
+
+	for (int i = 0; i < numModels; i++)
+		delete models[i];
+
+	int numVertices = GetNumVertices(reference);
+	string benchmark = name + "_baked_animation";
+
+	// Medio paso mas el redondeo en float del decodificado y de la interpolacion
+	Check(maxSteps[0] <= 0.5f + 2e-2f, benchmark, "max_position_error_at_samples");
+	Check(maxSteps[1] <= 0.5f + 2e-2f, benchmark, "max_interpolation_error_between_samples");
+
+	printf("{\"benchmark\":\"%s_baked_animation\",\"sample_rate\":%.0f,\"clip_frames\":%d,\"baked_frames\":%d,\"vertices\":%d,"
+		   "\"bake_ms\":%.2f,\"bake_bytes\":%lu,\"clip_retained_bytes\":%lu,\"models\":%d",
+		   name.c_str(), sampleRate, reference.animation->GetNumFrames(), baked.GetNumFrames(), numVertices,
+		   bakeNanoseconds / 1e6, (unsigned long)baked.GetMemoryUsage(), (unsigned long)reference.animation->GetMemoryUsage(),
+		   numModels);
+
+	const char *sampleNames[] = { "at_samples", "between_samples" };
+
+	for (int k = 0; k < 2; k++)
+	{
+		printf(",\"max_position_error_%s\":%g,\"average_position_error_%s\":%g,\"max_normal_angle_rad_%s\":%.6f,"
+			   "\"max_interpolation_error_steps_%s\":%.3f",
+			   sampleNames[k], maxPositionError[k], sampleNames[k], numSamples[k] > 0 ? totalPositionError[k] / numSamples[k] : 0.0f,
+			   sampleNames[k], maxNormalAngle[k], sampleNames[k], maxSteps[k]);
+	}
+
+	for (int m = 0; m < 3; m++)
+		printf(",\"%s_ns_per_model\":%.0f", modeNames[m], updateNanoseconds[m]);
+
+	printf(",\"speedup_vs_weights\":%.2f,\"speedup_vs_palette\":%.2f}\n",
+		   updateNanoseconds[0] / updateNanoseconds[2], updateNanoseconds[1] / updateNanoseconds[2]);
+	fflush(stdout);
+}
+
+#pragma endregion
+
+#pragma region Skinning cache report
+
+// Mismas fases y velocidades en las dos multitudes del reporte
+void ResetCrowdPlayback(vector<MD5Mesh*> &models)
+{
+	for (int i = 0; i < (int)models.size(); i++)
+	{
+		models[i]->GetPlayback().SetTime(0.037f * i);
+		models[i]->GetPlayback().SetSpeed(0.5f + (i % 4) * 0.25f);
+	}
+}
+
+/**
+*	Multitud con fases y velocidades distintas, actualizada sin cache y
+*	con cache de skinning con varios tamanos de intervalo: costo por
+*	modelo, tasa de aciertos, entradas y memoria del cache, y cuanto se
+*	separan los vertices de los del skinning sin cache en el mismo tiempo.
+*	La ultima configuracion limita la memoria para forzar desalojos.
+**/
+void RunSkinningCacheReport(string name, string path, SkinningMethod method, int numModels, int updates)
+{
+	vector<MD5Mesh*> reference(numModels), cached(numModels), bucketReference(numModels);
+
+	for (int i = 0; i < numModels; i++)
+	{
+		reference[i] = new MD5Mesh(path, NULL);
+		cached[i] = new MD5Mesh(path, NULL);
+		bucketReference[i] = new MD5Mesh(path, NULL);
+		reference[i]->SetSkinningMethod(method);
+		cached[i]->SetSkinningMethod(method);
+		bucketReference[i]->SetSkinningMethod(method);
+	}
+
+	if (reference[0]->animation->GetNumFrames() > 0)
+	{
+		LARGE_INTEGER start;
+		ResetCrowdPlayback(reference);
+
+		QueryPerformanceCounter(&start);
+		for (int k = 0; k < updates; k++)
+			MD5Mesh::UpdateModels(&reference[0], numModels, 1.0f / 60.0f);
+		double uncachedNanoseconds = GetElapsedNanoseconds(start) / ((double)updates * numModels);
+
+		float bucketSizes[] = { 1.0f / 120.0f, 1.0f / 60.0f, 1.0f / 30.0f, 1.0f / 15.0f, 1.0f / 60.0f };
+		size_t entryBytes = GetNumVertices(*reference[0]) * sizeof(Vertex) + sizeof(SkinningCacheEntry);
+		size_t budgets[] = { SKINNING_CACHE_DEFAULT_BUDGET, SKINNING_CACHE_DEFAULT_BUDGET, SKINNING_CACHE_DEFAULT_BUDGET, SKINNING_CACHE_DEFAULT_BUDGET, entryBytes * 8 };
+
+		for (int c = 0; c < 5; c++)
+		{
+			SkinningCache cache(bucketSizes[c], budgets[c]);
+
+			for (int i = 0; i < numModels; i++)
+				cached[i]->SetSkinningCache(&cache);
+
+			ResetCrowdPlayback(cached);
+
+			QueryPerformanceCounter(&start);
+			for (int k = 0; k < updates; k++)
+				MD5Mesh::UpdateModels(&cached[0], numModels, 1.0f / 60.0f);
+			double cachedNanoseconds = GetElapsedNanoseconds(start) / ((double)updates * numModels);
+
+			SkinningCacheStats stats = cache.GetStats();
+
+			// El error se mide aparte para no contarlo en el tiempo. maxPositionError
+			// compara con el skinning sin cache en el tiempo de cada modelo y crece con
+			// el intervalo; maxBucketError compara con el skinning sin cache en el
+			// inicio del intervalo, que es lo que el cache debe reproducir.
+			ResetCrowdPlayback(reference);
+			ResetCrowdPlayback(cached);
+			float maxPositionError = 0, maxBucketError = 0;
+
+			for (int k = 0; k < 16; k++)
+			{
+				MD5Mesh::UpdateModels(&reference[0], numModels, 1.0f / 60.0f);
+				MD5Mesh::UpdateModels(&cached[0], numModels, 1.0f / 60.0f);
+
+				for (int i = 0; i < numModels; i++)
+					bucketReference[i]->GetPlayback().SetTime(cache.GetBucketTime(cache.GetBucket(cached[i]->GetPlayback().GetTime())));
+				MD5Mesh::UpdateModels(&bucketReference[0], numModels, 0);
+
+				for (int i = 0; i < numModels; i++)
+				{
+					for (int m = 0; m < (int)reference[i]->meshes.size(); m++)
+					{
+						const vector<Vertex> &expected = reference[i]->meshes[m].vertices;
+						const vector<Vertex> &expectedAtBucket = bucketReference[i]->meshes[m].vertices;
+						const vector<Vertex> &actual = cached[i]->meshes[m].vertices;
+
+						for (int j = 0; j < (int)expected.size(); j++)
+						{
+							XMFLOAT3 difference(actual[j].position.x - expected[j].position.x, actual[j].position.y - expected[j].position.y,
+												actual[j].position.z - expected[j].position.z);
+							XMFLOAT3 bucketDifference(actual[j].position.x - expectedAtBucket[j].position.x,
+													  actual[j].position.y - expectedAtBucket[j].position.y,
+													  actual[j].position.z - expectedAtBucket[j].position.z);
+							maxPositionError = max(maxPositionError, GetVectorLength(difference));
+							maxBucketError = max(maxBucketError, GetVectorLength(bucketDifference));
+						}
+					}
+				}
+			}
+
+			for (int i = 0; i < numModels; i++)
+				cached[i]->SetSkinningCache(NULL);
+
+			unsigned long long lookups = stats.hits + stats.misses;
+			string benchmark = name + "_skinning_cache";
+
+			// Con un intervalo no mayor que el paso de actualizacion cada modelo cae en
+			// un intervalo nuevo en cada actualizacion, y el cache debe dar los mismos
+			// vertices que el skinning sin cache al inicio de ese intervalo. Con la
+			// memoria limitada a unas pocas entradas el cache tiene que desalojar.
+			if (bucketSizes[c] <= 1.0f / 60.0f)
+				Check(maxBucketError <= SKINNING_CHECK_TOLERANCE, benchmark, "max_bucket_error");
+			if (budgets[c] < SKINNING_CACHE_DEFAULT_BUDGET)
+				Check(stats.evictions > 0, benchmark, "evicts_over_budget");
+
+			printf("{\"benchmark\":\"%s\",\"method\":\"%s\",\"models\":%d,\"bucket_ms\":%.2f,\"budget_bytes\":%lu,"
+				   "\"uncached_ns_per_model\":%.0f,\"cached_ns_per_model\":%.0f,\"speedup\":%.2f,\"hit_rate\":%.3f,\"entries\":%d,"
+				   "\"memory_bytes\":%lu,\"evictions\":%lu,\"max_position_error\":%g,\"max_bucket_error\":%g}\n",
+				   benchmark.c_str(), method == SKINNING_MATRIX_PALETTE ? "palette" : "weights", numModels, bucketSizes[c] * 1000.0f,
+				   (unsigned long)budgets[c], uncachedNanoseconds, cachedNanoseconds, uncachedNanoseconds / cachedNanoseconds,
+				   lookups > 0 ? (double)stats.hits / lookups : 0.0, stats.numEntries, (unsigned long)stats.memoryUsage,
+				   (unsigned long)stats.evictions, maxPositionError, maxBucketError);
+			fflush(stdout);
+		}
+	}
+
+	for (int i = 0; i < numModels; i++)
+	{
+		delete reference[i];
+		delete cached[i];
+		delete bucketReference[i];
+	}
+}
+
+#pragma endregion
+
+#pragma region Detail level report
+
+// Distancia de p al triangulo abc (punto mas cercano de Ericson, Real-Time Collision Detection 5.1.5)
+float GetPointTriangleDistance(const XMFLOAT3 &p, const XMFLOAT3 &a, const XMFLOAT3 &b, const XMFLOAT3 &c)
+{
+	XMVECTOR vp = XMLoadFloat3(&p), va = XMLoadFloat3(&a), vb = XMLoadFloat3(&b), vc = XMLoadFloat3(&c);
+	XMVECTOR ab = vb - va, ac = vc - va, ap = vp - va;
+	XMVECTOR closest;
+
+	float d1 = XMVectorGetX(XMVector3Dot(ab, ap)), d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+	XMVECTOR bp = vp - vb;
+	float d3 = XMVectorGetX(XMVector3Dot(ab, bp)), d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+	XMVECTOR cp = vp - vc;
+	float d5 = XMVectorGetX(XMVector3Dot(ab, cp)), d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+	float va3 = d3 * d6 - d5 * d4, vb3 = d5 * d2 - d1 * d6, vc3 = d1 * d4 - d3 * d2;
+
+	if (d1 <= 0 && d2 <= 0)
+		closest = va;
+	else if (d3 >= 0 && d4 <= d3)
+		closest = vb;
+	else if (d6 >= 0 && d5 <= d6)
+		closest = vc;
+	else if (vc3 <= 0 && d1 >= 0 && d3 <= 0)
+		closest = va + ab * (d1 / (d1 - d3));
+	else if (vb3 <= 0 && d2 >= 0 && d6 <= 0)
+		closest = va + ac * (d2 / (d2 - d6));
+	else if (va3 <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+		closest = vb + (vc - vb) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	else
+	{
+		float denominator = 1.0f / (va3 + vb3 + vc3);
+		closest = va + ab * (vb3 * denominator) + ac * (vc3 * denominator);
+	}
+
+	return XMVectorGetX(XMVector3Length(vp - closest));
+}
+
+/**
+*	Distancia de cada vertice de la malla completa a la superficie del
+*	nivel (los dos ya transformados): maximo y suma, para el promedio.
+**/
+void MeasureSurfaceError(const vector<vector<Vertex> > &full, const vector<Mesh> &levelMeshes, const vector<vector<Vertex> > &level,
+						 float *maxError, double *totalError)
+{
+	for (int i = 0; i < (int)full.size(); i++)
+	{
+		const vector<Triangle> &triangles = levelMeshes[i].triangles;
+
+		for (int j = 0; j < (int)full[i].size() && !triangles.empty(); j++)
+		{
+			float distance = FLT_MAX;
+
+			for (int t = 0; t < (int)triangles.size(); t++)
+			{
+				const int *indices = triangles[t].vertexIndices;
+				distance = min(distance, GetPointTriangleDistance(full[i][j].position, level[i][indices[0]].position,
+					level[i][indices[1]].position, level[i][indices[2]].position));
+			}
+
+			*maxError = max(*maxError, distance);
+			*totalError += distance;
+		}
+	}
+}
+
+/**
+*	Arma los niveles de detalle y reporta por nivel vertices, triangulos y
+*	pesos, la cota de error de las cuadricas con la distancia a la que
+*	SelectDetailLevel cambia a ese nivel, la distancia medida de los
+*	vertices de la malla completa a la superficie del nivel (en bind pose
+*	y en varios tiempos del clip) y el costo de la actualizacion.
+**/
+void RunDetailLevelReport(string name, string path, int numLevels, int updates)
+{
+	MD5Mesh model(path, NULL);
+	LARGE_INTEGER start;
+
+	// Sin pool: con mallas chicas el reparto taparia la diferencia entre niveles
+	model.SetWorkerPool(NULL);
+
+	QueryPerformanceCounter(&start);
+	model.BuildDetailLevels(numLevels);
+	double buildNanoseconds = GetElapsedNanoseconds(start);
+
+	bool isAnimated = model.animation->GetNumFrames() > 0;
+	int numSteps = 8;
+	int numLevelsBuilt = model.GetNumDetailLevels();
+
+	// Vertices de cada nivel en bind pose (paso -1) y en numSteps tiempos del clip
+	vector<vector<vector<vector<Vertex> > > > levelVertices(numLevelsBuilt);
+
+	for (int level = 0; level < numLevelsBuilt; level++)
+	{
+		model.SetDetailLevel(level);
+		levelVertices[level].resize(isAnimated ? numSteps + 1 : 1);
+		SaveVertices(model, &levelVertices[level][0]);
+
+		for (int step = 0; isAnimated && step < numSteps; step++)
+		{
+			model.GetPlayback().SetTime(model.animation->GetTotalAnimationTime() * step / numSteps);
+			model.UpdateModel(0);
+			SaveVertices(model, &levelVertices[level][step + 1]);
+		}
+	}
+
+	for (int level = 0; level < numLevelsBuilt; level++)
+	{
+		model.SetDetailLevel(level);
+		DetailLevelStats stats = model.GetDetailLevelStats(level);
+		const vector<Mesh> &levelMeshes = model.meshes;
+		float bindMaxError = 0, animatedMaxError = 0;
+		double bindTotalError = 0, animatedTotalError = 0;
+
+		MeasureSurfaceError(levelVertices[0][0], levelMeshes, levelVertices[level][0], &bindMaxError, &bindTotalError);
+
+		for (int step = 1; step < (int)levelVertices[level].size(); step++)
+			MeasureSurfaceError(levelVertices[0][step], levelMeshes, levelVertices[level][step], &animatedMaxError, &animatedTotalError);
+
+		double updateNanoseconds[2] = { 0, 0 };
+		SkinningMethod methods[] = { SKINNING_WEIGHTS, SKINNING_MATRIX_PALETTE };
+
+		for (int k = 0; isAnimated && k < 2; k++)
+		{
+			model.SetSkinningMethod(methods[k]);
+
+			QueryPerformanceCounter(&start);
+			for (int i = 0; i < updates; i++)
+				model.UpdateModel(1.0f / 60.0f);
+			updateNanoseconds[k] = GetElapsedNanoseconds(start) / updates;
+		}
+
+		model.SetSkinningMethod(SKINNING_WEIGHTS);
+
+		int numFullVertices = model.GetDetailLevelStats(0).numVertices;
+
+		printf("{\"benchmark\":\"%s_detail_level\",\"level\":%d,\"vertices\":%d,\"triangles\":%d,\"weights\":%d,\"vertex_ratio\":%.3f,"
+			   "\"quadric_error\":%g,\"switch_distance\":%g,\"bind_max_surface_error\":%g,\"bind_mean_surface_error\":%g,"
+			   "\"animated_max_surface_error\":%g,\"animated_mean_surface_error\":%g,\"weights_update_ns\":%.0f,\"palette_update_ns\":%.0f,"
+			   "\"build_ns\":%.0f}\n",
+			   name.c_str(), level, stats.numVertices, stats.numTriangles, stats.numWeights,
+			   numFullVertices > 0 ? (float)stats.numVertices / numFullVertices : 0.0f, stats.error, stats.error / model.GetDetailTolerance(),
+			   bindMaxError, numFullVertices > 0 ? bindTotalError / numFullVertices : 0.0,
+			   animatedMaxError, isAnimated && numFullVertices > 0 ? animatedTotalError / ((double)numSteps * numFullVertices) : 0.0,
+			   updateNanoseconds[0], updateNanoseconds[1], buildNanoseconds);
+		fflush(stdout);
+	}
+}
+
+#pragma endregion
+
+#pragma region Instance report
+
+void RunInstanceReport(string name, string path, int numInstances)
+{
+	vector<MD5Mesh*> instances(numInstances);
+	LARGE_INTEGER start;
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < numInstances; i++)
+		instances[i] = new MD5Mesh(path, NULL);
+	double createNanoseconds = GetElapsedNanoseconds(start) / numInstances;
+
+	// Cada instancia arranca en un tiempo y con una velocidad distintos
+	for (int i = 0; i < numInstances; i++)
+	{
+		instances[i]->GetPlayback().SetTime(0.037f * i);
+		instances[i]->GetPlayback().SetSpeed(0.5f + (i % 4) * 0.25f);
+	}
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < numInstances; i++)
+		instances[i]->UpdateModel(1.0f / 60.0f);
+	double updateNanoseconds = GetElapsedNanoseconds(start) / numInstances;
+
+	Check(AnimationRegistry::GetShared()->GetReferenceCount(path) == numInstances, name + "_instances", "clip_references");
+
+	printf("{\"benchmark\":\"%s_instances\",\"instances\":%d,\"clips_loaded\":%d,\"clip_references\":%d,\"clip_retained_bytes\":%lu,"
+		   "\"create_ns_per_instance\":%.0f,\"update_ns_per_instance\":%.0f}\n",
+		   name.c_str(), numInstances, AnimationRegistry::GetShared()->GetNumClips(), AnimationRegistry::GetShared()->GetReferenceCount(path),
+		   (unsigned long)instances[0]->animation->GetMemoryUsage(), createNanoseconds, updateNanoseconds);
+	fflush(stdout);
+
+	for (int i = 0; i < numInstances; i++)
+		delete instances[i];
+}
+
+#pragma endregion
+
+int main(int argc, char *argv[])
+{
+	string modelDirectory = "../Model/";
+	bool isQuick = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+			isQuick = true;
+		else
+			modelDirectory = string(argv[i]) + "/";
+	}
+
+	// Modelos sinteticos: ~100k vertices y 256 joints en la malla, 10k frames en la animacion.
+	// La malla tiene su propio clip corto para los reportes de skinning.
+	int syntheticJoints = isQuick ? 64 : 256;
+	int syntheticGrid = isQuick ? 32 : 224;
+	int syntheticFrames = isQuick ? 200 : 10000;
+
+	if (!WriteSyntheticMesh("SyntheticMesh.md5mesh", syntheticJoints, 2, syntheticGrid, 4) ||
+		!WriteSyntheticAnimation("SyntheticMesh.md5anim", syntheticJoints, 48, 24) ||
+		!WriteSyntheticAnimation("SyntheticAnim.md5anim", syntheticJoints, syntheticFrames, 24) ||
+		!WriteSyntheticAnimation("SyntheticHelperAnim.md5anim", syntheticJoints, syntheticFrames, 24, syntheticJoints / 2))
+	{
+		fprintf(stderr, "No se pudieron generar los modelos sinteticos.\n");
+		return EXIT_FAILURE;
+	}
+
+	vector<BenchmarkCase> cases;
+	AddMeshCases(cases, "boy", modelDirectory + "ModelGuy/boy");
+	AddMeshCases(cases, "bob", modelDirectory + "bob_lamp_update");
+	AddAnimationCases(cases, "bob", modelDirectory + "bob_lamp_update");
+	AddMeshCases(cases, "synthetic", "SyntheticMesh");
+	AddAnimationCases(cases, "synthetic", "SyntheticAnim");
+
+	for (int i = 0; i < (int)cases.size(); i++)
+	{
+		if (cases[i].inputBytes == 0)
+		{
+			fprintf(stderr, "No se encontro %s, se omite %s.\n", cases[i].path.c_str(), cases[i].name.c_str());
+			continue;
+		}
+
+		RunBenchmark(cases[i]);
+	}
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunAnimationRoundTripReport("bob", modelDirectory + "bob_lamp_update");
+
+	RunAnimationRoundTripReport("synthetic", "SyntheticAnim");
+
+	// Tolerancias por canal: unidades del modelo para traslacion y radianes para rotacion
+	float tolerances[] = { 0.0001f, 0.001f, 0.01f };
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+			RunCompressionReport("bob", modelDirectory + "bob_lamp_update", tolerances[i]);
+
+		RunCompressionReport("synthetic", "SyntheticAnim", tolerances[i]);
+	}
+
+	// La mitad de los joints de SyntheticHelperAnim son huesos auxiliares sin animacion
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunSamplingReport("bob", modelDirectory + "bob_lamp_update");
+
+	RunSamplingReport("synthetic", "SyntheticAnim");
+	RunSamplingReport("synthetic_helpers", "SyntheticHelperAnim");
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunSkinningReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 200 : 2000);
+
+	RunSkinningReport("synthetic", "SyntheticMesh", isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunDualQuaternionReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 200 : 2000);
+
+	RunDualQuaternionReport("synthetic", "SyntheticMesh", isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "ModelGuy/boy.md5mesh") > 0)
+		RunSkinningKernelReport("boy", modelDirectory + "ModelGuy/boy", isQuick ? 200 : 5000);
+
+	RunSkinningKernelReport("synthetic", "SyntheticMesh", isQuick ? 20 : 100);
+
+	RunSingleModelScalingReport("synthetic", "SyntheticMesh", SKINNING_WEIGHTS, isQuick ? 10 : 20);
+	RunSingleModelScalingReport("synthetic", "SyntheticMesh", SKINNING_MATRIX_PALETTE, isQuick ? 10 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunCrowdScalingReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 32 : 256, isQuick ? 10 : 50);
+
+	RunOutputSinkReport("synthetic", "SyntheticMesh", SKINNING_WEIGHTS, isQuick ? 10 : 20);
+	RunOutputSinkReport("synthetic", "SyntheticMesh", SKINNING_MATRIX_PALETTE, isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunInfluencePruningReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 100 : 1000);
+
+	if (GetAssetSize(modelDirectory + "ModelGuy/boy.md5anim") > 0)
+		RunInfluencePruningReport("boy", modelDirectory + "ModelGuy/boy", isQuick ? 100 : 1000);
+
+	RunInfluencePruningReport("synthetic", "SyntheticMesh", isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunQuantizationReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 100 : 1000);
+
+	RunQuantizationReport("synthetic", "SyntheticMesh", isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunTangentFrameReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 100 : 1000);
+
+	RunTangentFrameReport("synthetic", "SyntheticMesh", isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5mesh") > 0)
+		RunIndexOrderReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 3 : 10, isQuick ? 100 : 1000);
+
+	if (GetAssetSize(modelDirectory + "ModelGuy/boy.md5mesh") > 0)
+		RunIndexOrderReport("boy", modelDirectory + "ModelGuy/boy", isQuick ? 3 : 10, isQuick ? 100 : 1000);
+
+	RunIndexOrderReport("synthetic", "SyntheticMesh", isQuick ? 3 : 10, isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5mesh") > 0)
+		RunDuplicateReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 3 : 10, isQuick ? 100 : 1000);
+
+	if (GetAssetSize(modelDirectory + "ModelGuy/boy.md5mesh") > 0)
+		RunDuplicateReport("boy", modelDirectory + "ModelGuy/boy", isQuick ? 3 : 10, isQuick ? 100 : 1000);
+
+	RunDuplicateReport("synthetic", "SyntheticMesh", isQuick ? 3 : 10, isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+	{
+		float sampleRates[] = { 12, 24, 48 };
+
+		for (int i = 0; i < 3; i++)
+			RunBakedAnimationReport("bob", modelDirectory + "bob_lamp_update", sampleRates[i], isQuick ? 32 : 256, isQuick ? 10 : 50);
+	}
+
+	RunBakedAnimationReport("synthetic", "SyntheticMesh", 24, isQuick ? 4 : 8, isQuick ? 5 : 10);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+	{
+		RunSkinningCacheReport("bob", modelDirectory + "bob_lamp_update", SKINNING_WEIGHTS, isQuick ? 64 : 256, isQuick ? 20 : 100);
+		RunSkinningCacheReport("bob", modelDirectory + "bob_lamp_update", SKINNING_MATRIX_PALETTE, isQuick ? 64 : 256, isQuick ? 20 : 100);
+	}
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5mesh") > 0)
+		RunDetailLevelReport("bob", modelDirectory + "bob_lamp_update", 3, isQuick ? 100 : 1000);
+
+	if (GetAssetSize(modelDirectory + "ModelGuy/boy.md5mesh") > 0)
+		RunDetailLevelReport("boy", modelDirectory + "ModelGuy/boy", 3, isQuick ? 100 : 1000);
+
+	RunDetailLevelReport("synthetic", "SyntheticMesh", 3, isQuick ? 20 : 50);
+
+	if (GetAssetSize(modelDirectory + "bob_lamp_update.md5anim") > 0)
+		RunInstanceReport("bob", modelDirectory + "bob_lamp_update", isQuick ? 50 : 200);
+
+	return g_hasFailedChecks ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+#ifndef _ANIMATIONREGISTRY_H_INCLUDED
+#define _ANIMATIONREGISTRY_H_INCLUDED
+
+#pragma region Includes
+
+#include <map>
+#include <string>
+#include "MD5Anim.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Registro de clips compartidos con conteo de referencias. Acquire
+*	carga el clip la primera vez que se pide una ruta y despues solo
+*	incrementa su contador; Release lo destruye cuando ya nadie lo usa.
+*
+*	Solo MD5_LOAD_SAMPLE_LOCAL cambia los datos del clip, asi que es el
+*	unico flag que forma parte de la llave. El registro no es seguro
+*	entre hilos: se usa desde el hilo que crea y destruye los modelos.
+**/
+class AnimationRegistry
+{
+	struct Entry
+	{
+		MD5Anim *clip;
+		int references;
+	};
+
+	map<string, Entry> clips;
+
+public:
+	~AnimationRegistry()
+	{
+		for (map<string, Entry>::iterator it = clips.begin(); it != clips.end(); ++it)
+			delete it->second.clip;
+	}
+
+	MD5Anim* Acquire(string filename, unsigned int loadFlags = MD5_LOAD_SERIAL)
+	{
+		string key = GetKey(filename, loadFlags);
+		map<string, Entry>::iterator it = clips.find(key);
+
+		if (it != clips.end())
+		{
+			it->second.references++;
+			return it->second.clip;
+		}
+
+		Entry entry;
+		entry.clip = new MD5Anim(filename, loadFlags);
+		entry.references = 1;
+		clips[key] = entry;
+
+		return entry.clip;
+	}
+
+	void Release(MD5Anim *clip)
+	{
+		for (map<string, Entry>::iterator it = clips.begin(); it != clips.end(); ++it)
+		{
+			if (it->second.clip != clip)
+				continue;
+
+			if (--it->second.references == 0)
+			{
+				delete it->second.clip;
+				clips.erase(it);
+			}
+
+			return;
+		}
+	}
+
+	int GetNumClips() const { return (int)clips.size(); }
+
+	int GetReferenceCount(string filename, unsigned int loadFlags = MD5_LOAD_SERIAL) const
+	{
+		map<string, Entry>::const_iterator it = clips.find(GetKey(filename, loadFlags));
+		return it != clips.end() ? it->second.references : 0;
+	}
+
+	static AnimationRegistry* GetShared()
+	{
+		static AnimationRegistry sharedRegistry;
+		return &sharedRegistry;
+	}
+
+private:
+	static string GetKey(string filename, unsigned int loadFlags)
+	{
+		return (loadFlags & MD5_LOAD_SAMPLE_LOCAL) ? filename + "|local" : filename;
+	}
+};
+
+#endif
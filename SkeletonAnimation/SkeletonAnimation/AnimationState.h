@@ -0,0 +1,74 @@
+#ifndef _ANIMATIONSTATE_H_INCLUDED
+#define _ANIMATIONSTATE_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include "Pose.h"
+
+#pragma endregion
+
+enum AnimationLoopMode
+{
+	ANIMATION_LOOP,
+	ANIMATION_ONCE
+};
+
+/**
+*	Estado de reproduccion de una instancia: tiempo, velocidad, modo de
+*	repeticion y la pose muestreada. El clip (MD5Anim) es inmutable y se
+*	comparte; cada instancia solo necesita uno de estos.
+**/
+class AnimationState
+{
+	float time;
+	float speed;
+	AnimationLoopMode loopMode;
+	PoseBuffer pose;
+
+public:
+	AnimationState()
+	{
+		time = 0;
+		speed = 1;
+		loopMode = ANIMATION_LOOP;
+	}
+
+	// Avanza deltaTime * speed segundos dentro de un clip de duration segundos
+	void Advance(float deltaTime, float duration)
+	{
+		if (duration <= 0)
+		{
+			time = 0;
+			return;
+		}
+
+		time += deltaTime * speed;
+
+		if (loopMode == ANIMATION_LOOP)
+		{
+			if (time >= duration || time < 0)
+				time = fmodf(time, duration);
+			if (time < 0)
+				time += duration;
+		}
+		else
+		{
+			if (time > duration)	time = duration;
+			if (time < 0)			time = 0;
+		}
+	}
+
+	float GetTime() const { return time; }
+	void SetTime(float time) { this->time = time; }
+
+	float GetSpeed() const { return speed; }
+	void SetSpeed(float speed) { this->speed = speed; }
+
+	AnimationLoopMode GetLoopMode() const { return loopMode; }
+	void SetLoopMode(AnimationLoopMode loopMode) { this->loopMode = loopMode; }
+
+	PoseBuffer& GetPose() { return pose; }
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef _BAKEDANIMATION_H_INCLUDED
+#define _BAKEDANIMATION_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <string>
+#include "Structs.h"
+#include "MD5Binary.h"
+#include "VertexQuantization.h"
+#include "SkinningKernels.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Animacion horneada (.md5bake): los vertices ya transformados de cada
+*	malla, muestreados a intervalos iguales en todo el clip (al menos
+*	sampleRate por segundo) y cuantizados como QuantizedVertex contra la caja de su frame. El
+*	archivo se mapea en memoria y no se copia, asi que una sola instancia
+*	de BakedAnimation sirve para toda una multitud; solo se lee. Lo crea
+*	MD5Mesh::BakeAnimation y lo abre MD5Mesh::LoadBakedAnimation.
+**/
+class BakedAnimation
+{
+	MD5MappedFile bakeFile;
+	const MD5BakeBinaryHeader *header;
+	const QuantizationBounds *frameBounds;
+	const MD5BakeBinaryMesh *meshes;
+	SkinningISA isa;
+
+public:
+	BakedAnimation()
+	{
+		isa = GetSupportedSkinningISA();
+		Reset();
+	}
+
+	// Con SSE2 o AVX se usa el kernel de SSE2; da los mismos vertices que el escalar
+	SkinningISA GetISA() const { return isa; }
+	void SetISA(SkinningISA isa)
+	{
+		this->isa = isa <= GetSupportedSkinningISA() ? isa : GetSupportedSkinningISA();
+	}
+
+	/**
+	*	Falla si el archivo no existe, esta truncado o no corresponde a los
+	*	textos de origen (meshPath y animPath, ver IsSourceCurrent), al orden
+	*	de vertices (que cambia con los flags de carga) o a la frecuencia de
+	*	muestreo pedida. Los textos se comparan por hash salvo que
+	*	verifySource sea false (MD5_LOAD_TRUST_SOURCE_STAMP en MD5Mesh).
+	**/
+	bool Open(string path, string meshPath, string animPath, unsigned long long vertexOrderHash, float sampleRate,
+			  bool verifySource = true)
+	{
+		Close();
+
+		if (!bakeFile.Open(path))
+			return false;
+
+		const MD5BakeBinaryHeader *bakeHeader = bakeFile.At<MD5BakeBinaryHeader>(0, 1);
+
+		if (bakeHeader == NULL ||
+			memcmp(bakeHeader->common.magic, "MD5B", 4) != 0 ||
+			bakeHeader->common.version != MD5BAKE_BINARY_VERSION ||
+			bakeHeader->common.fileSize != (int)bakeFile.GetSize() ||
+			bakeHeader->vertexSize != sizeof(QuantizedVertex) ||
+			bakeHeader->numFrames <= 0 ||
+			bakeHeader->duration <= 0 ||
+			bakeHeader->sampleRate != sampleRate ||
+			bakeHeader->vertexOrderHash != vertexOrderHash ||
+			!IsSourceCurrent(bakeHeader->common.source, animPath, verifySource) ||
+			!IsSourceCurrent(bakeHeader->meshSource, meshPath, verifySource))
+		{
+			Close();
+			return false;
+		}
+
+		frameBounds = bakeFile.At<QuantizationBounds>(bakeHeader->frameBoundsOffset, bakeHeader->numFrames);
+		meshes = bakeFile.At<MD5BakeBinaryMesh>(bakeHeader->meshesOffset, bakeHeader->numMeshes);
+
+		for (int i = 0; meshes != NULL && i < bakeHeader->numMeshes; i++)
+		{
+			if (bakeFile.At<QuantizedVertex>(meshes[i].framesOffset, meshes[i].numVertices * bakeHeader->numFrames) == NULL)
+				meshes = NULL;
+		}
+
+		if (frameBounds == NULL || meshes == NULL)
+		{
+			Close();
+			return false;
+		}
+
+		header = bakeHeader;
+		return true;
+	}
+
+	void Close()
+	{
+		bakeFile.Close();
+		Reset();
+	}
+
+	bool IsOpen() const { return header != NULL; }
+	int GetNumFrames() const { return header != NULL ? header->numFrames : 0; }
+	int GetNumMeshes() const { return header != NULL ? header->numMeshes : 0; }
+	float GetSampleRate() const { return header != NULL ? header->sampleRate : 0.0f; }
+	float GetDuration() const { return header != NULL ? header->duration : 0.0f; }
+	unsigned long long GetVertexOrderHash() const { return header != NULL ? header->vertexOrderHash : 0; }
+	int GetNumVertices(int mesh) const { return meshes[mesh].numVertices; }
+
+	// Bytes del archivo mapeado; es memoria compartida entre todas las instancias
+	size_t GetMemoryUsage() const { return header != NULL ? (size_t)header->common.fileSize : 0; }
+
+	const QuantizationBounds& GetFrameBounds(int frame) const { return frameBounds[frame]; }
+
+	const QuantizedVertex* GetFrameVertices(int mesh, int frame) const
+	{
+		return (const QuantizedVertex*)((const char*)header + meshes[mesh].framesOffset) + frame * meshes[mesh].numVertices;
+	}
+
+	/**
+	*	Frames entre los que cae time (en segundos, dentro del clip). Igual
+	*	que MD5Anim::GetFrames, despues del ultimo se interpola hacia el
+	*	primero.
+	**/
+	void GetFrames(float time, int *frame0, int *frame1, float *interpolation) const
+	{
+		int numFrames = GetNumFrames();
+		float currentFrame = time * numFrames / GetDuration();
+		*frame0 = (int)floorf(currentFrame);
+		*interpolation = currentFrame - *frame0;
+
+		if (*frame0 < 0 || *frame0 >= numFrames)
+		{
+			*frame0 = *frame0 < 0 ? 0 : numFrames - 1;
+			*interpolation = 0;
+		}
+
+		*frame1 = *frame0 == numFrames - 1 ? 0 : *frame0 + 1;
+	}
+
+	/**
+	*	Decodifica los vertices [first, first + count) de la malla en ambos
+	*	frames y los interpola linealmente; la normal se normaliza. Es todo
+	*	el trabajo por vertice de la reproduccion horneada: no hay pose ni
+	*	pesos. El kernel de SSE2 no lee mas alla del rango, asi que los
+	*	ultimos vertices que no completan un grupo de 4 van por el escalar.
+	**/
+	void SampleVertices(int mesh, int frame0, int frame1, float interpolation, int first, int count, Vertex *output) const
+	{
+		BakedFrameBlend blend(frameBounds[frame0], frameBounds[frame1], interpolation);
+		const QuantizedVertex *vertices0 = GetFrameVertices(mesh, frame0);
+		const QuantizedVertex *vertices1 = GetFrameVertices(mesh, frame1);
+		int vectorCount = isa >= SKINNING_ISA_SSE2 ? count & ~3 : 0;
+
+		if (vectorCount > 0)
+			SampleVerticesSSE2(blend, vertices0, vertices1, first, vectorCount, output);
+
+		SampleVerticesScalar(blend, vertices0, vertices1, first + vectorCount, count - vectorCount, output);
+	}
+
+private:
+	// Posicion = min + q * extent / pasos, con los dos frames ya mezclados en origin y scale
+	struct BakedFrameBlend
+	{
+		float origin[3];
+		float scale0[3];
+		float scale1[3];
+		float weight0;
+		float weight1;
+
+		BakedFrameBlend(const QuantizationBounds &bounds0, const QuantizationBounds &bounds1, float interpolation)
+		{
+			const float *min0 = &bounds0.min.x, *min1 = &bounds1.min.x;
+			const float *extent0 = &bounds0.extent.x, *extent1 = &bounds1.extent.x;
+
+			weight0 = 1.0f - interpolation;
+			weight1 = interpolation;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				origin[axis] = min0[axis] * weight0 + min1[axis] * weight1;
+				scale0[axis] = extent0[axis] / QUANTIZED_POSITION_STEPS * weight0;
+				scale1[axis] = extent1[axis] / QUANTIZED_POSITION_STEPS * weight1;
+			}
+		}
+	};
+
+	void SampleVerticesScalar(const BakedFrameBlend &blend, const QuantizedVertex *vertices0, const QuantizedVertex *vertices1,
+							  int first, int count, Vertex *output) const
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			const QuantizedVertex &a = vertices0[i];
+			const QuantizedVertex &b = vertices1[i];
+			float normal0[3], normal1[3];
+			UnfoldOctahedral(a.normal, normal0);
+			UnfoldOctahedral(b.normal, normal1);
+
+			float normal[3] =
+			{
+				normal0[0] * blend.weight0 + normal1[0] * blend.weight1,
+				normal0[1] * blend.weight0 + normal1[1] * blend.weight1,
+				normal0[2] * blend.weight0 + normal1[2] * blend.weight1
+			};
+			float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			float inverseLength = length > 0 ? 1.0f / length : 0.0f;
+
+			Vertex vertex;
+			vertex.position.x = blend.origin[0] + a.position[0] * blend.scale0[0] + b.position[0] * blend.scale1[0];
+			vertex.position.y = blend.origin[1] + a.position[1] * blend.scale0[1] + b.position[1] * blend.scale1[1];
+			vertex.position.z = blend.origin[2] + a.position[2] * blend.scale0[2] + b.position[2] * blend.scale1[2];
+			vertex.normal.x = normal[0] * inverseLength;
+			vertex.normal.y = normal[1] * inverseLength;
+			vertex.normal.z = normal[2] * inverseLength;
+
+			output[i] = vertex;
+		}
+	}
+
+	/**
+	*	Cuatro vertices por iteracion: los enteros de 16 bits de cada frame
+	*	se transponen a SoA (x, y, z y u, v de la normal en un registro cada
+	*	uno) y se hacen las mismas operaciones que el escalar en el mismo
+	*	orden. count debe ser multiplo de 4.
+	**/
+	void SampleVerticesSSE2(const BakedFrameBlend &blend, const QuantizedVertex *vertices0, const QuantizedVertex *vertices1,
+							int first, int count, Vertex *output) const
+	{
+		__m128 weight0 = _mm_set1_ps(blend.weight0);
+		__m128 weight1 = _mm_set1_ps(blend.weight1);
+
+		for (int i = first; i < first + count; i += 4)
+		{
+			__m128 positions0[3], positions1[3], normals0[3], normals1[3];
+			LoadQuantizedLanes(&vertices0[i], positions0, normals0);
+			LoadQuantizedLanes(&vertices1[i], positions1, normals1);
+
+			float lanes[6][8];
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 position = _mm_add_ps(_mm_add_ps(_mm_set1_ps(blend.origin[axis]), _mm_mul_ps(positions0[axis], _mm_set1_ps(blend.scale0[axis]))),
+											 _mm_mul_ps(positions1[axis], _mm_set1_ps(blend.scale1[axis])));
+				_mm_storeu_ps(lanes[axis], position);
+			}
+
+			__m128 normal[3];
+			for (int axis = 0; axis < 3; axis++)
+				normal[axis] = _mm_add_ps(_mm_mul_ps(normals0[axis], weight0), _mm_mul_ps(normals1[axis], weight1));
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], normal[0]), _mm_mul_ps(normal[1], normal[1])),
+												   _mm_mul_ps(normal[2], normal[2])));
+			__m128 inverseLength = _mm_and_ps(_mm_cmpgt_ps(length, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), length));
+
+			for (int axis = 0; axis < 3; axis++)
+				_mm_storeu_ps(lanes[axis + 3], _mm_mul_ps(normal[axis], inverseLength));
+
+			StoreSkinnedLanes(lanes, 4, &output[i]);
+		}
+	}
+
+	// Posiciones en float sin escalar y normales desdobladas (como UnfoldOctahedral) de 4 vertices
+	static void LoadQuantizedLanes(const QuantizedVertex *vertices, __m128 *positions, __m128 *normals)
+	{
+		__m128i zero = _mm_setzero_si128();
+
+		// x0 x1 y0 y1 z0 z1 w0 w1 y x2 x3 ...; luego x0 x1 x2 x3 y0 y1 y2 y3 y z0 z1 z2 z3 w0 w1 w2 w3
+		__m128i positions01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)vertices[0].position), _mm_loadl_epi64((const __m128i*)vertices[1].position));
+		__m128i positions23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)vertices[2].position), _mm_loadl_epi64((const __m128i*)vertices[3].position));
+		__m128i xy = _mm_unpacklo_epi32(positions01, positions23);
+		__m128i zw = _mm_unpackhi_epi32(positions01, positions23);
+
+		positions[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(xy, zero));
+		positions[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(xy, zero));
+		positions[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(zw, zero));
+
+		int encoded[4];
+		for (int v = 0; v < 4; v++)
+			memcpy(&encoded[v], vertices[v].normal, sizeof(int));
+
+		// u0 u1 v0 v1 y u2 u3 v2 v3; luego u0 u1 u2 u3 v0 v1 v2 v3 con extension de signo a 32 bits
+		__m128i normals01 = _mm_unpacklo_epi16(_mm_cvtsi32_si128(encoded[0]), _mm_cvtsi32_si128(encoded[1]));
+		__m128i normals23 = _mm_unpacklo_epi16(_mm_cvtsi32_si128(encoded[2]), _mm_cvtsi32_si128(encoded[3]));
+		__m128i uv = _mm_unpacklo_epi32(normals01, normals23);
+
+		__m128 step = _mm_set1_ps(1.0f / QUANTIZED_NORMAL_STEPS);
+		__m128 minusOne = _mm_set1_ps(-1.0f);
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 x = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(uv, uv), 16)), step), minusOne);
+		__m128 y = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(uv, uv), 16)), step), minusOne);
+		__m128 z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_andnot_ps(signMask, x)), _mm_andnot_ps(signMask, y));
+		__m128 fold = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+
+		normals[0] = _mm_sub_ps(x, _mm_or_ps(fold, _mm_and_ps(x, signMask)));
+		normals[1] = _mm_sub_ps(y, _mm_or_ps(fold, _mm_and_ps(y, signMask)));
+		normals[2] = z;
+	}
+
+	/**
+	*	DecodeOctahedral sin saltos ni normalizacion: doblar de regreso la
+	*	mitad inferior equivale a restar max(-z, 0) con el signo de cada
+	*	componente. Las dos normales se interpolan asi y el resultado se
+	*	normaliza una sola vez; en los frames horneados queda igual.
+	**/
+	static void UnfoldOctahedral(const short *encoded, float *normal)
+	{
+		float x = encoded[0] * (1.0f / QUANTIZED_NORMAL_STEPS);
+		float y = encoded[1] * (1.0f / QUANTIZED_NORMAL_STEPS);
+		x = x < -1.0f ? -1.0f : x;
+		y = y < -1.0f ? -1.0f : y;
+
+		float z = 1.0f - fabsf(x) - fabsf(y);
+		float fold = z < 0 ? -z : 0.0f;
+
+		normal[0] = x - (x >= 0 ? fold : -fold);
+		normal[1] = y - (y >= 0 ? fold : -fold);
+		normal[2] = z;
+	}
+
+	void Reset()
+	{
+		header = NULL;
+		frameBounds = NULL;
+		meshes = NULL;
+	}
+};
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef _DUALQUATERNIONSKINNING_H_INCLUDED
+#define _DUALQUATERNIONSKINNING_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <vector>
+#include <xnamath.h>
+#include "Structs.h"
+#include "Pose.h"
+#include "SkinningKernels.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Cuaternion dual unitario: real es la rotacion y dual = t * real / 2,
+*	con t la traslacion como cuaternion puro. Los cuaterniones usan la
+*	convencion v' = q * v * q^-1; la de los joints MD5 (q^-1 * v * q) se
+*	convierte conjugando al construir la paleta.
+**/
+struct DualQuaternion
+{
+	XMFLOAT4 real;
+	XMFLOAT4 dual;
+};
+
+#pragma region Quaternion helpers
+
+// Producto de Hamilton a * b (XMQuaternionMultiply regresa b * a)
+XMFLOAT4 MultiplyQuaternions(const XMFLOAT4 &a, const XMFLOAT4 &b)
+{
+	return XMFLOAT4(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+					a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+					a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+					a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+XMFLOAT4 ConjugateQuaternion(const XMFLOAT4 &q)
+{
+	return XMFLOAT4(-q.x, -q.y, -q.z, q.w);
+}
+
+// Rotacion q seguida de la traslacion (x, y, z)
+DualQuaternion MakeDualQuaternion(const XMFLOAT4 &rotation, float x, float y, float z)
+{
+	DualQuaternion result;
+	XMFLOAT4 dual = MultiplyQuaternions(XMFLOAT4(x, y, z, 0.0f), rotation);
+
+	result.real = rotation;
+	result.dual = XMFLOAT4(dual.x * 0.5f, dual.y * 0.5f, dual.z * 0.5f, dual.w * 0.5f);
+
+	return result;
+}
+
+// a despues de b
+DualQuaternion MultiplyDualQuaternions(const DualQuaternion &a, const DualQuaternion &b)
+{
+	DualQuaternion result;
+	XMFLOAT4 realDual = MultiplyQuaternions(a.real, b.dual);
+	XMFLOAT4 dualReal = MultiplyQuaternions(a.dual, b.real);
+
+	result.real = MultiplyQuaternions(a.real, b.real);
+	result.dual = XMFLOAT4(realDual.x + dualReal.x, realDual.y + dualReal.y, realDual.z + dualReal.z, realDual.w + dualReal.w);
+
+	return result;
+}
+
+// Inversa de una transformacion rigida: basta conjugar ambas partes
+DualQuaternion InvertDualQuaternion(const DualQuaternion &dq)
+{
+	DualQuaternion result;
+	result.real = ConjugateQuaternion(dq.real);
+	result.dual = ConjugateQuaternion(dq.dual);
+
+	return result;
+}
+
+#pragma endregion
+
+#pragma region Kernels
+
+/**
+*	Mezcla los cuaterniones duales de las influencias de cada vertice,
+*	normaliza el resultado y transforma con el posicion y normal. Cada
+*	influencia se voltea al hemisferio de la primera (la mas pesada) para
+*	que q y -q, que son la misma rotacion, no se cancelen. Al normalizar
+*	no hace falta que los pesos sumen 1.
+*
+*	Igual que los kernels de la paleta, se instancia por numero de
+*	influencias y recorre [first, first + count) de las streams. El kernel
+*	SSE2 hace las mismas operaciones en el mismo orden, asi que ambos dan
+*	vertices identicos. Sin withNormals solo se rota y traslada la
+*	posicion y la normal queda en cero.
+**/
+template <int numInfluences, bool withNormals>
+void SkinVerticesDualQuaternion(const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count, Vertex *output)
+{
+	for (int i = first; i < first + count; i++)
+	{
+		const DualQuaternion &pivot = dualQuaternions[streams.joints[0][i]];
+		float real[4] = { 0 }, dual[4] = { 0 };
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			const DualQuaternion &dq = dualQuaternions[streams.joints[k][i]];
+			float weight = streams.weights[k][i];
+
+			if (dq.real.x * pivot.real.x + dq.real.y * pivot.real.y + dq.real.z * pivot.real.z + dq.real.w * pivot.real.w < 0)
+				weight = -weight;
+
+			real[0] += dq.real.x * weight;
+			real[1] += dq.real.y * weight;
+			real[2] += dq.real.z * weight;
+			real[3] += dq.real.w * weight;
+			dual[0] += dq.dual.x * weight;
+			dual[1] += dq.dual.y * weight;
+			dual[2] += dq.dual.z * weight;
+			dual[3] += dq.dual.w * weight;
+		}
+
+		float length = sqrtf(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+		float inverseLength = length > 0 ? 1.0f / length : 0.0f;
+
+		float rx = real[0] * inverseLength, ry = real[1] * inverseLength, rz = real[2] * inverseLength, rw = real[3] * inverseLength;
+		float dx = dual[0] * inverseLength, dy = dual[1] * inverseLength, dz = dual[2] * inverseLength, dw = dual[3] * inverseLength;
+
+		// Traslacion: 2 * (rw * d - dw * r + r x d), de la parte vectorial de 2 * dual * conj(real)
+		float tx = 2 * (rw * dx - dw * rx + ry * dz - rz * dy);
+		float ty = 2 * (rw * dy - dw * ry + rz * dx - rx * dz);
+		float tz = 2 * (rw * dz - dw * rz + rx * dy - ry * dx);
+
+		float px = streams.positionX[i], py = streams.positionY[i], pz = streams.positionZ[i];
+
+		// Rotacion: v + 2 * r x (r x v + rw * v)
+		float cx = ry * pz - rz * py + rw * px;
+		float cy = rz * px - rx * pz + rw * py;
+		float cz = rx * py - ry * px + rw * pz;
+
+		Vertex vertex;
+		vertex.position.x = px + 2 * (ry * cz - rz * cy) + tx;
+		vertex.position.y = py + 2 * (rz * cx - rx * cz) + ty;
+		vertex.position.z = pz + 2 * (rx * cy - ry * cx) + tz;
+		vertex.normal = XMFLOAT3(0, 0, 0);
+
+		if (withNormals)
+		{
+			float nx = streams.normalX[i], ny = streams.normalY[i], nz = streams.normalZ[i];
+
+			cx = ry * nz - rz * ny + rw * nx;
+			cy = rz * nx - rx * nz + rw * ny;
+			cz = rx * ny - ry * nx + rw * nz;
+
+			vertex.normal.x = nx + 2 * (ry * cz - rz * cy);
+			vertex.normal.y = ny + 2 * (rz * cx - rx * cz);
+			vertex.normal.z = nz + 2 * (rx * cy - ry * cx);
+		}
+
+		output[i] = vertex;
+	}
+}
+
+// Carga los cuaterniones duales de 4 vertices y los transpone: real[c] y dual[c] tienen el componente c de cada uno
+void LoadDualQuaternionLanes(const DualQuaternion *dualQuaternions, const int *joints, __m128 real[4], __m128 dual[4])
+{
+	real[0] = _mm_loadu_ps(&dualQuaternions[joints[0]].real.x);
+	real[1] = _mm_loadu_ps(&dualQuaternions[joints[1]].real.x);
+	real[2] = _mm_loadu_ps(&dualQuaternions[joints[2]].real.x);
+	real[3] = _mm_loadu_ps(&dualQuaternions[joints[3]].real.x);
+	_MM_TRANSPOSE4_PS(real[0], real[1], real[2], real[3]);
+
+	dual[0] = _mm_loadu_ps(&dualQuaternions[joints[0]].dual.x);
+	dual[1] = _mm_loadu_ps(&dualQuaternions[joints[1]].dual.x);
+	dual[2] = _mm_loadu_ps(&dualQuaternions[joints[2]].dual.x);
+	dual[3] = _mm_loadu_ps(&dualQuaternions[joints[3]].dual.x);
+	_MM_TRANSPOSE4_PS(dual[0], dual[1], dual[2], dual[3]);
+}
+
+// Componentes de a x b con las mismas operaciones que el kernel escalar
+#define DQ_CROSS_X(ax, ay, az, bx, by, bz)	_mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by))
+#define DQ_CROSS_Y(ax, ay, az, bx, by, bz)	_mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz))
+#define DQ_CROSS_Z(ax, ay, az, bx, by, bz)	_mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx))
+
+template <int numInfluences, bool withNormals>
+void SkinVerticesDualQuaternionSSE2(const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count, Vertex *output)
+{
+	int end = first + count;
+	__m128 signBit = _mm_set1_ps(-0.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	for (int i = first; i < end; i += 4)
+	{
+		__m128 pivot[4], real[4], dual[4];
+		for (int c = 0; c < 4; c++)
+			real[c] = dual[c] = _mm_setzero_ps();
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			__m128 dqReal[4], dqDual[4];
+			LoadDualQuaternionLanes(dualQuaternions, &streams.joints[k][i], dqReal, dqDual);
+
+			if (k == 0)
+			{
+				for (int c = 0; c < 4; c++)
+					pivot[c] = dqReal[c];
+			}
+
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dqReal[0], pivot[0]), _mm_mul_ps(dqReal[1], pivot[1])),
+											   _mm_mul_ps(dqReal[2], pivot[2])), _mm_mul_ps(dqReal[3], pivot[3]));
+			__m128 weight = _mm_loadu_ps(&streams.weights[k][i]);
+			weight = _mm_xor_ps(weight, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), signBit));
+
+			for (int c = 0; c < 4; c++)
+			{
+				real[c] = _mm_add_ps(real[c], _mm_mul_ps(dqReal[c], weight));
+				dual[c] = _mm_add_ps(dual[c], _mm_mul_ps(dqDual[c], weight));
+			}
+		}
+
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(real[0], real[0]), _mm_mul_ps(real[1], real[1])),
+														  _mm_mul_ps(real[2], real[2])), _mm_mul_ps(real[3], real[3])));
+		__m128 inverseLength = _mm_and_ps(_mm_cmpgt_ps(length, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), length));
+
+		__m128 rx = _mm_mul_ps(real[0], inverseLength), ry = _mm_mul_ps(real[1], inverseLength);
+		__m128 rz = _mm_mul_ps(real[2], inverseLength), rw = _mm_mul_ps(real[3], inverseLength);
+		__m128 dx = _mm_mul_ps(dual[0], inverseLength), dy = _mm_mul_ps(dual[1], inverseLength);
+		__m128 dz = _mm_mul_ps(dual[2], inverseLength), dw = _mm_mul_ps(dual[3], inverseLength);
+
+		__m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)), _mm_mul_ps(ry, dz)), _mm_mul_ps(rz, dy)));
+		__m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)), _mm_mul_ps(rz, dx)), _mm_mul_ps(rx, dz)));
+		__m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)), _mm_mul_ps(rx, dy)), _mm_mul_ps(ry, dx)));
+
+		__m128 vectors[2][3] =
+		{
+			{ _mm_loadu_ps(&streams.positionX[i]), _mm_loadu_ps(&streams.positionY[i]), _mm_loadu_ps(&streams.positionZ[i]) },
+			{ _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() }
+		};
+
+		if (withNormals)
+		{
+			vectors[1][0] = _mm_loadu_ps(&streams.normalX[i]);
+			vectors[1][1] = _mm_loadu_ps(&streams.normalY[i]);
+			vectors[1][2] = _mm_loadu_ps(&streams.normalZ[i]);
+		}
+
+		float lanes[6][8];
+
+		for (int v = 0; v < (withNormals ? 2 : 1); v++)
+		{
+			__m128 x = vectors[v][0], y = vectors[v][1], z = vectors[v][2];
+
+			__m128 cx = _mm_add_ps(DQ_CROSS_X(rx, ry, rz, x, y, z), _mm_mul_ps(rw, x));
+			__m128 cy = _mm_add_ps(DQ_CROSS_Y(rx, ry, rz, x, y, z), _mm_mul_ps(rw, y));
+			__m128 cz = _mm_add_ps(DQ_CROSS_Z(rx, ry, rz, x, y, z), _mm_mul_ps(rw, z));
+
+			__m128 resultX = _mm_add_ps(x, _mm_mul_ps(two, DQ_CROSS_X(rx, ry, rz, cx, cy, cz)));
+			__m128 resultY = _mm_add_ps(y, _mm_mul_ps(two, DQ_CROSS_Y(rx, ry, rz, cx, cy, cz)));
+			__m128 resultZ = _mm_add_ps(z, _mm_mul_ps(two, DQ_CROSS_Z(rx, ry, rz, cx, cy, cz)));
+
+			// Solo las posiciones se trasladan
+			if (v == 0)
+			{
+				resultX = _mm_add_ps(resultX, tx);
+				resultY = _mm_add_ps(resultY, ty);
+				resultZ = _mm_add_ps(resultZ, tz);
+			}
+
+			_mm_storeu_ps(lanes[v * 3], resultX);
+			_mm_storeu_ps(lanes[v * 3 + 1], resultY);
+			_mm_storeu_ps(lanes[v * 3 + 2], resultZ);
+		}
+
+		StoreSkinnedLanes(lanes, end - i < 4 ? end - i : 4, &output[i], withNormals);
+	}
+}
+
+#undef DQ_CROSS_X
+#undef DQ_CROSS_Y
+#undef DQ_CROSS_Z
+
+template <int numInfluences>
+void SkinVerticesDualQuaternionWithISA(SkinningISA isa, const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count, Vertex *output, bool withNormals)
+{
+	if (isa >= SKINNING_ISA_SSE2)
+	{
+		if (withNormals)	SkinVerticesDualQuaternionSSE2<numInfluences, true>(dualQuaternions, streams, first, count, output);
+		else				SkinVerticesDualQuaternionSSE2<numInfluences, false>(dualQuaternions, streams, first, count, output);
+	}
+	else
+	{
+		if (withNormals)	SkinVerticesDualQuaternion<numInfluences, true>(dualQuaternions, streams, first, count, output);
+		else				SkinVerticesDualQuaternion<numInfluences, false>(dualQuaternions, streams, first, count, output);
+	}
+}
+
+#pragma endregion
+
+/**
+*	Skinning por cuaterniones duales. Cada frame arma un cuaternion dual
+*	por joint ya compuesto con la inversa de la bind pose y cada vertice
+*	mezcla los de sus influencias (las mismas streams que la paleta de
+*	matrices). A diferencia de mezclar matrices, el resultado siempre es
+*	una transformacion rigida, asi que las articulaciones que giran mucho
+*	no pierden volumen; con una sola influencia ambos coinciden.
+*
+*	Con AVX se usa el kernel SSE2: cada influencia trae 8 floats por
+*	vertice y la transposicion por mitades no compensa.
+**/
+class DualQuaternionPalette
+{
+	vector<DualQuaternion> inverseBindPose;
+	vector<DualQuaternion> dualQuaternions;
+	SkinningISA isa;
+
+public:
+	DualQuaternionPalette()
+	{
+		isa = GetSupportedSkinningISA();
+	}
+
+	SkinningISA GetISA() const { return isa; }
+
+	// Un conjunto que el CPU no soporta se reemplaza por el mejor disponible
+	void SetISA(SkinningISA isa)
+	{
+		this->isa = isa <= GetSupportedSkinningISA() ? isa : GetSupportedSkinningISA();
+	}
+
+	void ComputeInverseBindPose(const vector<Joint> &joints)
+	{
+		inverseBindPose.resize(joints.size());
+		dualQuaternions.resize(joints.size());
+
+		for (int i = 0; i < (int)joints.size(); i++)
+		{
+			DualQuaternion bindPose = MakeJointDualQuaternion(joints[i].position.x, joints[i].position.y, joints[i].position.z,
+															  joints[i].orientation.x, joints[i].orientation.y, joints[i].orientation.z, joints[i].orientation.w);
+			inverseBindPose[i] = InvertDualQuaternion(bindPose);
+		}
+	}
+
+	// Regresa false si la pose no corresponde al esqueleto de la malla
+	bool ComputePalette(const PoseBuffer &pose)
+	{
+		if (pose.GetNumJoints() != (int)inverseBindPose.size())
+			return false;
+
+		const XMFLOAT4A *positions = pose.GetPositions(0);
+		const XMFLOAT4A *orientations = pose.GetOrientations(0);
+
+		for (int i = 0; i < (int)dualQuaternions.size(); i++)
+		{
+			DualQuaternion jointPose = MakeJointDualQuaternion(positions[i].x, positions[i].y, positions[i].z,
+															   orientations[i].x, orientations[i].y, orientations[i].z, orientations[i].w);
+			dualQuaternions[i] = MultiplyDualQuaternions(jointPose, inverseBindPose[i]);
+		}
+
+		return true;
+	}
+
+	int GetNumJoints() const { return (int)dualQuaternions.size(); }
+	const DualQuaternion* GetDualQuaternions() const { return dualQuaternions.empty() ? NULL : &dualQuaternions[0]; }
+
+	void SkinVertices(const InfluenceStreams &influences, Vertex *output) const
+	{
+		SkinVertexRange(influences, 0, influences.numVertices, output);
+	}
+
+	// first debe ser multiplo de SKINNING_STREAM_PADDING; sin withNormals las normales quedan en cero
+	void SkinVertexRange(const InfluenceStreams &influences, int first, int count, Vertex *output, bool withNormals = true) const
+	{
+		if (count <= 0 || dualQuaternions.empty())
+			return;
+
+		const DualQuaternion *palette = &dualQuaternions[0];
+		int end = first + count;
+
+		for (int i = 0; i < (int)influences.runs.size(); i++)
+		{
+			const InfluenceRun &run = influences.runs[i];
+			int runFirst = run.first > first ? run.first : first;
+			int runEnd = run.first + run.count < end ? run.first + run.count : end;
+
+			if (runFirst >= runEnd)
+				continue;
+
+			switch (run.numInfluences)
+			{
+			case 1:		SkinVerticesDualQuaternionWithISA<1>(isa, palette, influences, runFirst, runEnd - runFirst, output, withNormals); break;
+			case 2:		SkinVerticesDualQuaternionWithISA<2>(isa, palette, influences, runFirst, runEnd - runFirst, output, withNormals); break;
+			case 3:		SkinVerticesDualQuaternionWithISA<3>(isa, palette, influences, runFirst, runEnd - runFirst, output, withNormals); break;
+			default:	SkinVerticesDualQuaternionWithISA<MAX_BONE_INFLUENCES>(isa, palette, influences, runFirst, runEnd - runFirst, output, withNormals); break;
+			}
+		}
+	}
+
+private:
+	// Los joints MD5 rotan con q^-1 * v * q, que es la rotacion del conjugado en la convencion de DualQuaternion
+	static DualQuaternion MakeJointDualQuaternion(float x, float y, float z, float qx, float qy, float qz, float qw)
+	{
+		return MakeDualQuaternion(XMFLOAT4(-qx, -qy, -qz, qw), x, y, z);
+	}
+};
+
+#endif
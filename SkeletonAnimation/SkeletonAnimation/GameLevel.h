@@ -26,6 +26,7 @@ public:
 	SimpleRenderLevel(ID3D11Device *device, ID3D11DeviceContext *deviceContext, bool *couldInitialize) : GameLevel(device)
 	{
 		mesh = new MD5Mesh("C:\\Model\\boy", deviceContext);
+		mesh->BuildDetailLevels(3);
 		//cube = new Cube();
 		*couldInitialize = mesh->PrepareGraphicResources(this->_device);
 		//*couldInitialize = cube->PrepareGraphicResources(this->_device);
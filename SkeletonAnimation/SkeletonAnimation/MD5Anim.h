@@ -9,9 +9,10 @@
 #include <xnamath.h>
 #include <vector>
 #include "Util.h"
-#include "Game.h"
-#include "Camera.h"
 #include "Structs.h"
+#include "MD5Binary.h"
+#include "WorkerPool.h"
+#include "Pose.h"
 
 using namespace std;
 
@@ -26,30 +27,219 @@ class MD5Anim
 
 	float frameTime;
 	float totalAnimationTime;
-	float currentAnimationTime;
 
 	vector<HierarchyInfo> hierarchy;
 	vector<Bound> bounds;
 	vector<BaseFrameInfo> baseFrame;
 	vector<Frame> frames;
 
+	// Esqueletos en espacio de modelo de todos los frames. Con
+	// MD5_LOAD_SAMPLE_LOCAL queda vacio y cada pose se calcula a partir
+	// de los componentes animados al momento de muestrear.
+	SkeletonDescription skeleton;
+	PoseBuffer frameSkeletons;
+
+	// Canales que de verdad cambian entre frames. Un joint sin canales
+	// animados (flags 0 o componentes constantes) es estatico y su
+	// transformacion local queda en constantFrame; si ademas todos sus
+	// ancestros son estaticos, su pose en espacio de modelo se calcula
+	// una sola vez en fixedPose y no se vuelve a evaluar.
+	vector<int> animatedFlags;
+	vector<BaseFrameInfo> constantFrame;
+	vector<bool> isFixedJoint;
+	PoseBuffer fixedPose;
+
+	int numStaticJoints;
+	int numFixedJoints;
+	int numSkippedComponents;
+
+	unsigned int loadFlags;
+	bool isLoadedFromBinary;
+
+	// Ruta, flag local y tamano y fecha del .md5anim: no depende de la
+	// direccion del objeto, que el registro puede reutilizar al liberar
+	unsigned long long clipKey;
+
 public:
-	MD5Anim(string filename)
+	MD5Anim(string filename, unsigned int loadFlags = MD5_LOAD_SERIAL)
 	{
 		this->filename = filename;
-		ifstream fileStream(filename + ".md5anim", ifstream::in);
-
-		if (fileStream.is_open())
+		this->loadFlags = loadFlags;
+		this->numJoints = 0;
+		this->numFrames = 0;
+		this->frameRate = 0;
+		this->numAnimatedComponents = 0;
+		this->frameTime = 0;
+		this->totalAnimationTime = 0;
+		this->numStaticJoints = 0;
+		this->numFixedJoints = 0;
+		this->numSkippedComponents = 0;
+		this->isLoadedFromBinary = false;
+		this->clipKey = 0;
+
+		// Solo se lee el tamano y la fecha del texto; el hash se calcula si hay que compilar
+		bool useCache = !(loadFlags & MD5_LOAD_SKIP_CACHE);
+		MD5SourceStamp source;
+		bool hasSource = ReadSourceStamp(filename + ".md5anim", &source);
+		bool isLoaded = useCache && LoadCompiledAnimation(filename + ".md5animbin", hasSource ? filename + ".md5anim" : "");
+		this->isLoadedFromBinary = isLoaded;
+
+		unsigned long long clipParts[4] =
+		{
+			HashBytes(filename.c_str(), filename.size()),
+			(unsigned long long)(loadFlags & MD5_LOAD_SAMPLE_LOCAL),
+			hasSource ? source.size : 0,
+			hasSource ? source.modifiedTime : 0
+		};
+		this->clipKey = HashBytes((const char*)clipParts, sizeof(clipParts));
+
+		if (!isLoaded && hasSource)
 		{
-			ReadGlobalParameters(fileStream);
-			ReadHierarchy(fileStream);
-			ReadBounds(fileStream);
-			ReadBaseFrame(fileStream);
-			ReadFrames(fileStream);
+			MD5Tokenizer tokenizer;
+
+			if (tokenizer.Open(filename + ".md5anim"))
+			{
+				ReadGlobalParameters(tokenizer);
+				ReadHierarchy(tokenizer);
+				ReadBounds(tokenizer);
+				ReadBaseFrame(tokenizer);
+				ReadFrames(tokenizer);
+				isLoaded = true;
+
+				if (useCache && ComputeSourceStamp(filename + ".md5anim", &source))
+					SaveCompiledAnimation(filename + ".md5animbin", source);
+			}
+		}
 
+		if (isLoaded)
+		{
 			ComputeTimes();
-			ComputeFrameSkeletons();
+			BuildSkeletonDescription();
+			ComputeStaticJoints();
+
+			if (!(loadFlags & MD5_LOAD_SAMPLE_LOCAL))
+				ComputeFrameSkeletons();
+		}
+	}
+
+	// Guarda la animacion como .md5animbin: jerarquia, bounds, base frame y los
+	// componentes animados de todos los frames en un solo arreglo de floats
+	bool SaveCompiledAnimation(string binaryPath, const MD5SourceStamp &source)
+	{
+		MD5BinaryWriter writer;
+		MD5AnimBinaryHeader header;
+		ZeroMemory(&header, sizeof(header));
+
+		int headerOffset = writer.Append(&header, sizeof(header));
+
+		vector<MD5AnimBinaryJoint> binaryHierarchy(hierarchy.size());
+		for (int i = 0; i < (int)hierarchy.size(); i++)
+		{
+			binaryHierarchy[i].nameOffset = writer.AppendString(hierarchy[i].name);
+			binaryHierarchy[i].parent = hierarchy[i].parent;
+			binaryHierarchy[i].flags = hierarchy[i].flags;
+			binaryHierarchy[i].startIndex = hierarchy[i].startIndex;
+		}
+
+		// Todos los frames se guardan con el mismo numero de componentes
+		int componentsPerFrame = 0;
+		for (int i = 0; i < (int)frames.size(); i++)
+			if ((int)frames[i].parameters.size() > componentsPerFrame)
+				componentsPerFrame = frames[i].parameters.size();
+
+		vector<int> frameIndices(frames.size());
+		vector<float> components(frames.size() * componentsPerFrame, 0.0f);
+		for (int i = 0; i < (int)frames.size(); i++)
+		{
+			frameIndices[i] = frames[i].frameIndex;
+			if (!frames[i].parameters.empty())
+				memcpy(&components[i * componentsPerFrame], frames[i].parameters.data(), sizeof(float) * frames[i].parameters.size());
+		}
+
+		memcpy(header.common.magic, "MD5A", 4);
+		header.common.version = MD5ANIM_BINARY_VERSION;
+		header.common.source = source;
+		header.numJoints = hierarchy.size();
+		header.numFrames = frames.size();
+		header.frameRate = frameRate;
+		header.numAnimatedComponents = numAnimatedComponents;
+		header.componentsPerFrame = componentsPerFrame;
+		header.hierarchyOffset = writer.Append(binaryHierarchy.data(), sizeof(MD5AnimBinaryJoint) * binaryHierarchy.size());
+		header.boundsOffset = writer.Append(bounds.data(), sizeof(Bound) * bounds.size());
+		header.baseFrameOffset = writer.Append(baseFrame.data(), sizeof(BaseFrameInfo) * baseFrame.size());
+		header.frameIndicesOffset = writer.Append(frameIndices.data(), sizeof(int) * frameIndices.size());
+		header.componentsOffset = writer.Append(components.data(), sizeof(float) * components.size());
+		header.boundSize = sizeof(Bound);
+		header.baseFrameSize = sizeof(BaseFrameInfo);
+		header.common.fileSize = writer.GetSize();
+		writer.Patch(headerOffset, &header, sizeof(header));
+
+		return writer.Save(binaryPath);
+	}
+
+private:
+	// sourcePath vacio: no hay texto con que comparar y se acepta cualquier binario valido
+	bool LoadCompiledAnimation(string binaryPath, string sourcePath)
+	{
+		MD5MappedFile binaryFile;
+
+		if (!binaryFile.Open(binaryPath))
+			return false;
+
+		const MD5AnimBinaryHeader *header = binaryFile.At<MD5AnimBinaryHeader>(0, 1);
+
+		if (header == NULL ||
+			memcmp(header->common.magic, "MD5A", 4) != 0 ||
+			header->common.version != MD5ANIM_BINARY_VERSION ||
+			header->common.fileSize != (int)binaryFile.GetSize() ||
+			header->boundSize != sizeof(Bound) ||
+			header->baseFrameSize != sizeof(BaseFrameInfo) ||
+			header->frameRate <= 0)
+			return false;
+
+		if (!sourcePath.empty() && !IsSourceCurrent(header->common.source, sourcePath, (loadFlags & MD5_LOAD_VERIFY_SOURCE) != 0))
+			return false;
+
+		const MD5AnimBinaryJoint *binaryHierarchy = binaryFile.At<MD5AnimBinaryJoint>(header->hierarchyOffset, header->numJoints);
+		const Bound *binaryBounds = binaryFile.At<Bound>(header->boundsOffset, header->numFrames);
+		const BaseFrameInfo *binaryBaseFrame = binaryFile.At<BaseFrameInfo>(header->baseFrameOffset, header->numJoints);
+		const int *frameIndices = binaryFile.At<int>(header->frameIndicesOffset, header->numFrames);
+		const float *components = binaryFile.At<float>(header->componentsOffset, header->numFrames * header->componentsPerFrame);
+
+		if (binaryHierarchy == NULL || binaryBounds == NULL || binaryBaseFrame == NULL || frameIndices == NULL || components == NULL)
+			return false;
+
+		vector<HierarchyInfo> loadedHierarchy(header->numJoints);
+		for (int i = 0; i < header->numJoints; i++)
+		{
+			const char *name = binaryFile.StringAt(binaryHierarchy[i].nameOffset);
+			if (name == NULL)
+				return false;
+
+			loadedHierarchy[i].name = name;
+			loadedHierarchy[i].parent = binaryHierarchy[i].parent;
+			loadedHierarchy[i].flags = binaryHierarchy[i].flags;
+			loadedHierarchy[i].startIndex = binaryHierarchy[i].startIndex;
 		}
+
+		vector<Frame> loadedFrames(header->numFrames);
+		for (int i = 0; i < header->numFrames; i++)
+		{
+			const float *frameComponents = components + i * header->componentsPerFrame;
+			loadedFrames[i].frameIndex = frameIndices[i];
+			loadedFrames[i].parameters.assign(frameComponents, frameComponents + header->componentsPerFrame);
+		}
+
+		this->numJoints = header->numJoints;
+		this->numFrames = header->numFrames;
+		this->frameRate = header->frameRate;
+		this->numAnimatedComponents = header->numAnimatedComponents;
+		this->hierarchy.swap(loadedHierarchy);
+		this->bounds.assign(binaryBounds, binaryBounds + header->numFrames);
+		this->baseFrame.assign(binaryBaseFrame, binaryBaseFrame + header->numJoints);
+		this->frames.swap(loadedFrames);
+
+		return true;
 	}
 
 public:
@@ -57,303 +247,561 @@ public:
 	{
 		frameTime = 1.0f / frameRate;
 		totalAnimationTime = numFrames * frameTime;
-		currentAnimationTime = 0;
 	}
 
-	void ComputeFrameSkeletons()
+	void BuildSkeletonDescription()
 	{
-		for (int i = 0; i < numFrames; i++)
+		skeleton.names.resize(hierarchy.size());
+		skeleton.parents.resize(hierarchy.size());
+
+		for (int i = 0; i < (int)hierarchy.size(); i++)
 		{
-			for (int j = 0; j < numJoints; j++)
+			skeleton.names[i] = hierarchy[i].name;
+			skeleton.parents[i] = hierarchy[i].parent;
+		}
+	}
+
+	// Busca los componentes que no cambian en ningun frame y los aplica al
+	// base frame. Los joints se recorren de padres a hijos, asi que la pose
+	// fija de un joint se arma con la de su padre ya calculada.
+	void ComputeStaticJoints()
+	{
+		constantFrame = baseFrame;
+		animatedFlags.assign(numJoints, 0);
+		isFixedJoint.assign(numJoints, false);
+		fixedPose.Allocate(1, numJoints);
+		numStaticJoints = 0;
+		numFixedJoints = 0;
+		numSkippedComponents = 0;
+
+		XMFLOAT4A *fixedPositions = fixedPose.GetPositions(0);
+		XMFLOAT4A *fixedOrientations = fixedPose.GetOrientations(0);
+
+		for (int j = 0; j < numJoints; j++)
+		{
+			int component = hierarchy[j].startIndex;
+
+			for (int flag = 1; flag <= 32; flag <<= 1)
 			{
-				int k = 0;
-				Joint currentJoint = BuildMeshJointWithAnimationInfo(&hierarchy[j], &baseFrame[j]);
-
-				if (hierarchy[j].flags & 1)
-					currentJoint.position.x = frames[i].parameters[hierarchy[j].startIndex + k++];
-				if (hierarchy[j].flags & 2)
-					currentJoint.position.z = frames[i].parameters[hierarchy[j].startIndex + k++];
-				if (hierarchy[j].flags & 4)
-					currentJoint.position.y = frames[i].parameters[hierarchy[j].startIndex + k++];
-				if (hierarchy[j].flags & 8)
-					currentJoint.orientation.x = frames[i].parameters[hierarchy[j].startIndex + k++];
-				if (hierarchy[j].flags & 16)
-					currentJoint.orientation.z = frames[i].parameters[hierarchy[j].startIndex + k++];
-				if (hierarchy[j].flags & 32)
-					currentJoint.orientation.y = frames[i].parameters[hierarchy[j].startIndex + k++];
-
-				currentJoint.orientation.w = GetWComponent(currentJoint.orientation);
-
-				if (hierarchy[j].parent >= 0)
+				if (!(hierarchy[j].flags & flag))
+					continue;
+
+				if (IsConstantComponent(component))
+				{
+					SetChannel(&constantFrame[j], flag, frames[0].parameters[component]);
+					numSkippedComponents++;
+				}
+				else
 				{
-					Joint parentJoint = frames[i].skeleton[hierarchy[j].parent];
-					XMVECTOR parentJointOrientation = XMVectorSet(parentJoint.orientation.x, 
-																  parentJoint.orientation.y, 
-																  parentJoint.orientation.z, 
-																  parentJoint.orientation.w);
-					XMVECTOR currentJointPosition = XMVectorSet(currentJoint.position.x,
-																currentJoint.position.y,
-																currentJoint.position.z,
-																0);
-					XMVECTOR parentJointConjugatedOrientation = XMVectorSet(-parentJoint.orientation.x, 
-																  -parentJoint.orientation.y, 
-																  -parentJoint.orientation.z, 
-																  parentJoint.orientation.w);
-
-					XMFLOAT3 rotatedPosition;
-					XMStoreFloat3(&rotatedPosition, XMQuaternionMultiply(XMQuaternionMultiply(parentJointOrientation, currentJointPosition), parentJointConjugatedOrientation));
-
-					currentJoint.position.x = rotatedPosition.x + parentJoint.position.x;
-					currentJoint.position.y = rotatedPosition.y + parentJoint.position.y;
-					currentJoint.position.z = rotatedPosition.z + parentJoint.position.z;
-
-					XMVECTOR currentJointOrientation = XMVectorSet(currentJoint.orientation.x, 
-																   currentJoint.orientation.y,
-																   currentJoint.orientation.z, 
-																   currentJoint.orientation.w);
-					currentJointOrientation = XMQuaternionMultiply(parentJointOrientation, currentJointOrientation);
-					currentJointOrientation = XMQuaternionNormalize(currentJointOrientation);
-					XMStoreFloat4(&currentJoint.orientation, currentJointOrientation);
+					animatedFlags[j] |= flag;
 				}
-				
-				frames[i].skeleton.push_back(currentJoint);
+
+				component++;
+			}
+
+			constantFrame[j].orientation.w = GetWComponent(constantFrame[j].orientation);
+
+			if (animatedFlags[j] != 0)
+				continue;
+
+			numStaticJoints++;
+
+			int parent = skeleton.parents[j];
+			if (parent >= j || (parent >= 0 && !isFixedJoint[parent]))
+				continue;
+
+			XMFLOAT3 position = constantFrame[j].position;
+			XMFLOAT4 orientation = constantFrame[j].orientation;
+			if (parent >= 0)
+				ConcatenateWithParent(fixedPositions[parent], fixedOrientations[parent], &position, &orientation);
+
+			fixedPositions[j] = XMFLOAT4A(position.x, position.y, position.z, 0);
+			fixedOrientations[j] = XMFLOAT4A(orientation.x, orientation.y, orientation.z, orientation.w);
+			isFixedJoint[j] = true;
+			numFixedJoints++;
+		}
+	}
+
+	int GetNumJoints() const { return numJoints; }
+	int GetNumFrames() const { return numFrames; }
+	int GetFrameRate() const { return frameRate; }
+	int GetNumAnimatedComponents() const { return numAnimatedComponents; }
+
+	// Joints cuya transformacion local no cambia, joints cuya pose en espacio
+	// de modelo no cambia y componentes animados que nunca se leen al muestrear
+	int GetNumStaticJoints() const { return numStaticJoints; }
+	int GetNumFixedJoints() const { return numFixedJoints; }
+	int GetNumSkippedComponents() const { return numSkippedComponents; }
+	float GetTotalAnimationTime() const { return totalAnimationTime; }
+
+	const SkeletonDescription& GetSkeleton() const { return skeleton; }
+	const PoseBuffer& GetFrameSkeletons() const { return frameSkeletons; }
+
+	// Datos tal como se leyeron, del texto o del .md5animbin (IsLoadedFromBinary)
+	const vector<HierarchyInfo>& GetHierarchy() const { return hierarchy; }
+	const vector<Bound>& GetBounds() const { return bounds; }
+	const vector<BaseFrameInfo>& GetBaseFrame() const { return baseFrame; }
+	const vector<Frame>& GetFrameData() const { return frames; }
+	bool IsLoadedFromBinary() const { return isLoadedFromBinary; }
+
+	// Identifica el clip en SkinningCacheKey; dos clips cargados del mismo archivo comparten llave
+	unsigned long long GetClipKey() const { return clipKey; }
+
+	void ComputeFrameSkeletons()
+	{
+		frameSkeletons.Allocate(numFrames, numJoints);
+
+		if (loadFlags & MD5_LOAD_PARALLEL)
+		{
+			FrameSkeletonTask skeletonTask(this);
+			WorkerPool::GetShared()->Run(&skeletonTask, numFrames);
+		}
+		else
+		{
+			for (int i = 0; i < numFrames; i++)
+				ComputeFrameSkeleton(i);
+		}
+	}
+
+	void ComputeFrameSkeleton(int i)
+	{
+		XMFLOAT4A *positions = frameSkeletons.GetPositions(i);
+		XMFLOAT4A *orientations = frameSkeletons.GetOrientations(i);
+
+		for (int j = 0; j < numJoints; j++)
+		{
+			if (isFixedJoint[j])
+			{
+				positions[j] = fixedPose.GetPositions(0)[j];
+				orientations[j] = fixedPose.GetOrientations(0)[j];
+				continue;
 			}
+
+			XMFLOAT3 position;
+			XMFLOAT4 orientation;
+			GetLocalJoint(i, j, &position, &orientation);
+
+			int parent = skeleton.parents[j];
+			if (parent >= 0)
+				ConcatenateWithParent(positions[parent], orientations[parent], &position, &orientation);
+
+			positions[j] = XMFLOAT4A(position.x, position.y, position.z, 0);
+			orientations[j] = XMFLOAT4A(orientation.x, orientation.y, orientation.z, orientation.w);
 		}
 	}
 
-	void UpdateModel(vector<Mesh>& meshes, float deltaTime, ID3D11DeviceContext *deviceContext)
+	// Joint j del frame i relativo a su padre: base frame con los componentes
+	// constantes ya aplicados mas los componentes que si estan animados
+	void GetLocalJoint(int i, int j, XMFLOAT3 *position, XMFLOAT4 *orientation) const
 	{
-		currentAnimationTime += deltaTime;
-		if (currentAnimationTime > totalAnimationTime)
-			currentAnimationTime = 0;
+		*position = constantFrame[j].position;
+		*orientation = constantFrame[j].orientation;
 
-		float currentFrame = currentAnimationTime * frameRate;
-		int frame0 = floorf(currentFrame);
-		int frame1 = frame0 == numFrames - 1 ? 0 : frame0 + 1;
+		int animated = animatedFlags[j];
+		if (animated == 0)
+			return;
 
-		float interpolation = currentFrame - frame0;
+		int flags = hierarchy[j].flags;
+		const float *parameters = &frames[i].parameters[hierarchy[j].startIndex];
 
-		vector<Joint> interpolatedSkeleton;
+		if (flags & 1)	{ if (animated & 1)		position->x = *parameters; parameters++; }
+		if (flags & 2)	{ if (animated & 2)		position->z = *parameters; parameters++; }
+		if (flags & 4)	{ if (animated & 4)		position->y = *parameters; parameters++; }
+		if (flags & 8)	{ if (animated & 8)		orientation->x = *parameters; parameters++; }
+		if (flags & 16)	{ if (animated & 16)	orientation->z = *parameters; parameters++; }
+		if (flags & 32)	{ if (animated & 32)	orientation->y = *parameters; parameters++; }
 
-		for (int i = 0; i < numJoints; i++)
+		orientation->w = GetWComponent(*orientation);
+	}
+
+	// Lleva un joint de espacio local a espacio de modelo con la pose ya calculada de su padre
+	static void ConcatenateWithParent(const XMFLOAT4A &parentPosition, const XMFLOAT4A &parentOrientation, XMFLOAT3 *position, XMFLOAT4 *orientation)
+	{
+		XMVECTOR parentJointOrientation = XMLoadFloat4A(&parentOrientation);
+		XMVECTOR currentJointPosition = XMVectorSet(position->x, position->y, position->z, 0);
+		XMVECTOR parentJointConjugatedOrientation = XMVectorSet(-parentOrientation.x, 
+																-parentOrientation.y, 
+																-parentOrientation.z, 
+																parentOrientation.w);
+
+		XMFLOAT3 rotatedPosition;
+		XMStoreFloat3(&rotatedPosition, XMQuaternionMultiply(XMQuaternionMultiply(parentJointOrientation, currentJointPosition), parentJointConjugatedOrientation));
+
+		position->x = rotatedPosition.x + parentPosition.x;
+		position->y = rotatedPosition.y + parentPosition.y;
+		position->z = rotatedPosition.z + parentPosition.z;
+
+		XMVECTOR currentJointOrientation = XMLoadFloat4(orientation);
+		currentJointOrientation = XMQuaternionMultiply(parentJointOrientation, currentJointOrientation);
+		currentJointOrientation = XMQuaternionNormalize(currentJointOrientation);
+		XMStoreFloat4(orientation, currentJointOrientation);
+	}
+
+	// Calcula en la primera pose de pose la pose en espacio de modelo para el tiempo dado.
+	// El clip no guarda estado de reproduccion, asi que varias instancias pueden muestrearlo a la vez.
+	void SamplePose(float time, PoseBuffer *pose) const
+	{
+		if (numFrames == 0 || pose->GetNumJoints() != numJoints)
+			return;
+
+		int frame0, frame1;
+		float interpolation;
+		GetFrames(time, &frame0, &frame1, &interpolation);
+
+		if (loadFlags & MD5_LOAD_SAMPLE_LOCAL)
+			SampleLocalPose(frame0, frame1, interpolation, pose);
+		else
+			InterpolateFrameSkeletons(frame0, frame1, interpolation, pose);
+	}
+
+	// Frames que se mezclan en el tiempo dado; fuera del clip se toma el primer o el ultimo frame sin interpolar
+	void GetFrames(float time, int *frame0, int *frame1, float *interpolation) const
+	{
+		float currentFrame = time * frameRate;
+		*frame0 = floorf(currentFrame);
+		*interpolation = currentFrame - *frame0;
+
+		if (*frame0 < 0 || *frame0 >= numFrames)
 		{
-			Joint currentJoint;
-			Joint joint0 = frames[frame0].skeleton[i];
-			Joint joint1 = frames[frame1].skeleton[i];
+			*frame0 = *frame0 < 0 ? 0 : numFrames - 1;
+			*interpolation = 0;
+		}
+
+		*frame1 = *frame0 == numFrames - 1 ? 0 : *frame0 + 1;
+	}
+
+	// Caja del modelo en un frame segun el archivo; false si el clip no trae bounds
+	bool GetFrameBound(int frame, Bound *bound) const
+	{
+		if (frame < 0 || frame >= (int)bounds.size())
+			return false;
+
+		*bound = bounds[frame];
+		return true;
+	}
 
-			currentJoint.parent = joint0.parent;
+	// Memoria retenida por el clip: datos leidos del archivo mas los esqueletos precalculados
+	size_t GetMemoryUsage() const
+	{
+		size_t bytes = sizeof(HierarchyInfo) * hierarchy.capacity() +
+					   sizeof(Bound) * bounds.capacity() +
+					   sizeof(BaseFrameInfo) * baseFrame.capacity() +
+					   sizeof(Frame) * frames.capacity();
+
+		for (int i = 0; i < (int)frames.size(); i++)
+			bytes += sizeof(float) * frames[i].parameters.capacity();
 
-			XMVECTOR joint0Orientation = XMVectorSet(joint0.orientation.x, joint0.orientation.y, joint0.orientation.z, joint0.orientation.w);
-			XMVECTOR joint1Orientation = XMVectorSet(joint1.orientation.x, joint1.orientation.y, joint1.orientation.z, joint1.orientation.w);
+		bytes += sizeof(int) * animatedFlags.capacity() +
+				 sizeof(BaseFrameInfo) * constantFrame.capacity() +
+				 isFixedJoint.capacity() / 8 +
+				 fixedPose.GetSizeInBytes();
 
-			currentJoint.position.x = joint1.position.x * interpolation + (1 - interpolation) * joint0.position.x;
-			currentJoint.position.y = joint1.position.y * interpolation + (1 - interpolation) * joint0.position.y;
-			currentJoint.position.z = joint1.position.z * interpolation + (1 - interpolation) * joint0.position.z;
+		return bytes + frameSkeletons.GetSizeInBytes();
+	}
 
-			XMStoreFloat4(&currentJoint.orientation, XMQuaternionSlerp(joint0Orientation, joint1Orientation, interpolation));
-			interpolatedSkeleton.push_back(currentJoint);
+private:
+	// Un componente es constante si vale lo mismo en todos los frames
+	bool IsConstantComponent(int component) const
+	{
+		if (frames.empty())
+			return false;
+
+		for (int i = 0; i < (int)frames.size(); i++)
+		{
+			if (component >= (int)frames[i].parameters.size() ||
+				frames[i].parameters[component] != frames[0].parameters[component])
+				return false;
 		}
 
-		for (int i = 0; i < meshes.size(); i++)
+		return true;
+	}
+
+	// Mismo orden de canales que en el archivo: x z y para posicion y orientacion
+	static void SetChannel(BaseFrameInfo *joint, int flag, float value)
+	{
+		switch (flag)
 		{
-			for (int j = 0; j < meshes[i].numVertices; j++)
-			{
-				Vertex currentVertex = meshes[i].vertices[j];
-				currentVertex.position = XMFLOAT3(0, 0, 0);
-				currentVertex.normal = XMFLOAT3(0, 0, 0);
+		case 1:		joint->position.x = value;		break;
+		case 2:		joint->position.z = value;		break;
+		case 4:		joint->position.y = value;		break;
+		case 8:		joint->orientation.x = value;	break;
+		case 16:	joint->orientation.z = value;	break;
+		case 32:	joint->orientation.y = value;	break;
+		}
+	}
 
-				for (int k = 0; k < currentVertex.countWeight; k++)
-				{
-					Weight currentWeight = meshes[i].weights[currentVertex.startWeight + k];
-					Joint interpolatedJoint = interpolatedSkeleton[currentWeight.joint];
-
-					XMVECTOR interpolatedJointOrientation = XMVectorSet(interpolatedJoint.orientation.x, 
-																		interpolatedJoint.orientation.y, 
-																		interpolatedJoint.orientation.z, 
-																		interpolatedJoint.orientation.w);
-					XMVECTOR currentWeightPosition = XMVectorSet(currentWeight.position.x,
-																 currentWeight.position.y,
-																 currentWeight.position.z,
-																 0);
-					XMVECTOR interpolatedJointConjugatedOrientation = XMVectorSet(-interpolatedJoint.orientation.x, 
-																		-interpolatedJoint.orientation.y, 
-																		-interpolatedJoint.orientation.z, 
-																		interpolatedJoint.orientation.w);
-
-					XMFLOAT3 rotatedPoint;
-					XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(interpolatedJointOrientation, currentWeightPosition),
-						interpolatedJointConjugatedOrientation));
-
-					currentVertex.position.x += (interpolatedJoint.position.x + rotatedPoint.x) * currentWeight.bias;
-					currentVertex.position.y += (interpolatedJoint.position.y + rotatedPoint.y) * currentWeight.bias;
-					currentVertex.position.z += (interpolatedJoint.position.z + rotatedPoint.z) * currentWeight.bias;
-
-					XMVECTOR tempWeightNormal = XMVectorSet(currentWeight.normal.x, currentWeight.normal.y, currentWeight.normal.z, 0.0f);
-
-					// Rotate the normal
-					XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(interpolatedJointOrientation, tempWeightNormal), interpolatedJointConjugatedOrientation));
-
-					// Add to vertices normal and ake weight bias into account
-					currentVertex.normal.x -= rotatedPoint.x * currentWeight.bias;
-					currentVertex.normal.y -= rotatedPoint.y * currentWeight.bias;
-					currentVertex.normal.z -= rotatedPoint.z * currentWeight.bias;
-				}
+	void InterpolateFrameSkeletons(int frame0, int frame1, float interpolation, PoseBuffer *pose) const
+	{
+		const XMFLOAT4A *positions0 = frameSkeletons.GetPositions(frame0);
+		const XMFLOAT4A *positions1 = frameSkeletons.GetPositions(frame1);
+		const XMFLOAT4A *orientations0 = frameSkeletons.GetOrientations(frame0);
+		const XMFLOAT4A *orientations1 = frameSkeletons.GetOrientations(frame1);
+		XMFLOAT4A *positions = pose->GetPositions(0);
+		XMFLOAT4A *orientations = pose->GetOrientations(0);
 
-				meshes[i].vertices[j] = currentVertex;
+		for (int i = 0; i < numJoints; i++)
+		{
+			if (isFixedJoint[i])
+			{
+				positions[i] = fixedPose.GetPositions(0)[i];
+				orientations[i] = fixedPose.GetOrientations(0)[i];
+				continue;
 			}
 
-			D3D11_MAPPED_SUBRESOURCE mappedVertexBuffer;
-			HRESULT hResult = deviceContext->Map(meshes[i].vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedVertexBuffer);
-			memcpy(mappedVertexBuffer.pData, &meshes[i].vertices[0], (sizeof(Vertex) * meshes[i].vertices.size()));
-			deviceContext->Unmap(meshes[i].vertexBuffer, 0);
+			// Un joint estatico con padre animado se interpola como los demas: su posicion
+			// va en linea recta entre los dos frames, no en el arco que da girar con su padre
+			positions[i].x = positions1[i].x * interpolation + (1 - interpolation) * positions0[i].x;
+			positions[i].y = positions1[i].y * interpolation + (1 - interpolation) * positions0[i].y;
+			positions[i].z = positions1[i].z * interpolation + (1 - interpolation) * positions0[i].z;
+
+			XMStoreFloat4A(&orientations[i], XMQuaternionSlerp(XMLoadFloat4A(&orientations0[i]), XMLoadFloat4A(&orientations1[i]), interpolation));
 		}
 	}
 
-	void ReadGlobalParameters(ifstream &fileStream)
+	// Interpola los dos frames en espacio local y luego recorre la jerarquia de padres a hijos
+	void SampleLocalPose(int frame0, int frame1, float interpolation, PoseBuffer *pose) const
 	{
-		string currentLine;
-		while (getline(fileStream, currentLine))
+		XMFLOAT4A *positions = pose->GetPositions(0);
+		XMFLOAT4A *orientations = pose->GetOrientations(0);
+
+		for (int j = 0; j < numJoints; j++)
 		{
-			string *currentLineSplitted = new string[2];
-			SplitString(currentLine, 2, currentLineSplitted);
-
-			if (currentLineSplitted[0] == "numFrames")
-				this->numFrames = atoi(currentLineSplitted[1].c_str());
-			else if (currentLineSplitted[0] == "numJoints")
-				this->numJoints = atoi(currentLineSplitted[1].c_str());
-			else if (currentLineSplitted[0] == "frameRate")
-				this->frameRate = atoi(currentLineSplitted[1].c_str());
-			else if (currentLineSplitted[0] == "numAnimatedComponents")
+			if (isFixedJoint[j])
 			{
-				this->numAnimatedComponents = atoi(currentLineSplitted[1].c_str());
-				delete[] currentLineSplitted;
-				return;
+				positions[j] = fixedPose.GetPositions(0)[j];
+				orientations[j] = fixedPose.GetOrientations(0)[j];
+				continue;
+			}
+
+			XMFLOAT3 position;
+			XMFLOAT4 orientation;
+
+			// Un joint estatico no necesita interpolarse, solo concatenarse con su padre animado
+			if (animatedFlags[j] == 0)
+			{
+				position = constantFrame[j].position;
+				orientation = constantFrame[j].orientation;
 			}
+			else
+			{
+				XMFLOAT3 position0, position1;
+				XMFLOAT4 orientation0, orientation1;
+				GetLocalJoint(frame0, j, &position0, &orientation0);
+				GetLocalJoint(frame1, j, &position1, &orientation1);
 
-			delete[] currentLineSplitted;
+				position.x = position1.x * interpolation + (1 - interpolation) * position0.x;
+				position.y = position1.y * interpolation + (1 - interpolation) * position0.y;
+				position.z = position1.z * interpolation + (1 - interpolation) * position0.z;
+
+				XMStoreFloat4(&orientation, XMQuaternionSlerp(XMLoadFloat4(&orientation0), XMLoadFloat4(&orientation1), interpolation));
+			}
+
+			int parent = skeleton.parents[j];
+			if (parent >= 0)
+				ConcatenateWithParent(positions[parent], orientations[parent], &position, &orientation);
+
+			positions[j] = XMFLOAT4A(position.x, position.y, position.z, 0);
+			orientations[j] = XMFLOAT4A(orientation.x, orientation.y, orientation.z, orientation.w);
 		}
 	}
 
-	void ReadHierarchy(ifstream &fileStream)
+public:
+	void ReadGlobalParameters(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
+		do
+		{
+			MD5Token token = tokenizer.NextToken();
+
+			if (token.Equals("numFrames"))
+				this->numFrames = tokenizer.ReadInt();
+			else if (token.Equals("numJoints"))
+				this->numJoints = tokenizer.ReadInt();
+			else if (token.Equals("frameRate"))
+				this->frameRate = tokenizer.ReadInt();
+			else if (token.Equals("numAnimatedComponents"))
+			{
+				this->numAnimatedComponents = tokenizer.ReadInt();
+				tokenizer.NextLine();
+				return;
+			}
+		} while (tokenizer.NextLine());
+	}
 
-		while (getline(fileStream, currentLine))
-			if (currentLine == "hierarchy {") break;
+	void ReadHierarchy(MD5Tokenizer &tokenizer)
+	{
+		if (!tokenizer.SkipToLine("hierarchy {"))
+			return;
 
-		int i = 0;
+		hierarchy.reserve(this->numJoints);
 
-		while (getline(fileStream, currentLine) && i < this->numJoints)
+		for (int i = 0; i < this->numJoints && !tokenizer.IsAtEnd(); i++)
 		{
 			HierarchyInfo hierarchyInfo;
-			string *currentLineSplitted = new string[4];
-			SplitString(currentLine, 4, currentLineSplitted);
-			
-			hierarchyInfo.name = currentLineSplitted[0];
-			TrimString(hierarchyInfo.name, "\"");
-			hierarchyInfo.parent = atoi(currentLineSplitted[1].c_str());
-			hierarchyInfo.flags = atoi(currentLineSplitted[2].c_str());
-			hierarchyInfo.startIndex = atoi(currentLineSplitted[3].c_str());
+			hierarchyInfo.name = tokenizer.ReadQuotedString();
+			hierarchyInfo.parent = tokenizer.ReadInt();
+			hierarchyInfo.flags = tokenizer.ReadInt();
+			hierarchyInfo.startIndex = tokenizer.ReadInt();
 
 			hierarchy.push_back(hierarchyInfo);
-			delete[] currentLineSplitted;
-
-			i++;
+			tokenizer.NextLine();
 		}
 	}
 	 
-	void ReadBounds(ifstream &fileStream)
+	void ReadBounds(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
+		if (!tokenizer.SkipToLine("bounds {"))
+			return;
 
-		while (getline(fileStream, currentLine))
-			if (currentLine == "bounds {") break;
+		bounds.reserve(this->numFrames);
 
-		while (getline(fileStream, currentLine))
+		for (; !tokenizer.IsAtEnd() && !tokenizer.LineEquals("}"); tokenizer.NextLine())
 		{
-			if (currentLine == "}") break;
-
 			Bound bound;
-			string *currentLineSplitted = new string[10];
-			SplitString(currentLine, 10, currentLineSplitted);
-			
-			bound.min.x = atof(currentLineSplitted[1].c_str());
-			bound.min.z = atof(currentLineSplitted[2].c_str());
-			bound.min.y = atof(currentLineSplitted[3].c_str());
-
-			bound.max.x = atof(currentLineSplitted[6].c_str());
-			bound.max.z = atof(currentLineSplitted[7].c_str());
-			bound.max.y = atof(currentLineSplitted[8].c_str());
+			tokenizer.SkipTokens(1);
+			bound.min.x = tokenizer.ReadFloat();
+			bound.min.z = tokenizer.ReadFloat();
+			bound.min.y = tokenizer.ReadFloat();
+			tokenizer.SkipTokens(2);
+			bound.max.x = tokenizer.ReadFloat();
+			bound.max.z = tokenizer.ReadFloat();
+			bound.max.y = tokenizer.ReadFloat();
 
 			bounds.push_back(bound);
-			delete[] currentLineSplitted;
 		}
+
+		tokenizer.NextLine();
 	}
 
-	void ReadBaseFrame(ifstream &fileStream)
+	void ReadBaseFrame(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
+		if (!tokenizer.SkipToLine("baseframe {"))
+			return;
 
-		while (getline(fileStream, currentLine))
-			if (currentLine == "baseframe {") break;
+		baseFrame.reserve(this->numJoints);
 
-		while (getline(fileStream, currentLine))
+		for (; !tokenizer.IsAtEnd() && !tokenizer.LineEquals("}"); tokenizer.NextLine())
 		{
-			if (currentLine == "}") break;
-
 			BaseFrameInfo baseFrameInfo;
-			string *currentLineSplitted = new string[10];
-			SplitString(currentLine, 10, currentLineSplitted);
-			
-			baseFrameInfo.position.x = atof(currentLineSplitted[1].c_str());
-			baseFrameInfo.position.z = atof(currentLineSplitted[2].c_str());
-			baseFrameInfo.position.y = atof(currentLineSplitted[3].c_str());
-
-			baseFrameInfo.orientation.x = atof(currentLineSplitted[6].c_str());
-			baseFrameInfo.orientation.z = atof(currentLineSplitted[7].c_str());
-			baseFrameInfo.orientation.y = atof(currentLineSplitted[8].c_str());
+			tokenizer.SkipTokens(1);
+			baseFrameInfo.position.x = tokenizer.ReadFloat();
+			baseFrameInfo.position.z = tokenizer.ReadFloat();
+			baseFrameInfo.position.y = tokenizer.ReadFloat();
+			tokenizer.SkipTokens(2);
+			baseFrameInfo.orientation.x = tokenizer.ReadFloat();
+			baseFrameInfo.orientation.z = tokenizer.ReadFloat();
+			baseFrameInfo.orientation.y = tokenizer.ReadFloat();
 			baseFrameInfo.orientation.w = GetWComponent(baseFrameInfo.orientation);
 
 			baseFrame.push_back(baseFrameInfo);
-			delete[] currentLineSplitted;
 		}
+
+		tokenizer.NextLine();
 	}
 
-	void ReadFrames(ifstream &fileStream)
+	void ReadFrames(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
-
-		while (getline(fileStream, currentLine))
+		if (loadFlags & MD5_LOAD_PARALLEL)
 		{
-			if (currentLine == "") continue;
+			ReadFramesParallel(tokenizer);
+			return;
+		}
+
+		frames.reserve(this->numFrames);
 
-			string *currentLineSplitted = new string[3];
-			SplitString(currentLine, 3, currentLineSplitted);
+		while (!tokenizer.IsAtEnd())
+		{
+			if (tokenizer.LineEquals(""))
+			{
+				tokenizer.NextLine();
+				continue;
+			}
 
 			Frame frame;
-			frame.frameIndex = atoi(currentLineSplitted[1].c_str());
+			ReadFrame(tokenizer, &frame);
+			frames.push_back(frame);
+		}
+	}
 
-			delete[] currentLineSplitted;
-				
-			while (getline(fileStream, currentLine))
+	// Localiza los bloques "frame N {" y lee cada uno en el pool de hilos
+	void ReadFramesParallel(MD5Tokenizer &tokenizer)
+	{
+		vector<const char*> frameStarts;
+		frameStarts.reserve(this->numFrames);
+
+		while (!tokenizer.IsAtEnd())
+		{
+			if (tokenizer.LineEquals(""))
 			{
-				if (currentLine == "}") break;
-
-				float parameters[6];
-				currentLineSplitted = new string[6];
-				SplitString(currentLine, 6, currentLineSplitted);
-			
-				frame.parameters.push_back(atof(currentLineSplitted[0].c_str()));
-				frame.parameters.push_back(atof(currentLineSplitted[1].c_str()));
-				frame.parameters.push_back(atof(currentLineSplitted[2].c_str()));
-				frame.parameters.push_back(atof(currentLineSplitted[3].c_str()));
-				frame.parameters.push_back(atof(currentLineSplitted[4].c_str()));
-				frame.parameters.push_back(atof(currentLineSplitted[5].c_str()));			
+				tokenizer.NextLine();
+				continue;
 			}
 
-			frames.push_back(frame);
+			frameStarts.push_back(tokenizer.GetCursor());
+			tokenizer.SkipToLine("}");
+		}
+
+		frames.resize(frameStarts.size());
+
+		FrameParseTask parseTask(this, &frameStarts, tokenizer.GetEnd());
+		WorkerPool::GetShared()->Run(&parseTask, frameStarts.size());
+	}
+
+	void ReadFrame(MD5Tokenizer &tokenizer, Frame *frame)
+	{
+		tokenizer.SkipTokens(1);
+		frame->frameIndex = tokenizer.ReadInt();
+		frame->parameters.reserve(this->numAnimatedComponents);
+
+		// Cada linea trae hasta 6 componentes; los que faltan se leen como 0
+		while (tokenizer.NextLine() && !tokenizer.LineEquals("}"))
+		{
+			for (int k = 0; k < 6; k++)
+				frame->parameters.push_back(tokenizer.ReadFloat());
 		}
+
+		tokenizer.NextLine();
 	}
+
+#pragma region Parallel tasks
+
+	class FrameParseTask : public ParallelTask
+	{
+		MD5Anim *animation;
+		vector<const char*> *frameStarts;
+		const char *end;
+
+	public:
+		FrameParseTask(MD5Anim *animation, vector<const char*> *frameStarts, const char *end)
+		{
+			this->animation = animation;
+			this->frameStarts = frameStarts;
+			this->end = end;
+		}
+
+		void Execute(int index)
+		{
+			MD5Tokenizer frameTokenizer((*frameStarts)[index], end);
+			animation->ReadFrame(frameTokenizer, &animation->frames[index]);
+		}
+	};
+
+	class FrameSkeletonTask : public ParallelTask
+	{
+		MD5Anim *animation;
+
+	public:
+		FrameSkeletonTask(MD5Anim *animation)
+		{
+			this->animation = animation;
+		}
+
+		void Execute(int index)
+		{
+			animation->ComputeFrameSkeleton(index);
+		}
+	};
+
+#pragma endregion
 };
 
 #endif
\ No newline at end of file
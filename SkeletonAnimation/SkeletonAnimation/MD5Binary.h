@@ -0,0 +1,368 @@
+#ifndef _MD5BINARY_H_INCLUDED
+#define _MD5BINARY_H_INCLUDED
+
+#pragma region Includes
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "Structs.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Utilerias compartidas por los formatos binarios compilados
+*	(.md5meshbin, .md5animbin y las animaciones horneadas .md5bake).
+*
+*	Cada archivo compilado inicia con un MD5BinaryHeader que guarda
+*	el tamano, la fecha de modificacion y el hash del archivo de texto
+*	de origen; si ya no corresponden, el binario se descarta y se vuelve
+*	a compilar. Las mallas y los horneados comparan el hash por omision
+*	(MD5_LOAD_TRUST_SOURCE_STAMP lo omite); las animaciones solo comparan
+*	tamano y fecha, salvo con MD5_LOAD_VERIFY_SOURCE.
+**/
+
+#define MD5_BINARY_ALIGNMENT 16
+
+#pragma region Binary Format Substructures
+
+struct MD5SourceStamp
+{
+	unsigned long long size;
+	unsigned long long modifiedTime;
+	unsigned long long hash;
+};
+
+struct MD5BinaryHeader
+{
+	char magic[4];
+	int version;
+	int fileSize;
+	int reserved;
+	MD5SourceStamp source;
+};
+
+#define MD5MESH_BINARY_VERSION 5
+
+struct MD5MeshBinaryHeader
+{
+	MD5BinaryHeader common;
+	int numJoints;
+	int numMeshes;
+	int jointsOffset;
+	int meshesOffset;
+	int vertexSize;
+	int staticVertexSize;
+	int vertexInfoSize;
+	int triangleSize;
+	int weightSize;
+};
+
+struct MD5MeshBinaryJoint
+{
+	int nameOffset;
+	int parent;
+	XMFLOAT3 position;
+	XMFLOAT4 orientation;
+};
+
+struct MD5MeshBinaryMesh
+{
+	int shaderOffset;
+	int numVertices;
+	int numTriangles;
+	int numWeights;
+	int verticesOffset;
+	int staticVerticesOffset;
+	int vertexInfoOffset;
+	int trianglesOffset;
+	int weightsOffset;
+	int indicesOffset;
+};
+
+#define MD5ANIM_BINARY_VERSION 1
+
+struct MD5AnimBinaryHeader
+{
+	MD5BinaryHeader common;
+	int numJoints;
+	int numFrames;
+	int frameRate;
+	int numAnimatedComponents;
+	int componentsPerFrame;
+	int hierarchyOffset;
+	int boundsOffset;
+	int baseFrameOffset;
+	int frameIndicesOffset;
+	int componentsOffset;
+	int boundSize;
+	int baseFrameSize;
+};
+
+struct MD5AnimBinaryJoint
+{
+	int nameOffset;
+	int parent;
+	int flags;
+	int startIndex;
+};
+
+#define MD5BAKE_BINARY_VERSION 1
+
+// common.source es el del .md5anim; el horneado tambien depende de la malla y de su orden de vertices.
+// sampleRate es la frecuencia pedida; los numFrames frames reparten duration en partes iguales
+struct MD5BakeBinaryHeader
+{
+	MD5BinaryHeader common;
+	MD5SourceStamp meshSource;
+	unsigned long long vertexOrderHash;
+	float sampleRate;
+	float duration;
+	int numFrames;
+	int numMeshes;
+	int frameBoundsOffset;
+	int meshesOffset;
+	int vertexSize;
+};
+
+// Los vertices de la malla van frame por frame: numFrames bloques de numVertices
+struct MD5BakeBinaryMesh
+{
+	int numVertices;
+	int framesOffset;
+};
+
+#pragma endregion
+
+#pragma region Hashing
+
+unsigned long long HashBytes(const char *data, size_t size)
+{
+	// FNV-1a de 64 bits
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+#pragma endregion
+
+#pragma region Mapped File
+
+class MD5MappedFile
+{
+	HANDLE file;
+	HANDLE mapping;
+	const char *data;
+	size_t size;
+
+public:
+	MD5MappedFile()
+	{
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+		data = NULL;
+		size = 0;
+	}
+
+	~MD5MappedFile()
+	{
+		Close();
+	}
+
+	bool Open(string path)
+	{
+		Close();
+
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			Close();
+			return false;
+		}
+
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL)
+		{
+			Close();
+			return false;
+		}
+
+		size = (size_t)fileSize.QuadPart;
+		return true;
+	}
+
+	void Close()
+	{
+		if (data != NULL)					UnmapViewOfFile(data);
+		if (mapping != NULL)				CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)	CloseHandle(file);
+
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+		data = NULL;
+		size = 0;
+	}
+
+	const char* GetData() { return data; }
+	size_t GetSize() { return size; }
+
+	unsigned long long GetModifiedTime()
+	{
+		FILETIME writeTime;
+		if (file == INVALID_HANDLE_VALUE || !GetFileTime(file, NULL, NULL, &writeTime))
+			return 0;
+
+		return ((unsigned long long)writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime;
+	}
+
+	// Regresa NULL si el rango pedido no cabe dentro del archivo
+	template <class T>
+	const T* At(int offset, int count)
+	{
+		if (offset < 0 || count < 0 || (size_t)offset + sizeof(T) * (size_t)count > size)
+			return NULL;
+
+		return (const T*)(data + offset);
+	}
+
+	// Regresa NULL si la cadena no termina dentro del archivo
+	const char* StringAt(int offset)
+	{
+		if (offset < 0 || (size_t)offset >= size || memchr(data + offset, 0, size - offset) == NULL)
+			return NULL;
+
+		return data + offset;
+	}
+};
+
+// Tamano y fecha del archivo de texto sin leer su contenido; hash queda en 0
+bool ReadSourceStamp(string path, MD5SourceStamp *stamp)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	FILETIME writeTime;
+	bool isRead = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && GetFileTime(file, NULL, NULL, &writeTime);
+	CloseHandle(file);
+
+	if (!isRead)
+		return false;
+
+	stamp->size = (unsigned long long)fileSize.QuadPart;
+	stamp->modifiedTime = ((unsigned long long)writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime;
+	stamp->hash = 0;
+
+	return true;
+}
+
+// Sello completo para guardar en un binario: lee y recorre todo el texto
+bool ComputeSourceStamp(string path, MD5SourceStamp *stamp)
+{
+	MD5MappedFile sourceFile;
+
+	if (!sourceFile.Open(path))
+		return false;
+
+	stamp->size = sourceFile.GetSize();
+	stamp->modifiedTime = sourceFile.GetModifiedTime();
+	stamp->hash = HashBytes(sourceFile.GetData(), sourceFile.GetSize());
+
+	return true;
+}
+
+/**
+*	Sin verifyHash el binario sigue vigente si el texto tiene el mismo
+*	tamano y fecha. Con verifyHash manda el contenido: se lee el texto y
+*	se compara su hash, asi que un texto editado que conserva tamano y
+*	fecha se detecta, y uno que solo cambio de fecha sigue vigente.
+**/
+bool IsSourceCurrent(const MD5SourceStamp &stored, string path, bool verifyHash)
+{
+	MD5SourceStamp current;
+
+	if (!ReadSourceStamp(path, &current) || current.size != stored.size)
+		return false;
+
+	if (!verifyHash)
+		return current.modifiedTime == stored.modifiedTime;
+
+	return ComputeSourceStamp(path, &current) && current.hash == stored.hash;
+}
+
+#pragma endregion
+
+#pragma region Writer
+
+class MD5BinaryWriter
+{
+	vector<char> buffer;
+
+public:
+	// Agrega los bytes alineados y regresa su offset desde el inicio del archivo
+	int Append(const void *data, size_t bytes, size_t alignment = MD5_BINARY_ALIGNMENT)
+	{
+		while (buffer.size() % alignment != 0)
+			buffer.push_back(0);
+
+		int offset = (int)buffer.size();
+		buffer.resize(buffer.size() + bytes);
+
+		if (bytes > 0)
+			memcpy(&buffer[offset], data, bytes);
+
+		return offset;
+	}
+
+	int AppendString(string text)
+	{
+		return Append(text.c_str(), text.size() + 1, 1);
+	}
+
+	void Patch(int offset, const void *data, size_t bytes)
+	{
+		memcpy(&buffer[offset], data, bytes);
+	}
+
+	int GetSize() { return (int)buffer.size(); }
+
+	bool Save(string path)
+	{
+		ofstream fileStream(path.c_str(), ofstream::out | ofstream::binary | ofstream::trunc);
+
+		if (!fileStream.is_open())
+			return false;
+
+		fileStream.write(&buffer[0], buffer.size());
+		return fileStream.good();
+	}
+};
+
+#pragma endregion
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef _COMPRESSEDANIM_H_INCLUDED
+#define _COMPRESSEDANIM_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <xnamath.h>
+#include "MD5Anim.h"
+#include "Pose.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Version comprimida de un MD5Anim. Cada joint tiene un canal de
+*	traslacion y uno de rotacion en espacio local; de cada canal solo se
+*	guardan los keyframes que no se pueden reconstruir interpolando a
+*	sus vecinos dentro de la tolerancia pedida. Las rotaciones se guardan
+*	con smallest-three en 48 bits.
+*
+*	La pose se reconstruye igual que con MD5_LOAD_SAMPLE_LOCAL: se
+*	interpola en espacio local y se recorre la jerarquia una vez, asi
+*	que para medir el error conviene comparar contra un MD5Anim cargado
+*	en ese modo.
+**/
+
+#pragma region Compressed Substructures
+
+// Tres componentes de 15 bits; el bit alto de las dos primeras guarda el indice del componente omitido
+struct PackedQuaternion
+{
+	unsigned short components[3];
+};
+
+struct CompressedTrack
+{
+	int firstKey;
+	int numKeys;
+};
+
+#pragma endregion
+
+#define QUATERNION_COMPONENT_RANGE	0.70710678f
+#define QUATERNION_COMPONENT_STEPS	32767.0f
+
+class MD5CompressedAnim
+{
+	int numJoints;
+	int numFrames;
+	int frameRate;
+	size_t uncompressedSize;
+
+	vector<int> parents;
+
+	vector<CompressedTrack> translationTracks;
+	vector<unsigned short> translationKeyFrames;
+	vector<XMFLOAT3> translationKeys;
+
+	vector<CompressedTrack> rotationTracks;
+	vector<unsigned short> rotationKeyFrames;
+	vector<PackedQuaternion> rotationKeys;
+
+public:
+	MD5CompressedAnim()
+	{
+		numJoints = 0;
+		numFrames = 0;
+		frameRate = 0;
+		uncompressedSize = 0;
+	}
+
+	// positionTolerance en unidades del modelo y rotationTolerance en radianes, ambas por canal en espacio local
+	bool Compress(const MD5Anim &source, float positionTolerance, float rotationTolerance)
+	{
+		// Los indices de keyframe se guardan en 16 bits
+		if (source.GetNumFrames() <= 0 || source.GetNumFrames() > 65536)
+			return false;
+
+		numJoints = source.GetNumJoints();
+		numFrames = source.GetNumFrames();
+		frameRate = source.GetFrameRate();
+		parents = source.GetSkeleton().parents;
+		uncompressedSize = sizeof(float) * numFrames * source.GetNumAnimatedComponents() + sizeof(BaseFrameInfo) * numJoints;
+
+		translationTracks.resize(numJoints);
+		rotationTracks.resize(numJoints);
+		translationKeyFrames.clear();
+		translationKeys.clear();
+		rotationKeyFrames.clear();
+		rotationKeys.clear();
+
+		vector<XMFLOAT3> positions(numFrames);
+		vector<XMFLOAT4> orientations(numFrames);
+		vector<XMFLOAT4> quantizedOrientations(numFrames);
+		vector<PackedQuaternion> packedOrientations(numFrames);
+		vector<int> keys;
+
+		for (int j = 0; j < numJoints; j++)
+		{
+			for (int i = 0; i < numFrames; i++)
+			{
+				source.GetLocalJoint(i, j, &positions[i], &orientations[i]);
+				PackQuaternion(orientations[i], &packedOrientations[i]);
+				quantizedOrientations[i] = UnpackQuaternion(packedOrientations[i]);
+			}
+
+			ReduceTranslationKeys(positions, positionTolerance, &keys);
+			translationTracks[j].firstKey = translationKeys.size();
+			translationTracks[j].numKeys = keys.size();
+			for (int k = 0; k < (int)keys.size(); k++)
+			{
+				translationKeyFrames.push_back((unsigned short)keys[k]);
+				translationKeys.push_back(positions[keys[k]]);
+			}
+
+			ReduceRotationKeys(orientations, quantizedOrientations, rotationTolerance, &keys);
+			rotationTracks[j].firstKey = rotationKeys.size();
+			rotationTracks[j].numKeys = keys.size();
+			for (int k = 0; k < (int)keys.size(); k++)
+			{
+				rotationKeyFrames.push_back((unsigned short)keys[k]);
+				rotationKeys.push_back(packedOrientations[keys[k]]);
+			}
+		}
+
+		return true;
+	}
+
+	// Reconstruye en la primera pose de pose (numJoints joints) la pose en espacio de modelo para el tiempo dado;
+	// fuera del clip se toma el primer o el ultimo frame sin interpolar, igual que MD5Anim::GetFrames
+	void SamplePose(float time, PoseBuffer *pose) const
+	{
+		if (numFrames == 0)
+			return;
+
+		float currentFrame = time * frameRate;
+		int frame0 = floorf(currentFrame);
+		float interpolation = currentFrame - frame0;
+
+		if (frame0 < 0 || frame0 >= numFrames)
+		{
+			frame0 = frame0 < 0 ? 0 : numFrames - 1;
+			interpolation = 0;
+		}
+
+		int frame1 = frame0 == numFrames - 1 ? 0 : frame0 + 1;
+
+		XMFLOAT4A *positions = pose->GetPositions(0);
+		XMFLOAT4A *orientations = pose->GetOrientations(0);
+
+		for (int j = 0; j < numJoints; j++)
+		{
+			XMFLOAT3 position = SampleTranslation(translationTracks[j], frame0, frame1, interpolation);
+			XMFLOAT4 orientation = SampleRotation(rotationTracks[j], frame0, frame1, interpolation);
+
+			if (parents[j] >= 0)
+				MD5Anim::ConcatenateWithParent(positions[parents[j]], orientations[parents[j]], &position, &orientation);
+
+			positions[j] = XMFLOAT4A(position.x, position.y, position.z, 0);
+			orientations[j] = XMFLOAT4A(orientation.x, orientation.y, orientation.z, orientation.w);
+		}
+	}
+
+	// Compara contra source.SamplePose en samplesPerFrame tiempos por frame; el error es en espacio de modelo
+	void MeasureError(const MD5Anim &source, int samplesPerFrame, float *maxPositionError, float *maxRotationError) const
+	{
+		PoseBuffer pose, reference;
+		pose.Allocate(1, numJoints);
+		reference.Allocate(1, numJoints);
+
+		*maxPositionError = 0;
+		*maxRotationError = 0;
+
+		for (int i = 0; i < numFrames * samplesPerFrame; i++)
+		{
+			float time = (float)i / (samplesPerFrame * frameRate);
+			source.SamplePose(time, &reference);
+			SamplePose(time, &pose);
+
+			for (int j = 0; j < numJoints; j++)
+			{
+				XMVECTOR difference = XMLoadFloat4A(&pose.GetPositions(0)[j]) - XMLoadFloat4A(&reference.GetPositions(0)[j]);
+				float positionError = XMVectorGetX(XMVector3Length(difference));
+				float dot = fabsf(XMVectorGetX(XMQuaternionDot(XMLoadFloat4A(&pose.GetOrientations(0)[j]), XMLoadFloat4A(&reference.GetOrientations(0)[j]))));
+				float rotationError = 2.0f * acosf(dot > 1.0f ? 1.0f : dot);
+
+				*maxPositionError = max(*maxPositionError, positionError);
+				*maxRotationError = max(*maxRotationError, rotationError);
+			}
+		}
+	}
+
+	int GetNumJoints() const { return numJoints; }
+	int GetNumKeys() const { return (int)(translationKeys.size() + rotationKeys.size()); }
+	int GetNumUncompressedKeys() const { return 2 * numJoints * numFrames; }
+	size_t GetUncompressedSize() const { return uncompressedSize; }
+
+	size_t GetCompressedSize() const
+	{
+		return sizeof(CompressedTrack) * (translationTracks.size() + rotationTracks.size()) +
+			   sizeof(unsigned short) * (translationKeyFrames.size() + rotationKeyFrames.size()) +
+			   sizeof(XMFLOAT3) * translationKeys.size() +
+			   sizeof(PackedQuaternion) * rotationKeys.size();
+	}
+
+#pragma region Quantization
+
+	static void PackQuaternion(XMFLOAT4 q, PackedQuaternion *packed)
+	{
+		float values[4] = { q.x, q.y, q.z, q.w };
+
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (fabsf(values[i]) > fabsf(values[largest]))
+				largest = i;
+
+		// q y -q son la misma rotacion: se fuerza positivo el componente omitido
+		float sign = values[largest] < 0 ? -1.0f : 1.0f;
+
+		for (int i = 0, k = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			float normalized = (values[i] * sign / QUATERNION_COMPONENT_RANGE) * 0.5f + 0.5f;
+			normalized = normalized < 0 ? 0 : (normalized > 1 ? 1 : normalized);
+			packed->components[k++] = (unsigned short)(normalized * QUATERNION_COMPONENT_STEPS + 0.5f);
+		}
+
+		packed->components[0] |= (largest & 1) << 15;
+		packed->components[1] |= (largest >> 1) << 15;
+	}
+
+	static XMFLOAT4 UnpackQuaternion(const PackedQuaternion &packed)
+	{
+		int largest = (packed.components[0] >> 15) | ((packed.components[1] >> 15) << 1);
+		float values[4];
+		float sumOfSquares = 0;
+
+		for (int i = 0, k = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			float normalized = (packed.components[k++] & 0x7FFF) / QUATERNION_COMPONENT_STEPS;
+			values[i] = (normalized - 0.5f) * 2.0f * QUATERNION_COMPONENT_RANGE;
+			sumOfSquares += values[i] * values[i];
+		}
+
+		values[largest] = sqrtf(sumOfSquares < 1.0f ? 1.0f - sumOfSquares : 0.0f);
+
+		XMFLOAT4 q;
+		XMStoreFloat4(&q, XMQuaternionNormalize(XMVectorSet(values[0], values[1], values[2], values[3])));
+		return q;
+	}
+
+#pragma endregion
+
+private:
+#pragma region Key reduction
+
+	// Avanza cada segmento mientras todos los frames intermedios queden dentro de la tolerancia
+	static void ReduceTranslationKeys(const vector<XMFLOAT3> &values, float tolerance, vector<int> *keys)
+	{
+		keys->clear();
+		keys->push_back(0);
+
+		int last = values.size() - 1;
+		if (IsConstantTranslation(values, tolerance))
+			return;
+
+		for (int start = 0; start < last;)
+		{
+			int end = start + 1;
+			while (end < last && TranslationSegmentFits(values, start, end + 1, tolerance))
+				end++;
+
+			keys->push_back(end);
+			start = end;
+		}
+	}
+
+	static void ReduceRotationKeys(const vector<XMFLOAT4> &values, const vector<XMFLOAT4> &quantized, float tolerance, vector<int> *keys)
+	{
+		keys->clear();
+		keys->push_back(0);
+
+		int last = values.size() - 1;
+		if (IsConstantRotation(values, quantized[0], tolerance))
+			return;
+
+		for (int start = 0; start < last;)
+		{
+			int end = start + 1;
+			while (end < last && RotationSegmentFits(values, quantized, start, end + 1, tolerance))
+				end++;
+
+			keys->push_back(end);
+			start = end;
+		}
+	}
+
+	static bool IsConstantTranslation(const vector<XMFLOAT3> &values, float tolerance)
+	{
+		for (int i = 1; i < (int)values.size(); i++)
+			if (TranslationError(values[0], values[i]) > tolerance)
+				return false;
+
+		return true;
+	}
+
+	static bool IsConstantRotation(const vector<XMFLOAT4> &values, const XMFLOAT4 &key, float tolerance)
+	{
+		for (int i = 0; i < (int)values.size(); i++)
+			if (RotationError(key, values[i]) > tolerance)
+				return false;
+
+		return true;
+	}
+
+	static bool TranslationSegmentFits(const vector<XMFLOAT3> &values, int start, int end, float tolerance)
+	{
+		for (int i = start + 1; i < end; i++)
+		{
+			XMFLOAT3 interpolated = LerpTranslation(values[start], values[end], (float)(i - start) / (end - start));
+			if (TranslationError(interpolated, values[i]) > tolerance)
+				return false;
+		}
+
+		return true;
+	}
+
+	static bool RotationSegmentFits(const vector<XMFLOAT4> &values, const vector<XMFLOAT4> &quantized, int start, int end, float tolerance)
+	{
+		for (int i = start + 1; i < end; i++)
+		{
+			XMFLOAT4 interpolated = SlerpRotation(quantized[start], quantized[end], (float)(i - start) / (end - start));
+			if (RotationError(interpolated, values[i]) > tolerance)
+				return false;
+		}
+
+		return true;
+	}
+
+	static float TranslationError(const XMFLOAT3 &a, const XMFLOAT3 &b)
+	{
+		return XMVectorGetX(XMVector3Length(XMLoadFloat3(&a) - XMLoadFloat3(&b)));
+	}
+
+	static float RotationError(const XMFLOAT4 &a, const XMFLOAT4 &b)
+	{
+		float dot = fabsf(XMVectorGetX(XMQuaternionDot(XMLoadFloat4(&a), XMLoadFloat4(&b))));
+		return 2.0f * acosf(dot > 1.0f ? 1.0f : dot);
+	}
+
+#pragma endregion
+
+#pragma region Sampling
+
+	static XMFLOAT3 LerpTranslation(const XMFLOAT3 &a, const XMFLOAT3 &b, float t)
+	{
+		return XMFLOAT3(b.x * t + (1 - t) * a.x, b.y * t + (1 - t) * a.y, b.z * t + (1 - t) * a.z);
+	}
+
+	static XMFLOAT4 SlerpRotation(const XMFLOAT4 &a, const XMFLOAT4 &b, float t)
+	{
+		XMFLOAT4 result;
+		XMStoreFloat4(&result, XMQuaternionSlerp(XMLoadFloat4(&a), XMLoadFloat4(&b), t));
+		return result;
+	}
+
+	// Regresa el indice (relativo al canal) del ultimo key con frame <= frame
+	static int FindKey(const unsigned short *keyFrames, int numKeys, int frame)
+	{
+		return (int)(upper_bound(keyFrames, keyFrames + numKeys, frame) - keyFrames) - 1;
+	}
+
+	XMFLOAT3 TranslationAt(const CompressedTrack &track, int frame) const
+	{
+		const unsigned short *keyFrames = &translationKeyFrames[track.firstKey];
+		const XMFLOAT3 *keys = &translationKeys[track.firstKey];
+
+		int k = FindKey(keyFrames, track.numKeys, frame);
+		if (k == track.numKeys - 1)
+			return keys[k];
+
+		return LerpTranslation(keys[k], keys[k + 1], (float)(frame - keyFrames[k]) / (keyFrames[k + 1] - keyFrames[k]));
+	}
+
+	XMFLOAT4 RotationAt(const CompressedTrack &track, int frame) const
+	{
+		const unsigned short *keyFrames = &rotationKeyFrames[track.firstKey];
+		const PackedQuaternion *keys = &rotationKeys[track.firstKey];
+
+		int k = FindKey(keyFrames, track.numKeys, frame);
+		if (k == track.numKeys - 1)
+			return UnpackQuaternion(keys[k]);
+
+		return SlerpRotation(UnpackQuaternion(keys[k]), UnpackQuaternion(keys[k + 1]),
+							 (float)(frame - keyFrames[k]) / (keyFrames[k + 1] - keyFrames[k]));
+	}
+
+	// Si los dos frames caen en el mismo segmento se interpola una sola vez entre sus keys;
+	// solo al dar la vuelta del ultimo frame al primero se evaluan por separado
+	XMFLOAT3 SampleTranslation(const CompressedTrack &track, int frame0, int frame1, float interpolation) const
+	{
+		const unsigned short *keyFrames = &translationKeyFrames[track.firstKey];
+		const XMFLOAT3 *keys = &translationKeys[track.firstKey];
+
+		if (track.numKeys == 1)
+			return keys[0];
+
+		int k = FindKey(keyFrames, track.numKeys, frame0);
+		if (frame1 != frame0 + 1 || k == track.numKeys - 1)
+			return LerpTranslation(TranslationAt(track, frame0), TranslationAt(track, frame1), interpolation);
+
+		return LerpTranslation(keys[k], keys[k + 1], (frame0 - keyFrames[k] + interpolation) / (keyFrames[k + 1] - keyFrames[k]));
+	}
+
+	XMFLOAT4 SampleRotation(const CompressedTrack &track, int frame0, int frame1, float interpolation) const
+	{
+		const unsigned short *keyFrames = &rotationKeyFrames[track.firstKey];
+		const PackedQuaternion *keys = &rotationKeys[track.firstKey];
+
+		if (track.numKeys == 1)
+			return UnpackQuaternion(keys[0]);
+
+		int k = FindKey(keyFrames, track.numKeys, frame0);
+		if (frame1 != frame0 + 1 || k == track.numKeys - 1)
+			return SlerpRotation(RotationAt(track, frame0), RotationAt(track, frame1), interpolation);
+
+		return SlerpRotation(UnpackQuaternion(keys[k]), UnpackQuaternion(keys[k + 1]),
+							 (frame0 - keyFrames[k] + interpolation) / (keyFrames[k + 1] - keyFrames[k]));
+	}
+
+#pragma endregion
+};
+
+#endif
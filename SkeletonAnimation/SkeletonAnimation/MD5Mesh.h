@@ -11,10 +11,21 @@
 #include <xnamath.h>
 #include <vector>
 #include "Util.h"
-#include "Game.h"
 #include "Camera.h"
 #include "Structs.h"
 #include "MD5Anim.h"
+#include "MD5Binary.h"
+#include "AnimationRegistry.h"
+#include "AnimationState.h"
+#include "MatrixSkinning.h"
+#include "DualQuaternionSkinning.h"
+#include "WorkerPool.h"
+#include "SkinningSink.h"
+#include "VertexQuantization.h"
+#include "TangentFrames.h"
+#include "MeshOptimization.h"
+#include "BakedAnimation.h"
+#include "SkinningCache.h"
 
 #pragma endregion
 
@@ -24,6 +35,17 @@ using namespace std;
 
 #pragma endregion
 
+// Vertices por bloque de skinning; multiplo de SKINNING_STREAM_PADDING para que los
+// kernels SIMD de cada bloque empiecen alineados con las streams
+#define SKINNING_CHUNK_VERTICES 2048
+
+// Error de un nivel de detalle visto desde la camara, en radianes: con la proyeccion de Camera
+// (45 grados para 640 pixeles de alto) es poco mas de un pixel y medio
+#define DETAIL_LEVEL_DEFAULT_TOLERANCE 0.002f
+
+// Frames del clip, ademas de la bind pose, en los que se mide el error al simplificar
+#define DETAIL_LEVEL_POSES 8
+
 class MD5Mesh
 {
 #pragma region Private members
@@ -37,9 +59,15 @@ public:
 	vector<Mesh> meshes;
 
 	ID3D11VertexShader *vertexShader;
+	ID3D11VertexShader *quantizedVertexShader;
+	ID3D11VertexShader *tangentFrameVertexShader;
 	ID3D11PixelShader *pixelShader;
+	ID3D11PixelShader *normalMapPixelShader;
 	ID3D11InputLayout *inputLayout;
+	ID3D11InputLayout *quantizedInputLayout;
+	ID3D11InputLayout *tangentFrameInputLayout;
 	ID3D11Buffer *constantBuffer;
+	ID3D11Buffer *quantizationConstantBuffer;
 	ID3D11SamplerState *colorMapSampler;
 
 	XMFLOAT3 translation;
@@ -49,37 +77,159 @@ public:
 
 	MatrixBuffer matrixBuffer;
 
+	// El clip es compartido entre instancias; el estado de reproduccion es propio
 	MD5Anim *animation;
+	AnimationState playback;
+	SkinningMethod skinningMethod;
+	MatrixPalette palette;
+	DualQuaternionPalette dualQuaternionPalette;
+	WorkerPool *workerPool;
 	ID3D11DeviceContext *deviceContext;
 	DWORD biggestUpdate;
 
+private:
+	// Rango de vertices de una malla que un hilo procesa de una vez
+	struct SkinningChunk
+	{
+		int mesh;
+		int first;
+		int count;
+		// Posicion del primer vertice de la malla entre los de todas las mallas
+		int meshOffset;
+	};
+
+	vector<SkinningChunk> skinningChunks;
+
+	// Niveles de detalle de BuildDetailLevels; detailLevels[0] es la malla completa. Las mallas y
+	// bloques del nivel activo viven en meshes y skinningChunks, y su lugar aqui queda vacio
+	struct DetailLevel
+	{
+		vector<Mesh> meshes;
+		vector<SkinningChunk> skinningChunks;
+		DetailLevelStats stats;
+	};
+
+	vector<DetailLevel> detailLevels;
+	int detailLevel;
+	float detailTolerance;
+	// Centro de la caja de bind pose, de donde se mide la distancia a la camara
+	XMFLOAT3 detailCenter;
+
+	// Metodo con el que se transforma el frame actual; SKINNING_WEIGHTS si la paleta no corresponde a la pose
+	SkinningMethod frameSkinningMethod;
+	// Rotaciones con las que se giran los marcos tangentes del frame; NULL los deja en bind pose
+	const DualQuaternion *frameRotations;
+	int maxInfluences;
+	// Los binarios (.md5meshbin y .md5bake) se validan con el hash del texto salvo con MD5_LOAD_TRUST_SOURCE_STAMP
+	bool verifySource;
+
+	// Sin destino los vertices se escriben en meshes[i].vertices; con contexto van directo al vertex buffer
+	D3D11VertexSink deviceSink;
+	SkinningSink *outputSink;
+	vector<void*> outputVertices;
+
+	// Salida cuantizada: caja de cada frame del clip y la del tiempo actual
+	VertexOutputFormat outputFormat;
+	vector<Bound> frameBounds;
+	QuantizationBounds quantizationBounds;
+	// Salida en float del frame (todas las mallas, como frameCacheVertices) que se codifica en los otros formatos
+	vector<Vertex> frameVertices;
+
+	// Reproduccion horneada: compartida entre instancias; el frame actual solo interpola bakedFrames
+	const BakedAnimation *bakedAnimation;
+	bool frameIsBaked;
+	int bakedFrames[2];
+	float bakedInterpolation;
+
+	// Cache compartido; el frame actual copia frameCacheEntry o se transforma en frameCacheVertices para agregarlo
+	SkinningCache *skinningCache;
+	unsigned long long skinningCacheModel;
+	SkinningCacheKey frameCacheKey;
+	const SkinningCacheEntry *frameCacheEntry;
+	bool frameFillsCache;
+	vector<Vertex> frameCacheVertices;
+
 #pragma endregion
 
 #pragma region Public methods
 
 public:
-	MD5Mesh(string filename, ID3D11DeviceContext *deviceContext)
+	MD5Mesh(string filename, ID3D11DeviceContext *deviceContext, unsigned int loadFlags = MD5_LOAD_SERIAL)
+		: deviceSink(deviceContext)
 	{
 		this->filename = filename;
 		this->deviceContext = deviceContext;
+		this->skinningMethod = SKINNING_WEIGHTS;
+		this->workerPool = WorkerPool::GetShared();
+		this->frameSkinningMethod = SKINNING_WEIGHTS;
+		this->frameRotations = NULL;
+		this->maxInfluences = MD5_LOAD_GET_MAX_INFLUENCES(loadFlags);
+		this->verifySource = !(loadFlags & MD5_LOAD_TRUST_SOURCE_STAMP);
+		this->outputSink = deviceContext != NULL ? &deviceSink : NULL;
+		this->outputFormat = VERTEX_OUTPUT_FLOAT;
+		ZeroMemory(&quantizationBounds, sizeof(quantizationBounds));
+		this->bakedAnimation = NULL;
+		this->frameIsBaked = false;
+		this->bakedFrames[0] = this->bakedFrames[1] = 0;
+		this->bakedInterpolation = 0;
+		this->skinningCache = NULL;
+		this->skinningCacheModel = 0;
+		ZeroMemory(&frameCacheKey, sizeof(frameCacheKey));
+		this->frameCacheEntry = NULL;
+		this->frameFillsCache = false;
+		this->detailLevel = 0;
+		this->detailTolerance = DETAIL_LEVEL_DEFAULT_TOLERANCE;
+		this->detailCenter = XMFLOAT3(0, 0, 0);
+		this->world = XMMatrixIdentity();
 		biggestUpdate = 0;
 
-		ifstream fileStream(filename + ".md5mesh", ifstream::in);
-		
-		if (fileStream.is_open())
+		// Si existe un .md5meshbin vigente se carga directamente; si no, se
+		// interpreta el texto y se compila el binario para la siguiente vez.
+		// El binario guarda el orden optimizado y sin duplicados, asi que no
+		// sirve para MD5_LOAD_KEEP_FILE_ORDER ni MD5_LOAD_KEEP_DUPLICATES
+		bool keepFileOrder = (loadFlags & MD5_LOAD_KEEP_FILE_ORDER) != 0;
+		bool keepDuplicates = (loadFlags & MD5_LOAD_KEEP_DUPLICATES) != 0;
+		bool useCache = !(loadFlags & MD5_LOAD_SKIP_CACHE) && !keepFileOrder && !keepDuplicates;
+		MD5SourceStamp source;
+		bool hasSource = ReadSourceStamp(filename + ".md5mesh", &source);
+
+		if (!(useCache && LoadCompiledMesh(filename + ".md5meshbin", hasSource ? filename + ".md5mesh" : "")) && hasSource)
 		{
-			ReadNumJointsAndMeshes(fileStream);
-			ReadJoints(fileStream);
-			ReadMeshes(fileStream);
+			MD5Tokenizer tokenizer;
+
+			if (tokenizer.Open(filename + ".md5mesh"))
+			{
+				ReadNumJointsAndMeshes(tokenizer);
+				ReadJoints(tokenizer);
+				ReadMeshes(tokenizer);
+
+				if (!keepDuplicates)
+					WeldDuplicateVertices();
+
+				ComputeBindPose();
+
+				if (!keepFileOrder)
+					OptimizeMeshOrder();
+
+				if (useCache && ComputeSourceStamp(filename + ".md5mesh", &source))
+					SaveCompiledMesh(filename + ".md5meshbin", source);
+			}
 		}
 
-		animation = new MD5Anim(filename);
+		if (maxInfluences < 1 || maxInfluences > MAX_BONE_INFLUENCES)
+			maxInfluences = MAX_BONE_INFLUENCES;
+
+		PrepareMatrixSkinning();
+
+		animation = AnimationRegistry::GetShared()->Acquire(filename, loadFlags);
+		playback.GetPose().Allocate(1, animation->GetNumJoints());
 	}
 
 	~MD5Mesh()
 	{
 		joints.clear();
 		meshes.clear();
+		AnimationRegistry::GetShared()->Release(animation);
 	}
 
 	bool CompileShaders(ID3D11Device *device)
@@ -106,13 +256,13 @@ public:
 			return false;
 		}
 		
-		// Creando el input layout
+		// Creando el input layout: el slot 0 es el stream dinamico (Vertex) y el 1 el estatico (StaticVertex)
 		D3D11_INPUT_ELEMENT_DESC solidColorLayout[] =
 		{
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },			  
 			{ "NORMAL",	 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
-			{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },			  
+			{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT,    1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
 			//{ "BLENDINDICES", 0, DXGI_FORMAT_R32G32B32A32_UINT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0}
 		};
 
@@ -131,6 +281,75 @@ public:
 			return false;
 		}
 
+		// Variante que decodifica QuantizedVertex; mismo stream estatico en el slot 1
+		ID3DBlob *quantizedShaderBlob;
+
+		compileResult = CompileD3DShader(L"TestShader.fx", "VS_Main_Quantized", "vs_4_0", &quantizedShaderBlob);
+		if ( !compileResult )
+			return false;
+
+		d3dResult = device->CreateVertexShader(quantizedShaderBlob->GetBufferPointer(),
+											   quantizedShaderBlob->GetBufferSize(),
+											   0,
+											   &quantizedVertexShader);
+		if ( FAILED(d3dResult) )
+		{
+			quantizedShaderBlob->Release();
+			return false;
+		}
+
+		D3D11_INPUT_ELEMENT_DESC quantizedLayout[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL",	 0, DXGI_FORMAT_R16G16_SNORM,	0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT,    1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		};
+
+		d3dResult = device->CreateInputLayout(quantizedLayout,
+											  ARRAYSIZE(quantizedLayout),
+											  quantizedShaderBlob->GetBufferPointer(),
+											  quantizedShaderBlob->GetBufferSize(),
+											  &quantizedInputLayout);
+		quantizedShaderBlob->Release();
+
+		if ( FAILED(d3dResult) )
+			return false;
+
+		// Variante de TangentFrameVertex: el cuaternion del marco tangente ocupa el lugar de la normal
+		ID3DBlob *tangentFrameShaderBlob;
+
+		compileResult = CompileD3DShader(L"TestShader.fx", "VS_Main_TangentFrame", "vs_4_0", &tangentFrameShaderBlob);
+		if ( !compileResult )
+			return false;
+
+		d3dResult = device->CreateVertexShader(tangentFrameShaderBlob->GetBufferPointer(),
+											   tangentFrameShaderBlob->GetBufferSize(),
+											   0,
+											   &tangentFrameVertexShader);
+		if ( FAILED(d3dResult) )
+		{
+			tangentFrameShaderBlob->Release();
+			return false;
+		}
+
+		D3D11_INPUT_ELEMENT_DESC tangentFrameLayout[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL",	 0, DXGI_FORMAT_R16G16B16A16_SNORM,	0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+
+		d3dResult = device->CreateInputLayout(tangentFrameLayout,
+											  ARRAYSIZE(tangentFrameLayout),
+											  tangentFrameShaderBlob->GetBufferPointer(),
+											  tangentFrameShaderBlob->GetBufferSize(),
+											  &tangentFrameInputLayout);
+		tangentFrameShaderBlob->Release();
+
+		if ( FAILED(d3dResult) )
+			return false;
+
 		// Compilando pixel shader
 		compileResult = CompileD3DShader(L"TestShader.fx", "PS_Main", "ps_4_0", &pixelShaderBlob);
 		if ( !compileResult )
@@ -148,6 +367,22 @@ public:
 			return false;
 		}
 
+		pixelShaderBlob->Release();
+
+		// Pixel shader con mapa de normales para la salida VERTEX_OUTPUT_TANGENT_FRAME
+		compileResult = CompileD3DShader(L"TestShader.fx", "PS_Main_NormalMap", "ps_4_0", &pixelShaderBlob);
+		if ( !compileResult )
+			return false;
+
+		d3dResult = device->CreatePixelShader(pixelShaderBlob->GetBufferPointer(),
+											  pixelShaderBlob->GetBufferSize(),
+											  0,
+											  &normalMapPixelShader);
+		pixelShaderBlob->Release();
+
+		if ( FAILED(d3dResult) )
+			return false;
+
 		return true;
 	}
 
@@ -168,8 +403,10 @@ public:
 		matrixBuffer.view		= camera->GetViewMatrix();
 		matrixBuffer.projection = camera->GetProjectionMatrix();		
 
+		SelectDetailLevel(camera->GetPosition());
+
 		DWORD start = GetTickCount();
-		animation->UpdateModel(this->meshes, deltaTime, deviceContext);
+		UpdateModel(deltaTime);
 		DWORD end = GetTickCount();
 
 		DWORD updateTime = end - start;
@@ -180,77 +417,1244 @@ public:
 		int debug = 0;
 	}
 
+	/**
+	*	Avanza la reproduccion, muestrea el clip compartido y escribe los
+	*	vertices en el destino de salida. Con contexto el skinning escribe
+	*	directo en los vertex buffers mapeados, asi que meshes[i].vertices
+	*	se queda en bind pose. Los bloques de vertices se reparten entre los
+	*	hilos del pool; cada bloque escribe solo sus vertices, asi que el
+	*	resultado es identico al serial sin importar cuantos hilos haya.
+	**/
+	void UpdateModel(float deltaTime)
+	{
+		if (animation->GetNumFrames() == 0)
+			return;
+
+		BeginOutput();
+		AnimateModel(deltaTime, true);
+		EndOutput();
+	}
+
+	/**
+	*	Actualiza muchos personajes a la vez: los destinos se abren y cierran
+	*	desde el hilo que llama y en medio cada hilo del pool anima modelos
+	*	completos (con su skinning serial). Con un solo modelo se reparten
+	*	sus bloques de vertices en su lugar.
+	**/
+	static void UpdateModels(MD5Mesh **models, int numModels, float deltaTime, WorkerPool *pool = WorkerPool::GetShared())
+	{
+		if (numModels == 1)
+		{
+			models[0]->UpdateModel(deltaTime);
+			return;
+		}
+
+		for (int i = 0; i < numModels; i++)
+		{
+			if (models[i]->animation->GetNumFrames() > 0)
+				models[i]->BeginOutput();
+		}
+
+		ModelUpdateTask updateTask(models, deltaTime);
+		pool->Run(&updateTask, numModels);
+
+		for (int i = 0; i < numModels; i++)
+			models[i]->EndOutput();
+	}
+
+	AnimationState& GetPlayback() { return playback; }
+
+	SkinningMethod GetSkinningMethod() const { return skinningMethod; }
+	void SetSkinningMethod(SkinningMethod skinningMethod) { this->skinningMethod = skinningMethod; }
+
+	// Pool que reparte el skinning de este modelo; NULL lo hace siempre en el hilo que llama
+	WorkerPool* GetWorkerPool() const { return workerPool; }
+	void SetWorkerPool(WorkerPool *workerPool) { this->workerPool = workerPool; }
+
+	int GetNumSkinningChunks() const { return (int)skinningChunks.size(); }
+
+	/**
+	*	Arma hasta numLevels niveles de detalle despues de la malla completa;
+	*	cada uno deja triangleRatio de los triangulos del anterior con
+	*	colapsos de lados ordenados por cuadricas de error, medidas en la
+	*	bind pose y en DETAIL_LEVEL_POSES frames del clip (SimplifyMesh).
+	*	Los vertices que quedan son de la malla completa con sus mismos
+	*	pesos, asi que un nivel se anima con cualquier metodo igual que ella,
+	*	solo que con menos vertices. Para antes si un nivel ya no quita
+	*	triangulos. Se llama antes de PrepareGraphicResources, que crea los
+	*	buffers de todos los niveles.
+	**/
+	void BuildDetailLevels(int numLevels, float triangleRatio = 0.5f)
+	{
+		SetDetailLevel(0);
+		detailLevels.clear();
+		detailLevels.reserve(numLevels + 1);
+
+		DetailLevel fullLevel;
+		fullLevel.stats = CountDetailLevel(meshes, 0);
+		detailLevels.push_back(fullLevel);
+
+		vector<vector<Mesh> > meshLevels(meshes.size());
+		vector<vector<float> > meshErrors(meshes.size());
+
+		// El error de cada colapso se mide tambien en frames del clip repartidos en toda su duracion
+		int numPoses = animation->GetNumFrames() < DETAIL_LEVEL_POSES ? animation->GetNumFrames() : DETAIL_LEVEL_POSES;
+		PoseBuffer pose;
+		pose.Allocate(1, animation->GetNumJoints());
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			int numVertices = meshes[i].vertices.size();
+			vector<vector<Vertex> > poses(numVertices > 0 ? numPoses : 0);
+
+			for (int p = 0; p < (int)poses.size(); p++)
+			{
+				SampleFrame(p * animation->GetNumFrames() / numPoses, &pose);
+				poses[p].resize(numVertices);
+				SkinMeshWithWeights(&meshes[i], pose, 0, numVertices, &poses[p][0], false);
+			}
+
+			vector<int> targetTriangles(numLevels);
+			float ratio = 1;
+
+			for (int k = 0; k < numLevels; k++)
+			{
+				ratio *= triangleRatio;
+				targetTriangles[k] = (int)(meshes[i].triangles.size() * ratio);
+			}
+
+			SimplifyMesh(meshes[i], poses, targetTriangles, &meshLevels[i], &meshErrors[i]);
+		}
+
+		for (int k = 0; k < numLevels; k++)
+		{
+			DetailLevel level;
+			float error = 0;
+
+			for (int i = 0; i < (int)meshes.size(); i++)
+			{
+				level.meshes.push_back(meshLevels[i][k]);
+				error = meshErrors[i][k] > error ? meshErrors[i][k] : error;
+			}
+
+			level.stats = CountDetailLevel(level.meshes, error);
+
+			if (level.stats.numTriangles >= detailLevels.back().stats.numTriangles)
+				break;
+
+			detailLevels.push_back(level);
+
+			// El orden, las influencias y los bloques se arman sobre el nivel activo
+			SetDetailLevel(detailLevels.size() - 1);
+			OptimizeMeshOrder();
+
+			for (int i = 0; i < (int)meshes.size(); i++)
+			{
+				MatrixPalette::SortVerticesByInfluences(&meshes[i], maxInfluences);
+				MatrixPalette::BuildInfluences(&meshes[i], maxInfluences);
+			}
+
+			BuildSkinningChunks();
+			SetDetailLevel(0);
+		}
+
+		Bound bindBound;
+		bool hasBound = false;
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			for (int j = 0; j < (int)meshes[i].vertices.size(); j++)
+			{
+				Bound vertexBound;
+				vertexBound.min = vertexBound.max = meshes[i].vertices[j].position;
+				bindBound = hasBound ? MergeBounds(bindBound, vertexBound) : vertexBound;
+				hasBound = true;
+			}
+		}
+
+		detailCenter = !hasBound ? XMFLOAT3(0, 0, 0) : XMFLOAT3((bindBound.min.x + bindBound.max.x) * 0.5f,
+			(bindBound.min.y + bindBound.max.y) * 0.5f, (bindBound.min.z + bindBound.max.z) * 0.5f);
+	}
+
+	int GetNumDetailLevels() const { return detailLevels.empty() ? 1 : (int)detailLevels.size(); }
+	int GetDetailLevel() const { return detailLevel; }
+
+	// Cambia las mallas que se animan y dibujan; no debe llamarse mientras el modelo se actualiza
+	void SetDetailLevel(int level)
+	{
+		if (level >= GetNumDetailLevels())
+			level = GetNumDetailLevels() - 1;
+		if (level < 0)
+			level = 0;
+		if (level == detailLevel)
+			return;
+
+		meshes.swap(detailLevels[detailLevel].meshes);
+		skinningChunks.swap(detailLevels[detailLevel].skinningChunks);
+		meshes.swap(detailLevels[level].meshes);
+		skinningChunks.swap(detailLevels[level].skinningChunks);
+		detailLevel = level;
+	}
+
+	// level se limita a [0, GetNumDetailLevels() - 1], igual que en SetDetailLevel
+	DetailLevelStats GetDetailLevelStats(int level) const
+	{
+		if (level >= GetNumDetailLevels())
+			level = GetNumDetailLevels() - 1;
+		if (level < 0)
+			level = 0;
+
+		return detailLevels.empty() ? CountDetailLevel(meshes, 0) : detailLevels[level].stats;
+	}
+
+	/**
+	*	Activa el nivel mas simple cuyo error, escalado por la matriz world y
+	*	visto desde viewPosition, abarca a lo mas GetDetailTolerance()
+	*	radianes. La distancia se mide al centro de la malla en bind pose.
+	*	Update lo llama con la posicion de la camara; con UpdateModels hay
+	*	que llamarlo antes para cada modelo.
+	**/
+	int SelectDetailLevel(const XMFLOAT3 &viewPosition)
+	{
+		if (detailLevels.empty())
+			return 0;
+
+		XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&detailCenter), world);
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&viewPosition) - center));
+		float scale = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			float axisScale = XMVectorGetX(XMVector3Length(world.r[i]));
+			scale = axisScale > scale ? axisScale : scale;
+		}
+
+		int level = 0;
+
+		while (level + 1 < (int)detailLevels.size() && detailLevels[level + 1].stats.error * scale <= detailTolerance * distance)
+			level++;
+
+		SetDetailLevel(level);
+		return level;
+	}
+
+	float GetDetailTolerance() const { return detailTolerance; }
+	void SetDetailTolerance(float detailTolerance) { this->detailTolerance = detailTolerance; }
+
+	// Influencias por vertice que usa la paleta, de MD5_LOAD_MAX_INFLUENCES; el skinning por pesos usa todos los pesos MD5
+	int GetMaxInfluences() const { return maxInfluences; }
+
+	/**
+	*	Cuanto se mueven los vertices de la paleta por recortar sus
+	*	influencias a GetMaxInfluences(), contra el skinning con todos los
+	*	pesos MD5, en todos los frames del clip. Recorre el clip completo,
+	*	asi que es para elegir el limite de cada asset, no para cada frame.
+	**/
+	InfluencePruningStats MeasureInfluencePruning()
+	{
+		InfluencePruningStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+		stats.maxInfluences = maxInfluences;
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			stats.numVertices += meshes[i].vertices.size();
+			stats.numPrunedVertices += meshes[i].influences.numPrunedVertices;
+		}
+
+		PoseBuffer pose;
+		pose.Allocate(1, animation->GetNumJoints());
+
+		MatrixPalette framePalette = palette;
+		vector<Vertex> pruned, exact;
+		double totalDisplacement = 0;
+
+		for (int frame = 0; frame < animation->GetNumFrames(); frame++)
+		{
+			SampleFrame(frame, &pose);
+
+			if (!framePalette.ComputePalette(pose))
+				break;
+
+			for (int i = 0; i < (int)meshes.size(); i++)
+			{
+				int numVertices = meshes[i].vertices.size();
+				if (numVertices == 0)
+					continue;
+
+				pruned.resize(numVertices);
+				exact.resize(numVertices);
+				framePalette.SkinVertices(meshes[i].influences, &pruned[0]);
+				SkinMeshWithWeights(&meshes[i], pose, 0, numVertices, &exact[0]);
+
+				for (int j = 0; j < numVertices; j++)
+				{
+					float dx = pruned[j].position.x - exact[j].position.x;
+					float dy = pruned[j].position.y - exact[j].position.y;
+					float dz = pruned[j].position.z - exact[j].position.z;
+					float displacement = sqrtf(dx * dx + dy * dy + dz * dz);
+
+					totalDisplacement += displacement;
+					stats.maxDisplacement = displacement > stats.maxDisplacement ? displacement : stats.maxDisplacement;
+				}
+			}
+
+			stats.numFrames++;
+		}
+
+		if (stats.numFrames > 0 && stats.numVertices > 0)
+			stats.averageDisplacement = (float)(totalDisplacement / ((double)stats.numFrames * stats.numVertices));
+
+		return stats;
+	}
+
+	// NULL regresa al destino por defecto: el vertex buffer con contexto o meshes[i].vertices sin el
+	SkinningSink* GetOutputSink() const { return outputSink; }
+	void SetOutputSink(SkinningSink *outputSink)
+	{
+		if (outputSink == NULL && deviceContext != NULL)
+			outputSink = &deviceSink;
+
+		this->outputSink = outputSink;
+	}
+
+	/**
+	*	Con VERTEX_OUTPUT_QUANTIZED el destino recibe QuantizedVertex (sin
+	*	destino, quedan en meshes[i].quantizedVertices). La salida en float
+	*	se arma en un buffer del modelo, asi que meshes[i].vertices se queda
+	*	en bind pose. La primera vez se calculan las cajas de todos los
+	*	frames del clip.
+	*	Con VERTEX_OUTPUT_TANGENT_FRAME el destino recibe TangentFrameVertex
+	*	(sin destino, en meshes[i].tangentFrameVertices) y las mallas con
+	*	mapa _local se dibujan con PS_Main_NormalMap.
+	**/
+	VertexOutputFormat GetOutputFormat() const { return outputFormat; }
+	void SetOutputFormat(VertexOutputFormat outputFormat)
+	{
+		if (outputFormat == VERTEX_OUTPUT_QUANTIZED && frameBounds.empty())
+			ComputeFrameBounds();
+
+		this->outputFormat = outputFormat;
+	}
+
+	// Caja con la que se cuantizo el ultimo frame
+	const QuantizationBounds& GetQuantizationBounds() const { return quantizationBounds; }
+
+	/**
+	*	Con una animacion horneada cada actualizacion solo avanza la
+	*	reproduccion e interpola los vertices de los dos frames horneados
+	*	que la rodean: no se muestrea el clip ni se calcula paleta. El
+	*	horneado no guarda marcos tangentes, asi que con
+	*	VERTEX_OUTPUT_TANGENT_FRAME se sigue haciendo el skinning en vivo.
+	*	Falla (y deja la reproduccion en vivo) si el horneado no es de esta
+	*	malla con este orden de vertices; NULL la desactiva. El horneado es
+	*	de la malla completa: los demas niveles de detalle se transforman
+	*	en vivo, que con menos vertices ya cuesta poco.
+	**/
+	const BakedAnimation* GetBakedAnimation() const { return bakedAnimation; }
+	bool SetBakedAnimation(const BakedAnimation *bakedAnimation)
+	{
+		this->bakedAnimation = NULL;
+
+		if (bakedAnimation == NULL)
+			return true;
+
+		const vector<Mesh> &fullMeshes = GetLevelMeshes(0);
+
+		if (!bakedAnimation->IsOpen() ||
+			bakedAnimation->GetNumMeshes() != (int)fullMeshes.size() ||
+			bakedAnimation->GetVertexOrderHash() != GetVertexOrderHash())
+			return false;
+
+		for (int i = 0; i < (int)fullMeshes.size(); i++)
+		{
+			if (bakedAnimation->GetNumVertices(i) != (int)fullMeshes[i].vertices.size())
+				return false;
+		}
+
+		this->bakedAnimation = bakedAnimation;
+		return true;
+	}
+
+	/**
+	*	Con un cache de skinning las instancias cuyo tiempo cae en el mismo
+	*	intervalo del cache copian un solo resultado, transformado en el
+	*	inicio del intervalo, en lugar de repetir el skinning; en un fallo
+	*	esta instancia lo transforma y lo agrega. Los modelos comparten
+	*	entradas si vienen del mismo archivo con los mismos flags de orden
+	*	e influencias y usan el mismo clip y metodo. Con un acierto no se
+	*	muestrea la pose de GetPlayback(). Cada nivel de detalle tiene sus
+	*	propias entradas. La animacion horneada y la salida
+	*	VERTEX_OUTPUT_TANGENT_FRAME no usan el cache. NULL lo desactiva.
+	**/
+	SkinningCache* GetSkinningCache() const { return skinningCache; }
+	void SetSkinningCache(SkinningCache *skinningCache)
+	{
+		this->skinningCache = skinningCache;
+
+		unsigned long long modelParts[3] =
+		{
+			HashBytes(filename.c_str(), filename.size()),
+			GetVertexOrderHash(),
+			(unsigned long long)maxInfluences
+		};
+		skinningCacheModel = HashBytes((const char*)modelParts, sizeof(modelParts));
+	}
+
+	/**
+	*	Abre el .md5bake de este modelo en bakedAnimation y lo activa. Si no
+	*	existe o ya no corresponde a los textos, al orden de vertices o a
+	*	sampleRate, se hornea de nuevo primero. Cada combinacion de flags
+	*	que cambie el orden de los vertices necesita su propio horneado,
+	*	asi que todas las instancias deben cargarse igual.
+	**/
+	bool LoadBakedAnimation(BakedAnimation *bakedAnimation, float sampleRate)
+	{
+		string bakePath = filename + ".md5bake";
+		string meshPath = filename + ".md5mesh";
+		string animPath = filename + ".md5anim";
+		unsigned long long vertexOrderHash = GetVertexOrderHash();
+
+		if (!bakedAnimation->Open(bakePath, meshPath, animPath, vertexOrderHash, sampleRate, verifySource) &&
+			!(BakeAnimation(bakePath, sampleRate) && bakedAnimation->Open(bakePath, meshPath, animPath, vertexOrderHash, sampleRate, verifySource)))
+			return false;
+
+		return SetBakedAnimation(bakedAnimation);
+	}
+
+	/**
+	*	Hornea el clip completo en bakePath: ceil(duracion * sampleRate)
+	*	frames a intervalos iguales (el ultimo se interpola hacia el
+	*	primero, como en el clip), transformados con todos los pesos MD5 y
+	*	cuantizados contra la caja de todas las mallas en ese frame. Siempre
+	*	hornea la malla completa.
+	**/
+	bool BakeAnimation(string bakePath, float sampleRate)
+	{
+		MD5SourceStamp meshSource, animSource;
+		float duration = animation->GetTotalAnimationTime();
+
+		if (animation->GetNumFrames() == 0 || duration <= 0 || sampleRate <= 0 ||
+			!ComputeSourceStamp(filename + ".md5mesh", &meshSource) ||
+			!ComputeSourceStamp(filename + ".md5anim", &animSource))
+			return false;
+
+		int numFrames = (int)ceilf(duration * sampleRate);
+		if (numFrames < 1)
+			numFrames = 1;
+
+		int activeLevel = detailLevel;
+		SetDetailLevel(0);
+
+		PoseBuffer pose;
+		pose.Allocate(1, animation->GetNumJoints());
+
+		vector<vector<Vertex> > skinnedVertices(meshes.size());
+		vector<vector<QuantizedVertex> > bakedVertices(meshes.size());
+		vector<QuantizationBounds> bakedBounds(numFrames);
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			skinnedVertices[i].resize(meshes[i].vertices.size());
+			bakedVertices[i].resize(meshes[i].vertices.size() * numFrames);
+		}
+
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			animation->SamplePose(frame * duration / numFrames, &pose);
+
+			Bound frameBound;
+			bool hasBound = false;
+
+			for (int i = 0; i < (int)meshes.size(); i++)
+			{
+				if (skinnedVertices[i].empty())
+					continue;
+
+				SkinMeshWithWeights(&meshes[i], pose, 0, skinnedVertices[i].size(), &skinnedVertices[i][0]);
+
+				for (int j = 0; j < (int)skinnedVertices[i].size(); j++)
+				{
+					Bound vertexBound;
+					vertexBound.min = vertexBound.max = skinnedVertices[i][j].position;
+					frameBound = hasBound ? MergeBounds(frameBound, vertexBound) : vertexBound;
+					hasBound = true;
+				}
+			}
+
+			if (!hasBound)
+				ZeroMemory(&frameBound, sizeof(Bound));
+
+			bakedBounds[frame] = MakeQuantizationBounds(frameBound);
+
+			for (int i = 0; i < (int)meshes.size(); i++)
+			{
+				int numVertices = skinnedVertices[i].size();
+
+				if (numVertices > 0)
+					EncodeVertices(&skinnedVertices[i][0], numVertices, bakedBounds[frame], &bakedVertices[i][frame * numVertices]);
+			}
+		}
+
+		MD5BinaryWriter writer;
+		MD5BakeBinaryHeader header;
+		ZeroMemory(&header, sizeof(header));
+
+		int headerOffset = writer.Append(&header, sizeof(header));
+
+		vector<MD5BakeBinaryMesh> binaryMeshes(meshes.size());
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			binaryMeshes[i].numVertices = meshes[i].vertices.size();
+			binaryMeshes[i].framesOffset = writer.Append(bakedVertices[i].data(), sizeof(QuantizedVertex) * bakedVertices[i].size());
+		}
+
+		memcpy(header.common.magic, "MD5B", 4);
+		header.common.version = MD5BAKE_BINARY_VERSION;
+		header.common.source = animSource;
+		header.meshSource = meshSource;
+		header.vertexOrderHash = GetVertexOrderHash();
+		header.sampleRate = sampleRate;
+		header.duration = duration;
+		header.numFrames = numFrames;
+		header.numMeshes = meshes.size();
+		header.frameBoundsOffset = writer.Append(bakedBounds.data(), sizeof(QuantizationBounds) * bakedBounds.size());
+		header.meshesOffset = writer.Append(binaryMeshes.data(), sizeof(MD5BakeBinaryMesh) * binaryMeshes.size());
+		header.vertexSize = sizeof(QuantizedVertex);
+		header.common.fileSize = writer.GetSize();
+		writer.Patch(headerOffset, &header, sizeof(header));
+		SetDetailLevel(activeLevel);
+
+		return writer.Save(bakePath);
+	}
+
 	void Draw()
 	{
-		deviceContext->IASetInputLayout( this->inputLayout );
-		deviceContext->VSSetShader( this->vertexShader, NULL, 0 );
-		deviceContext->PSSetShader( this->pixelShader, NULL, 0 );
+		bool isQuantized = outputFormat == VERTEX_OUTPUT_QUANTIZED;
+		bool isTangentFrame = outputFormat == VERTEX_OUTPUT_TANGENT_FRAME;
+
+		if (isTangentFrame)
+		{
+			deviceContext->IASetInputLayout( this->tangentFrameInputLayout );
+			deviceContext->VSSetShader( this->tangentFrameVertexShader, NULL, 0 );
+		}
+		else
+		{
+			deviceContext->IASetInputLayout( isQuantized ? this->quantizedInputLayout : this->inputLayout );
+			deviceContext->VSSetShader( isQuantized ? this->quantizedVertexShader : this->vertexShader, NULL, 0 );
+		}
+
 		deviceContext->UpdateSubresource( this->constantBuffer, 0, 0, &this->matrixBuffer, sizeof(MatrixBuffer), 0 );
 		deviceContext->VSSetConstantBuffers( 0, 1, &this->constantBuffer );
 		deviceContext->PSSetSamplers( 0, 1, &this->colorMapSampler );
 
-		UINT uiStride = sizeof (Vertex);
-		UINT uiOffset = 0;
+		if (isQuantized)
+		{
+			deviceContext->UpdateSubresource( this->quantizationConstantBuffer, 0, 0, &this->quantizationBounds, sizeof(QuantizationBounds), 0 );
+			deviceContext->VSSetConstantBuffers( 1, 1, &this->quantizationConstantBuffer );
+		}
+
+		UINT uiStrides[] = { isQuantized ? sizeof (QuantizedVertex) : (isTangentFrame ? sizeof (TangentFrameVertex) : sizeof (Vertex)), sizeof (StaticVertex) };
+		UINT uiOffsets[] = { 0, 0 };
 
 		for (int i = 0; i < numMeshes; i++)
 		{
 			Mesh *currentMesh = &meshes[i];
 			
+			ID3D11Buffer *vertexBuffers[] = { currentMesh->vertexBuffer, currentMesh->staticVertexBuffer };
+
+			// Sin mapa _local la malla se ilumina con la normal del marco
+			bool useNormalMap = isTangentFrame && currentMesh->normalMap != NULL;
+
+			deviceContext->PSSetShader( useNormalMap ? this->normalMapPixelShader : this->pixelShader, NULL, 0 );
 			deviceContext->PSSetShaderResources( 0, 1, &currentMesh->colorMap );
-			deviceContext->IASetVertexBuffers( 0, 1,  &currentMesh->vertexBuffer, &uiStride, &uiOffset );
-			deviceContext->IASetIndexBuffer( currentMesh->indexBuffer, DXGI_FORMAT_R32_UINT, 0 );
+
+			if (useNormalMap)
+				deviceContext->PSSetShaderResources( 1, 1, &currentMesh->normalMap );
+
+			deviceContext->IASetVertexBuffers( 0, 2, vertexBuffers, uiStrides, uiOffsets );
+			deviceContext->IASetIndexBuffer( currentMesh->indexBuffer, currentMesh->indexFormat, 0 );
 			deviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );	
 			deviceContext->DrawIndexed( currentMesh->indices.size(), 0, 0 );
 		}
 	}
 
+	// Guarda la malla ya preprocesada (posiciones y normales de bind pose) como .md5meshbin
+	bool SaveCompiledMesh(string binaryPath, const MD5SourceStamp &source)
+	{
+		MD5BinaryWriter writer;
+		MD5MeshBinaryHeader header;
+		ZeroMemory(&header, sizeof(header));
+
+		int headerOffset = writer.Append(&header, sizeof(header));
+
+		vector<MD5MeshBinaryJoint> binaryJoints(numJoints);
+		for (int i = 0; i < numJoints; i++)
+		{
+			binaryJoints[i].nameOffset = writer.AppendString(joints[i].name);
+			binaryJoints[i].parent = joints[i].parent;
+			binaryJoints[i].position = joints[i].position;
+			binaryJoints[i].orientation = joints[i].orientation;
+		}
+
+		vector<MD5MeshBinaryMesh> binaryMeshes(numMeshes);
+		for (int i = 0; i < numMeshes; i++)
+		{
+			Mesh *currentMesh = &meshes[i];
+			MD5MeshBinaryMesh *binaryMesh = &binaryMeshes[i];
+
+			binaryMesh->shaderOffset = writer.AppendString(currentMesh->shader);
+			binaryMesh->numVertices = currentMesh->vertices.size();
+			binaryMesh->numTriangles = currentMesh->triangles.size();
+			binaryMesh->numWeights = currentMesh->weights.size();
+			binaryMesh->verticesOffset = writer.Append(currentMesh->vertices.data(), sizeof(Vertex) * currentMesh->vertices.size());
+			binaryMesh->staticVerticesOffset = writer.Append(currentMesh->staticVertices.data(), sizeof(StaticVertex) * currentMesh->staticVertices.size());
+			binaryMesh->vertexInfoOffset = writer.Append(currentMesh->vertexInfo.data(), sizeof(VertexInfo) * currentMesh->vertexInfo.size());
+			binaryMesh->trianglesOffset = writer.Append(currentMesh->triangles.data(), sizeof(Triangle) * currentMesh->triangles.size());
+			binaryMesh->weightsOffset = writer.Append(currentMesh->weights.data(), sizeof(Weight) * currentMesh->weights.size());
+			binaryMesh->indicesOffset = writer.Append(currentMesh->indices.data(), sizeof(int) * currentMesh->indices.size());
+		}
+
+		memcpy(header.common.magic, "MD5M", 4);
+		header.common.version = MD5MESH_BINARY_VERSION;
+		header.common.source = source;
+		header.numJoints = numJoints;
+		header.numMeshes = numMeshes;
+		header.jointsOffset = writer.Append(binaryJoints.data(), sizeof(MD5MeshBinaryJoint) * binaryJoints.size());
+		header.meshesOffset = writer.Append(binaryMeshes.data(), sizeof(MD5MeshBinaryMesh) * binaryMeshes.size());
+		header.vertexSize = sizeof(Vertex);
+		header.staticVertexSize = sizeof(StaticVertex);
+		header.vertexInfoSize = sizeof(VertexInfo);
+		header.triangleSize = sizeof(Triangle);
+		header.weightSize = sizeof(Weight);
+		header.common.fileSize = writer.GetSize();
+		writer.Patch(headerOffset, &header, sizeof(header));
+
+		return writer.Save(binaryPath);
+	}
+
 #pragma endregion
 
 #pragma region Private methods
 
 private:
-	bool CreateDirectXResources(ID3D11Device *device)
+	// Pide al destino donde escribir cada malla; desde el hilo del contexto y antes del skinning
+	void BeginOutput()
+	{
+		outputVertices.resize(meshes.size());
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			Mesh *mesh = &meshes[i];
+
+			if (outputSink != NULL)
+				outputVertices[i] = outputSink->BeginMesh(mesh);
+			else if (mesh->vertices.empty())
+				outputVertices[i] = NULL;
+			else if (outputFormat == VERTEX_OUTPUT_QUANTIZED)
+			{
+				mesh->quantizedVertices.resize(mesh->vertices.size());
+				outputVertices[i] = &mesh->quantizedVertices[0];
+			}
+			else if (outputFormat == VERTEX_OUTPUT_TANGENT_FRAME)
+			{
+				mesh->tangentFrameVertices.resize(mesh->vertices.size());
+				outputVertices[i] = &mesh->tangentFrameVertices[0];
+			}
+			else
+				outputVertices[i] = &mesh->vertices[0];
+		}
+	}
+
+	void EndOutput()
+	{
+		for (int i = 0; i < (int)outputVertices.size(); i++)
+		{
+			if (outputSink != NULL && outputVertices[i] != NULL)
+				outputSink->EndMesh(&meshes[i]);
+		}
+
+		outputVertices.clear();
+	}
+
+	// Escribe en los destinos abiertos por BeginOutput; puede llamarse desde un hilo del pool
+	bool AnimateModel(float deltaTime, bool useWorkerPool)
+	{
+		if (animation->GetNumFrames() == 0)
+			return false;
+
+		playback.Advance(deltaTime, animation->GetTotalAnimationTime());
+
+		float time = playback.GetTime();
+		frameIsBaked = bakedAnimation != NULL && outputFormat != VERTEX_OUTPUT_TANGENT_FRAME && detailLevel == 0;
+		frameCacheEntry = NULL;
+		frameFillsCache = false;
+
+		// Con cache el frame se transforma en el inicio de su intervalo, lo calcule quien lo calcule
+		if (!frameIsBaked && skinningCache != NULL && outputFormat != VERTEX_OUTPUT_TANGENT_FRAME)
+		{
+			frameCacheKey.model = skinningCacheModel;
+			frameCacheKey.clip = animation->GetClipKey();
+			frameCacheKey.method = skinningMethod;
+			frameCacheKey.level = detailLevel;
+			frameCacheKey.bucket = skinningCache->GetBucket(time);
+			time = skinningCache->GetBucketTime(frameCacheKey.bucket);
+
+			frameCacheEntry = skinningCache->Acquire(frameCacheKey);
+			frameFillsCache = frameCacheEntry == NULL;
+		}
+
+		if (frameIsBaked)
+			bakedAnimation->GetFrames(time, &bakedFrames[0], &bakedFrames[1], &bakedInterpolation);
+		else if (frameCacheEntry == NULL)
+			animation->SamplePose(time, &playback.GetPose());
+
+		if (outputFormat == VERTEX_OUTPUT_QUANTIZED)
+		{
+			int frame0, frame1;
+			float interpolation;
+			animation->GetFrames(time, &frame0, &frame1, &interpolation);
+			quantizationBounds = MakeQuantizationBounds(MergeBounds(frameBounds[frame0], frameBounds[frame1]));
+		}
+
+		if (!skinningChunks.empty())
+		{
+			const SkinningChunk &lastChunk = skinningChunks.back();
+			int numVertices = lastChunk.meshOffset + meshes[lastChunk.mesh].vertices.size();
+
+			if (frameFillsCache)
+				frameCacheVertices.resize(numVertices);
+
+			if (outputFormat != VERTEX_OUTPUT_FLOAT)
+				frameVertices.resize(numVertices);
+		}
+
+		SkinMeshes(playback.GetPose(), useWorkerPool);
+
+		if (frameCacheEntry != NULL)
+			skinningCache->Release(frameCacheEntry);
+		else if (frameFillsCache)
+			skinningCache->Insert(frameCacheKey, &frameCacheVertices);
+
+		frameCacheEntry = NULL;
+		frameFillsCache = false;
+
+		return true;
+	}
+
+	void SkinMeshes(const PoseBuffer &pose, bool useWorkerPool)
+	{
+		frameSkinningMethod = SKINNING_WEIGHTS;
+
+		// El frame horneado o copiado del cache no necesita paleta: la pose ni siquiera se muestreo
+		bool needsPalette = !frameIsBaked && frameCacheEntry == NULL;
+
+		if (needsPalette && skinningMethod == SKINNING_MATRIX_PALETTE && palette.ComputePalette(pose))
+			frameSkinningMethod = SKINNING_MATRIX_PALETTE;
+		else if (needsPalette && skinningMethod == SKINNING_DUAL_QUATERNION && dualQuaternionPalette.ComputePalette(pose))
+			frameSkinningMethod = SKINNING_DUAL_QUATERNION;
+
+		// Los marcos tangentes siempre se giran con las rotaciones de la paleta de cuaterniones duales
+		frameRotations = NULL;
+
+		if (outputFormat == VERTEX_OUTPUT_TANGENT_FRAME &&
+			(frameSkinningMethod == SKINNING_DUAL_QUATERNION || dualQuaternionPalette.ComputePalette(pose)))
+			frameRotations = dualQuaternionPalette.GetDualQuaternions();
+
+		// Con un solo bloque no vale la pena despertar al pool
+		if (useWorkerPool && workerPool != NULL && skinningChunks.size() > 1)
+		{
+			SkinningTask skinningTask(this, &pose);
+			workerPool->Run(&skinningTask, skinningChunks.size());
+			return;
+		}
+
+		for (int i = 0; i < (int)skinningChunks.size(); i++)
+			SkinChunk(skinningChunks[i], pose);
+	}
+
+	void SkinChunk(const SkinningChunk &chunk, const PoseBuffer &pose)
+	{
+		Mesh *mesh = &meshes[chunk.mesh];
+		void *output = outputVertices[chunk.mesh];
+
+		// La entrada que se va a agregar al cache necesita todas las mallas, aunque esta no tenga destino
+		if (output == NULL && !frameFillsCache)
+			return;
+
+		// La salida cuantizada y la de marcos tangentes se transforman primero en float sobre
+		// frameVertices; el bloque sigue en cache cuando se codifica y meshes[i].vertices no se toca
+		bool isQuantized = outputFormat == VERTEX_OUTPUT_QUANTIZED;
+		bool isTangentFrame = outputFormat == VERTEX_OUTPUT_TANGENT_FRAME;
+		Vertex *vertices = isQuantized || isTangentFrame ? &frameVertices[chunk.meshOffset] : (Vertex*)output;
+
+		// Con cache los vertices vienen de la entrada o se transforman en la que se va a agregar,
+		// y despues se copian; el destino puede ser memoria que no conviene leer
+		const Vertex *skinned = vertices;
+
+		if (frameCacheEntry != NULL)
+			skinned = &frameCacheEntry->vertices[chunk.meshOffset];
+		else
+		{
+			Vertex *target = frameFillsCache ? &frameCacheVertices[chunk.meshOffset] : vertices;
+
+			if (frameIsBaked)
+				bakedAnimation->SampleVertices(chunk.mesh, bakedFrames[0], bakedFrames[1], bakedInterpolation, chunk.first, chunk.count, target);
+			else if (frameSkinningMethod == SKINNING_MATRIX_PALETTE)
+				palette.SkinVertexRange(mesh->influences, chunk.first, chunk.count, target, !isTangentFrame);
+			else if (frameSkinningMethod == SKINNING_DUAL_QUATERNION)
+				dualQuaternionPalette.SkinVertexRange(mesh->influences, chunk.first, chunk.count, target, !isTangentFrame);
+			else
+				SkinMeshWithWeights(mesh, pose, chunk.first, chunk.count, target, !isTangentFrame);
+
+			skinned = target;
+		}
+
+		if (output == NULL)
+			return;
+
+		if (isQuantized)
+			EncodeVertices(&skinned[chunk.first], chunk.count, quantizationBounds, (QuantizedVertex*)output + chunk.first);
+		else if (isTangentFrame)
+			SkinTangentFrameRange(dualQuaternionPalette.GetISA(), frameRotations, mesh->influences, chunk.first, chunk.count, skinned, (TangentFrameVertex*)output);
+		else if (skinned != vertices)
+			memcpy(&vertices[chunk.first], &skinned[chunk.first], sizeof(Vertex) * chunk.count);
+	}
+
+	// Sin withNormals no se giran las normales de los pesos y la normal de salida queda en cero
+	void SkinMeshWithWeights(Mesh *mesh, const PoseBuffer &pose, int first, int count, Vertex *output, bool withNormals = true)
+	{
+		const XMFLOAT4A *positions = pose.GetPositions(0);
+		const XMFLOAT4A *orientations = pose.GetOrientations(0);
+
+		for (int j = first; j < first + count; j++)
+		{
+			// Se acumula en locales y el Vertex se escribe una sola vez al final
+			const VertexInfo &currentVertex = mesh->vertexInfo[j];
+			XMFLOAT3 position(0, 0, 0);
+			XMFLOAT3 normal(0, 0, 0);
+
+			for (int k = 0; k < currentVertex.countWeight; k++)
+			{
+				const Weight &currentWeight = mesh->weights[currentVertex.startWeight + k];
+				const XMFLOAT4A &jointPosition = positions[currentWeight.joint];
+				const XMFLOAT4A &jointOrientation = orientations[currentWeight.joint];
+
+				XMVECTOR interpolatedJointOrientation = XMLoadFloat4A(&jointOrientation);
+				XMVECTOR currentWeightPosition = XMVectorSet(currentWeight.position.x,
+															 currentWeight.position.y,
+															 currentWeight.position.z,
+															 0);
+				XMVECTOR interpolatedJointConjugatedOrientation = XMVectorSet(-jointOrientation.x, 
+																			  -jointOrientation.y, 
+																			  -jointOrientation.z, 
+																			  jointOrientation.w);
+
+				XMFLOAT3 rotatedPoint;
+				XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(interpolatedJointOrientation, currentWeightPosition),
+					interpolatedJointConjugatedOrientation));
+
+				position.x += (jointPosition.x + rotatedPoint.x) * currentWeight.bias;
+				position.y += (jointPosition.y + rotatedPoint.y) * currentWeight.bias;
+				position.z += (jointPosition.z + rotatedPoint.z) * currentWeight.bias;
+
+				if (!withNormals)
+					continue;
+
+				XMVECTOR tempWeightNormal = XMVectorSet(currentWeight.normal.x, currentWeight.normal.y, currentWeight.normal.z, 0.0f);
+
+				// Rotate the normal
+				XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(interpolatedJointOrientation, tempWeightNormal), interpolatedJointConjugatedOrientation));
+
+				// Add to vertices normal and ake weight bias into account
+				normal.x -= rotatedPoint.x * currentWeight.bias;
+				normal.y -= rotatedPoint.y * currentWeight.bias;
+				normal.z -= rotatedPoint.z * currentWeight.bias;
+			}
+
+			Vertex skinnedVertex;
+			skinnedVertex.position = position;
+			skinnedVertex.normal = normal;
+			output[j] = skinnedVertex;
+		}
+	}
+
+	/**
+	*	Los arreglos se validan sobre el archivo mapeado y se copian a los
+	*	vectores de cada Mesh: despues de cargar, PrepareMatrixSkinning
+	*	reordena los vertices, BuildDetailLevels arma mallas nuevas y sin
+	*	destino el skinning escribe en meshes[i].vertices, asi que la malla
+	*	no puede quedarse apuntando al archivo de solo lectura. El benchmark
+	*	mesh_binary reporta lo que cuesta la copia. sourcePath vacio: no hay
+	*	texto con que comparar.
+	**/
+	bool LoadCompiledMesh(string binaryPath, string sourcePath)
+	{
+		MD5MappedFile binaryFile;
+
+		if (!binaryFile.Open(binaryPath))
+			return false;
+
+		const MD5MeshBinaryHeader *header = binaryFile.At<MD5MeshBinaryHeader>(0, 1);
+
+		if (header == NULL ||
+			memcmp(header->common.magic, "MD5M", 4) != 0 ||
+			header->common.version != MD5MESH_BINARY_VERSION ||
+			header->common.fileSize != (int)binaryFile.GetSize() ||
+			header->vertexSize != sizeof(Vertex) ||
+			header->staticVertexSize != sizeof(StaticVertex) ||
+			header->vertexInfoSize != sizeof(VertexInfo) ||
+			header->triangleSize != sizeof(Triangle) ||
+			header->weightSize != sizeof(Weight))
+			return false;
+
+		// Sin el texto de origen no hay contra que validar el sello; solo se revisan los rangos
+		if (!sourcePath.empty() && !IsSourceCurrent(header->common.source, sourcePath, verifySource))
+			return false;
+
+		const MD5MeshBinaryJoint *binaryJoints = binaryFile.At<MD5MeshBinaryJoint>(header->jointsOffset, header->numJoints);
+		const MD5MeshBinaryMesh *binaryMeshes = binaryFile.At<MD5MeshBinaryMesh>(header->meshesOffset, header->numMeshes);
+
+		if (binaryJoints == NULL || binaryMeshes == NULL)
+			return false;
+
+		vector<Joint> loadedJoints(header->numJoints);
+		for (int i = 0; i < header->numJoints; i++)
+		{
+			const char *name = binaryFile.StringAt(binaryJoints[i].nameOffset);
+			if (name == NULL)
+				return false;
+
+			if (binaryJoints[i].parent < -1 || binaryJoints[i].parent >= header->numJoints)
+				return false;
+
+			loadedJoints[i].name = name;
+			loadedJoints[i].parent = binaryJoints[i].parent;
+			loadedJoints[i].position = binaryJoints[i].position;
+			loadedJoints[i].orientation = binaryJoints[i].orientation;
+		}
+
+		vector<Mesh> loadedMeshes(header->numMeshes);
+		for (int i = 0; i < header->numMeshes; i++)
+		{
+			const MD5MeshBinaryMesh *binaryMesh = &binaryMeshes[i];
+			Mesh *currentMesh = &loadedMeshes[i];
+
+			const char *shader = binaryFile.StringAt(binaryMesh->shaderOffset);
+			const Vertex *vertices = binaryFile.At<Vertex>(binaryMesh->verticesOffset, binaryMesh->numVertices);
+			const StaticVertex *staticVertices = binaryFile.At<StaticVertex>(binaryMesh->staticVerticesOffset, binaryMesh->numVertices);
+			const VertexInfo *vertexInfo = binaryFile.At<VertexInfo>(binaryMesh->vertexInfoOffset, binaryMesh->numVertices);
+			const Triangle *triangles = binaryFile.At<Triangle>(binaryMesh->trianglesOffset, binaryMesh->numTriangles);
+			const Weight *weights = binaryFile.At<Weight>(binaryMesh->weightsOffset, binaryMesh->numWeights);
+			const int *indices = binaryFile.At<int>(binaryMesh->indicesOffset, binaryMesh->numTriangles * 3);
+
+			if (shader == NULL || vertices == NULL || staticVertices == NULL || vertexInfo == NULL ||
+				triangles == NULL || weights == NULL || indices == NULL)
+				return false;
+
+			currentMesh->shader = shader;
+			currentMesh->numVertices = binaryMesh->numVertices;
+			currentMesh->numTriangles = binaryMesh->numTriangles;
+			currentMesh->numWeights = binaryMesh->numWeights;
+			currentMesh->vertices.assign(vertices, vertices + binaryMesh->numVertices);
+			currentMesh->staticVertices.assign(staticVertices, staticVertices + binaryMesh->numVertices);
+			currentMesh->vertexInfo.assign(vertexInfo, vertexInfo + binaryMesh->numVertices);
+			currentMesh->triangles.assign(triangles, triangles + binaryMesh->numTriangles);
+			currentMesh->weights.assign(weights, weights + binaryMesh->numWeights);
+			currentMesh->indices.assign(indices, indices + binaryMesh->numTriangles * 3);
+
+			// Un binario viejo o danado no debe indexar fuera de los arreglos al hacer skinning
+			if (!HasValidRanges(*currentMesh, header->numJoints))
+				return false;
+		}
+
+		this->numJoints = header->numJoints;
+		this->numMeshes = header->numMeshes;
+		this->joints.swap(loadedJoints);
+		this->meshes.swap(loadedMeshes);
+
+		return true;
+	}
+
+	// Rangos de pesos, joints, triangulos e indices de una malla leida de un binario
+	static bool HasValidRanges(const Mesh &mesh, int numJoints)
+	{
+		for (int j = 0; j < (int)mesh.vertexInfo.size(); j++)
+		{
+			const VertexInfo &info = mesh.vertexInfo[j];
+
+			if (info.startWeight < 0 || info.countWeight < 0 || info.startWeight > mesh.numWeights - info.countWeight)
+				return false;
+		}
+
+		for (int j = 0; j < (int)mesh.weights.size(); j++)
+		{
+			if (mesh.weights[j].joint < 0 || mesh.weights[j].joint >= numJoints)
+				return false;
+		}
+
+		for (int j = 0; j < (int)mesh.triangles.size(); j++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				if (mesh.triangles[j].vertexIndices[k] < 0 || mesh.triangles[j].vertexIndices[k] >= mesh.numVertices)
+					return false;
+			}
+		}
+
+		for (int j = 0; j < (int)mesh.indices.size(); j++)
+		{
+			if (mesh.indices[j] < 0 || mesh.indices[j] >= mesh.numVertices)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Inversa de la bind pose e influencias por vertice; los vertices todavia estan en bind pose
+	void PrepareMatrixSkinning()
+	{
+		palette.ComputeInverseBindPose(joints);
+		dualQuaternionPalette.ComputeInverseBindPose(joints);
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			MatrixPalette::SortVerticesByInfluences(&meshes[i], maxInfluences);
+			MatrixPalette::BuildInfluences(&meshes[i], maxInfluences);
+		}
+
+		BuildSkinningChunks();
+	}
+
+	// Orden de los vertices por su indice en el .md5mesh; lo cambian la optimizacion y el orden por influencias
+	unsigned long long GetVertexOrderHash() const
+	{
+		const vector<Mesh> &fullMeshes = GetLevelMeshes(0);
+		vector<int> vertexOrder;
+
+		for (int i = 0; i < (int)fullMeshes.size(); i++)
+		{
+			vertexOrder.push_back(fullMeshes[i].vertexInfo.size());
+
+			for (int j = 0; j < (int)fullMeshes[i].vertexInfo.size(); j++)
+				vertexOrder.push_back(fullMeshes[i].vertexInfo[j].vertexIndex);
+		}
+
+		return HashBytes((const char*)vertexOrder.data(), sizeof(int) * vertexOrder.size());
+	}
+
+	// Mallas de un nivel de detalle, este activo o no
+	const vector<Mesh>& GetLevelMeshes(int level) const
+	{
+		return level == detailLevel ? meshes : detailLevels[level].meshes;
+	}
+
+	static DetailLevelStats CountDetailLevel(const vector<Mesh> &levelMeshes, float error)
+	{
+		DetailLevelStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+		stats.error = error;
+
+		for (int i = 0; i < (int)levelMeshes.size(); i++)
+		{
+			stats.numVertices += levelMeshes[i].vertices.size();
+			stats.numTriangles += levelMeshes[i].triangles.size();
+			stats.numWeights += levelMeshes[i].weights.size();
+		}
+
+		return stats;
+	}
+
+	// Un poco despues del frame para que el redondeo no lo confunda con el anterior
+	void SampleFrame(int frame, PoseBuffer *pose)
+	{
+		animation->SamplePose((frame + 0.001f) / animation->GetFrameRate(), pose);
+	}
+
+	/**
+	*	Caja de cada frame para la salida cuantizada. Se usan los bounds del
+	*	clip si de verdad contienen la malla en ese frame; si no (faltan, o el
+	*	exportador los escribio mal, como en bob_lamp_update) se usa la caja
+	*	de los vertices transformados con la paleta en ese frame. Se mide
+	*	la malla completa, que contiene a todos los niveles de detalle.
+	**/
+	void ComputeFrameBounds()
+	{
+		int numFrames = animation->GetNumFrames();
+		frameBounds.resize(numFrames);
+
+		int activeLevel = detailLevel;
+		SetDetailLevel(0);
+
+		PoseBuffer pose;
+		pose.Allocate(1, animation->GetNumJoints());
+
+		MatrixPalette framePalette = palette;
+		vector<Vertex> vertices;
+
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			SampleFrame(frame, &pose);
+
+			Bound clipBound;
+			bool hasClipBound = animation->GetFrameBound(frame, &clipBound);
+			bool hasMeshBound = false;
+			Bound meshBound;
+
+			if (framePalette.ComputePalette(pose))
+			{
+				for (int i = 0; i < (int)meshes.size(); i++)
+				{
+					vertices.resize(meshes[i].vertices.size());
+					framePalette.SkinVertices(meshes[i].influences, vertices.empty() ? NULL : &vertices[0]);
+
+					for (int j = 0; j < (int)vertices.size(); j++)
+					{
+						Bound vertexBound;
+						vertexBound.min = vertexBound.max = vertices[j].position;
+						meshBound = hasMeshBound ? MergeBounds(meshBound, vertexBound) : vertexBound;
+						hasMeshBound = true;
+					}
+				}
+			}
+
+			if (hasClipBound && (!hasMeshBound || ContainsBound(clipBound, meshBound)))
+				frameBounds[frame] = clipBound;
+			else if (hasMeshBound)
+				frameBounds[frame] = meshBound;
+			else
+				ZeroMemory(&frameBounds[frame], sizeof(Bound));
+		}
+
+		SetDetailLevel(activeLevel);
+	}
+
+	// Parte cada malla en bloques de SKINNING_CHUNK_VERTICES; el orden es fijo desde la carga
+	void BuildSkinningChunks()
+	{
+		skinningChunks.clear();
+		int meshOffset = 0;
+
+		for (int i = 0; i < (int)meshes.size(); i++)
+		{
+			int numVertices = meshes[i].vertices.size();
+
+			for (int first = 0; first < numVertices; first += SKINNING_CHUNK_VERTICES)
+			{
+				SkinningChunk chunk;
+				chunk.mesh = i;
+				chunk.first = first;
+				chunk.count = numVertices - first < SKINNING_CHUNK_VERTICES ? numVertices - first : SKINNING_CHUNK_VERTICES;
+				chunk.meshOffset = meshOffset;
+				skinningChunks.push_back(chunk);
+			}
+
+			meshOffset += numVertices;
+		}
+	}
+
+	// Orden de triangulos para la cache post-transform y de vertices (y sus pesos) para la lectura
+	void OptimizeMeshOrder()
 	{
 		for (int i = 0; i < numMeshes; i++)
 		{
-			Mesh *currentMesh = &meshes[i];
-			ComputeVerticesPositions(currentMesh);
-			ComputeNormals(currentMesh);
+			OptimizeTriangleOrder(&meshes[i]);
+			OptimizeVertexFetchOrder(&meshes[i]);
+		}
+	}
 
-			HRESULT result;
+	// Antes de ComputeBindPose: las normales de los vertices unidos promedian todos sus triangulos
+	void WeldDuplicateVertices()
+	{
+		for (int i = 0; i < numMeshes; i++)
+			WeldVertices(&meshes[i]);
+	}
+
+	void ComputeBindPose()
+	{
+		for (int i = 0; i < numMeshes; i++)
+		{
+			ComputeVerticesPositions(&meshes[i]);
+			ComputeNormals(&meshes[i]);
+			ComputeTangents(&meshes[i]);
+		}
+	}
+
+	// Index buffer y los dos vertex buffers de una malla
+	bool CreateMeshBuffers(ID3D11Device *device, Mesh *currentMesh)
+	{
+		HRESULT result;
+
+		// Creamos el index buffer; con menos de 65536 vertices basta con indices de 16 bits
+		vector<unsigned short> shortIndices;
+		bool useShortIndices = currentMesh->vertices.size() <= 65536;
+
+		if (useShortIndices)
+			shortIndices.assign(currentMesh->indices.begin(), currentMesh->indices.end());
+
+		currentMesh->indexFormat = useShortIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+		D3D11_BUFFER_DESC indexBufferDesc;
+		ZeroMemory( &indexBufferDesc, sizeof(indexBufferDesc) );
+
+		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		indexBufferDesc.ByteWidth = (useShortIndices ? sizeof(unsigned short) : sizeof(int)) * currentMesh->indices.size();
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexBufferDesc.CPUAccessFlags = 0;
+		indexBufferDesc.MiscFlags = 0;
+
+		D3D11_SUBRESOURCE_DATA iinitData;
+		iinitData.pSysMem = useShortIndices ? (const void*)shortIndices.data() : (const void*)currentMesh->indices.data();
+		result = device->CreateBuffer(&indexBufferDesc, &iinitData, &currentMesh->indexBuffer);
+
+		if ( FAILED(result) ) return false;
 
-			// Creamos el index buffer
-			D3D11_BUFFER_DESC indexBufferDesc;
-			ZeroMemory( &indexBufferDesc, sizeof(indexBufferDesc) );
+		//Creamos el vertex buffer
+		D3D11_BUFFER_DESC vertexBufferDesc;
+		ZeroMemory( &vertexBufferDesc, sizeof(vertexBufferDesc) );
 
-			indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-			indexBufferDesc.ByteWidth = sizeof(int) * currentMesh->numTriangles * 3;
-			indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-			indexBufferDesc.CPUAccessFlags = 0;
-			indexBufferDesc.MiscFlags = 0;
+		vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;							// We will be updating this buffer, so we must set as dynamic
+		vertexBufferDesc.ByteWidth = sizeof( Vertex ) * currentMesh->numVertices;
+		vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;				// Give CPU power to write to buffer
+		vertexBufferDesc.MiscFlags = 0;
 
-			D3D11_SUBRESOURCE_DATA iinitData;
-			iinitData.pSysMem = currentMesh->indices.data();
-			result = device->CreateBuffer(&indexBufferDesc, &iinitData, &currentMesh->indexBuffer);
+		D3D11_SUBRESOURCE_DATA vertexBufferData; 
+		ZeroMemory( &vertexBufferData, sizeof(vertexBufferData) );
+		vertexBufferData.pSysMem = currentMesh->vertices.data();
+		result = device->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &currentMesh->vertexBuffer);
 
-			if ( FAILED(result) ) return false;
+		if ( FAILED(result) ) return false;			
 
-			//Creamos el vertex buffer
-			D3D11_BUFFER_DESC vertexBufferDesc;
-			ZeroMemory( &vertexBufferDesc, sizeof(vertexBufferDesc) );
+		// Coordenadas de textura y tangentes: no cambian, se suben una sola vez
+		D3D11_BUFFER_DESC staticVertexBufferDesc;
+		ZeroMemory( &staticVertexBufferDesc, sizeof(staticVertexBufferDesc) );
 
-			vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;							// We will be updating this buffer, so we must set as dynamic
-			vertexBufferDesc.ByteWidth = sizeof( Vertex ) * currentMesh->numVertices;
-			vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-			vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;				// Give CPU power to write to buffer
-			vertexBufferDesc.MiscFlags = 0;
+		staticVertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		staticVertexBufferDesc.ByteWidth = sizeof( StaticVertex ) * currentMesh->numVertices;
+		staticVertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		staticVertexBufferDesc.CPUAccessFlags = 0;
+		staticVertexBufferDesc.MiscFlags = 0;
 
-			D3D11_SUBRESOURCE_DATA vertexBufferData; 
-			ZeroMemory( &vertexBufferData, sizeof(vertexBufferData) );
-			vertexBufferData.pSysMem = currentMesh->vertices.data();
-			result = device->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &currentMesh->vertexBuffer);
+		D3D11_SUBRESOURCE_DATA staticVertexBufferData;
+		ZeroMemory( &staticVertexBufferData, sizeof(staticVertexBufferData) );
+		staticVertexBufferData.pSysMem = currentMesh->staticVertices.data();
+		result = device->CreateBuffer( &staticVertexBufferDesc, &staticVertexBufferData, &currentMesh->staticVertexBuffer);
 
-			if ( FAILED(result) ) return false;			
+		if ( FAILED(result) ) return false;
+
+		return true;
+	}
+
+	bool CreateDirectXResources(ID3D11Device *device)
+	{
+		for (int i = 0; i < numMeshes; i++)
+		{
+			Mesh *currentMesh = &meshes[i];
+
+			if ( !CreateMeshBuffers(device, currentMesh) ) return false;
+
+			HRESULT result;
 
 			string resourcePath = "C:\\Model\\" + currentMesh->shader;
 			std::wstring stemp = std::wstring(resourcePath.begin(), resourcePath.end());
@@ -259,6 +1663,35 @@ private:
 			result = D3DX11CreateShaderResourceViewFromFile(device, sw, 0, 0, &currentMesh->colorMap, 0);
 
 			if( FAILED(result) ) return false;
+
+			// El mapa de normales es opcional: "<textura>_local" junto a la textura de color
+			size_t extension = resourcePath.find_last_of('.');
+			size_t separator = resourcePath.find_last_of('\\');
+			if (extension == string::npos || (separator != string::npos && extension < separator))
+				extension = resourcePath.size();
+
+			string normalMapPath = resourcePath.substr(0, extension) + "_local" + resourcePath.substr(extension);
+			std::wstring normalMapPathW = std::wstring(normalMapPath.begin(), normalMapPath.end());
+
+			if ( FAILED(D3DX11CreateShaderResourceViewFromFile(device, normalMapPathW.c_str(), 0, 0, &currentMesh->normalMap, 0)) )
+				currentMesh->normalMap = NULL;
+		}
+
+		// Los otros niveles de detalle solo necesitan sus buffers; las texturas son las mismas
+		for (int level = 0; level < (int)detailLevels.size(); level++)
+		{
+			if (level == detailLevel)
+				continue;
+
+			for (int i = 0; i < (int)detailLevels[level].meshes.size(); i++)
+			{
+				Mesh *levelMesh = &detailLevels[level].meshes[i];
+
+				if ( !CreateMeshBuffers(device, levelMesh) ) return false;
+
+				levelMesh->colorMap = meshes[i].colorMap;
+				levelMesh->normalMap = meshes[i].normalMap;
+			}
 		}
 
 		D3D11_BUFFER_DESC d3dBufferDescriptor;
@@ -273,6 +1706,12 @@ private:
 
 		if( FAILED(result) ) return false;
 
+		// Caja de cuantizacion del frame para VS_Main_Quantized
+		d3dBufferDescriptor.ByteWidth = sizeof(QuantizationBounds);
+		result = device->CreateBuffer( &d3dBufferDescriptor, NULL, &this->quantizationConstantBuffer );
+
+		if( FAILED(result) ) return false;
+
 		D3D11_SAMPLER_DESC colorMapDesc;
 		ZeroMemory( &colorMapDesc, sizeof( colorMapDesc ) );
 		colorMapDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -294,14 +1733,15 @@ private:
 		for (int j = 0; j < currentMesh->numVertices; j++)
 		{
 			Vertex *currentVertex = &currentMesh->vertices[j];
+			VertexInfo *currentInfo = &currentMesh->vertexInfo[j];
 			currentVertex->position = XMFLOAT3(0, 0, 0);
 			currentVertex->normal	= XMFLOAT3(0, 0, 0);
-			currentVertex->tangent	= XMFLOAT3(0, 0, 0);
-			currentVertex->timesUsed = 0;
+			currentMesh->staticVertices[j].tangent = XMFLOAT4(0, 0, 0, 1);
+			currentInfo->timesUsed = 0;
 
-			for (int k = 0; k < currentVertex->countWeight; k++)
+			for (int k = 0; k < currentInfo->countWeight; k++)
 			{
-				Weight *currentWeight = &currentMesh->weights[currentVertex->startWeight + k];
+				Weight *currentWeight = &currentMesh->weights[currentInfo->startWeight + k];
 				Joint *currentJoint = &this->joints[currentWeight->joint];
 
 				XMVECTOR jointOrientation = XMVectorSet(
@@ -361,199 +1801,215 @@ private:
 			vertex2->normal = XMFLOAT3(vertex2->normal.x + normal.x, vertex2->normal.y + normal.y, vertex2->normal.z + normal.z);
 			vertex3->normal = XMFLOAT3(vertex3->normal.x + normal.x, vertex3->normal.y + normal.y, vertex3->normal.z + normal.z);
 
-			vertex1->timesUsed++;
-			vertex2->timesUsed++;
-			vertex3->timesUsed++;
+			currentMesh->vertexInfo[currentMesh->triangles[i].vertexIndices[0]].timesUsed++;
+			currentMesh->vertexInfo[currentMesh->triangles[i].vertexIndices[1]].timesUsed++;
+			currentMesh->vertexInfo[currentMesh->triangles[i].vertexIndices[2]].timesUsed++;
 		}
 
 		for (int i = 0; i < currentMesh->numVertices; i++)
 		{
 			Vertex *currentVertex = &currentMesh->vertices[i];
+			VertexInfo *currentInfo = &currentMesh->vertexInfo[i];
 			XMVECTOR normalSum = XMVectorSet(currentVertex->normal.x, currentVertex->normal.y, currentVertex->normal.z, 0);
-			normalSum = XMVector3Normalize(normalSum / currentVertex->timesUsed);
+			normalSum = XMVector3Normalize(normalSum / currentInfo->timesUsed);
 			currentVertex->normal.x = XMVectorGetX(normalSum);
 			currentVertex->normal.y = XMVectorGetY(normalSum);
 			currentVertex->normal.z = XMVectorGetZ(normalSum);
 
 			XMVECTOR normal = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);		// Clear normal
 
-			for ( int k = 0; k < currentVertex->countWeight; k++)				// Loop through each of the vertices weights
+			for ( int k = 0; k < currentInfo->countWeight; k++)				// Loop through each of the vertices weights
 			{
-				Joint tempJoint = joints[currentMesh->weights[currentVertex->startWeight + k].joint];	// Get the joints orientation
+				Joint tempJoint = joints[currentMesh->weights[currentInfo->startWeight + k].joint];	// Get the joints orientation
 				XMVECTOR jointOrientation = XMVectorSet(tempJoint.orientation.x, tempJoint.orientation.y, tempJoint.orientation.z, tempJoint.orientation.w);
 
 				// Calculate normal based off joints orientation (turn into joint space)
 				normal = XMQuaternionMultiply(XMQuaternionMultiply(XMQuaternionInverse(jointOrientation), normalSum), jointOrientation);		
 
-				XMStoreFloat3(&currentMesh->weights[currentVertex->startWeight + k].normal, XMVector3Normalize(normal));			// Store the normalized quaternion into our weights normal
+				XMStoreFloat3(&currentMesh->weights[currentInfo->startWeight + k].normal, XMVector3Normalize(normal));			// Store the normalized quaternion into our weights normal
 			}
 		}
 	}
 
-	void ReadNumJointsAndMeshes(ifstream &fileStream)
+	void ReadNumJointsAndMeshes(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
-		while (getline(fileStream, currentLine))
+		do
 		{
-			string *currentLineSplitted = new string[2];
-			SplitString(currentLine, 2, currentLineSplitted);
+			MD5Token token = tokenizer.NextToken();
 
-			if (currentLineSplitted[0] == "numJoints")
-				this->numJoints = atoi(currentLineSplitted[1].c_str());
-			else if (currentLineSplitted[0] == "numMeshes")
+			if (token.Equals("numJoints"))
+				this->numJoints = tokenizer.ReadInt();
+			else if (token.Equals("numMeshes"))
 			{
-				this->numMeshes = atoi(currentLineSplitted[1].c_str());
+				this->numMeshes = tokenizer.ReadInt();
+				tokenizer.NextLine();
 				return;
 			}
-		}
+		} while (tokenizer.NextLine());
 	}
 
-	void ReadJoints(ifstream &fileStream)
+	void ReadJoints(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
-		bool isJointsZone = false;
-		//this->joints = new Joint[this->numJoints];
-		int i = 0;
+		if (!tokenizer.SkipToLine("joints {"))
+			return;
+
+		joints.reserve(this->numJoints);
 
-		while (getline(fileStream, currentLine) && i < this->numJoints)
+		for (int i = 0; i < this->numJoints && !tokenizer.IsAtEnd(); i++)
 		{
-			if (isJointsZone)
-			{
-				Joint joint;
-				string *currentLineSplitted = new string[12];			
-				SplitString(currentLine, 12, currentLineSplitted);
-
-				joint.name = currentLineSplitted[0];
-				TrimString(joint.name, "\"");
-				joint.parent = atoi(currentLineSplitted[1].c_str());
-				joint.position.x = (float)atof(currentLineSplitted[3].c_str());
-				joint.position.z = (float)atof(currentLineSplitted[4].c_str());
-				joint.position.y = (float)atof(currentLineSplitted[5].c_str());
-				joint.orientation.x = (float)atof(currentLineSplitted[8].c_str());
-				joint.orientation.z = (float)atof(currentLineSplitted[9].c_str());
-				joint.orientation.y = (float)atof(currentLineSplitted[10].c_str());
-				joint.orientation.w = GetWComponent(joint.orientation);
-
-				joints.push_back(joint);
-
-				i++;
-			}
-			else
-			{
-				if (currentLine == "joints {")
-					isJointsZone = true;
-			}
+			Joint joint;
+			joint.name = tokenizer.ReadQuotedString();
+			joint.parent = tokenizer.ReadInt();
+			tokenizer.SkipTokens(1);
+			joint.position.x = tokenizer.ReadFloat();
+			joint.position.z = tokenizer.ReadFloat();
+			joint.position.y = tokenizer.ReadFloat();
+			tokenizer.SkipTokens(2);
+			joint.orientation.x = tokenizer.ReadFloat();
+			joint.orientation.z = tokenizer.ReadFloat();
+			joint.orientation.y = tokenizer.ReadFloat();
+			joint.orientation.w = GetWComponent(joint.orientation);
+
+			joints.push_back(joint);
+			tokenizer.NextLine();
 		}
 	}
 
-	void ReadMeshes(ifstream &fileStream)
+	void ReadMeshes(MD5Tokenizer &tokenizer)
 	{
-		string currentLine;
-		bool isMeshesZone = false;
-		//this->meshes = new Mesh[this->numMeshes];		
-		int i = 0;
-		
-		Mesh *mesh = new Mesh();
+		meshes.reserve(this->numMeshes);
 
-		while (getline(fileStream, currentLine) && i < this->numMeshes)
+		for (int i = 0; i < this->numMeshes && tokenizer.SkipToLine("mesh {"); i++)
 		{
-			if (isMeshesZone)
+			Mesh mesh = Mesh();
+
+			while (!tokenizer.IsAtEnd())
 			{
-				if (currentLine == "}")
+				MD5Token token = tokenizer.NextToken();
+
+				if (token.Equals("}"))
 				{
-					this->meshes.push_back(*mesh);
-					mesh = new Mesh();
-					isMeshesZone = false;
-					i++;
-					continue;
+					tokenizer.NextLine();
+					break;
 				}
-
-				string *currentLineSplitted = new string[2];
-				SplitString(currentLine, 2, currentLineSplitted);
-
-				if (currentLineSplitted[0] == "shader")
+				else if (token.Equals("shader"))
 				{
-					mesh->shader = currentLineSplitted[1];
-					TrimString(mesh->shader, "\"");
+					mesh.shader = tokenizer.ReadQuotedString();
 				}
-				else if (currentLineSplitted[0] == "numverts")
+				else if (token.Equals("numverts"))
 				{
-					mesh->numVertices = atoi(currentLineSplitted[1].c_str());
-					//mesh->vertices = new Vertex[this->meshes[i].numVertices];
+					mesh.numVertices = tokenizer.ReadInt();
+					mesh.vertices.resize(mesh.numVertices);
+					mesh.staticVertices.resize(mesh.numVertices);
+					mesh.vertexInfo.resize(mesh.numVertices);
 
-					for (int j = 0; j < mesh->numVertices; j++)
+					for (int j = 0; j < mesh.numVertices; j++)
 					{
-						Vertex vertex;
-						getline(fileStream, currentLine);
-						string *vertLineSplitted = new string[8];
-						SplitString(currentLine, 8, vertLineSplitted);
-
-						vertex.vertexIndex = atoi(vertLineSplitted[1].c_str());
-						vertex.uv.x = (float)atof(vertLineSplitted[3].c_str());
-						vertex.uv.y = (float)atof(vertLineSplitted[4].c_str());
-						vertex.startWeight = atoi(vertLineSplitted[6].c_str());
-						vertex.countWeight = atoi(vertLineSplitted[7].c_str());
-
-						mesh->vertices.push_back(vertex);
+						StaticVertex &vertex = mesh.staticVertices[j];
+						VertexInfo &info = mesh.vertexInfo[j];
+						tokenizer.NextLine();
+						tokenizer.SkipTokens(1);
+						info.vertexIndex = tokenizer.ReadInt();
+						tokenizer.SkipTokens(1);
+						vertex.uv.x = tokenizer.ReadFloat();
+						vertex.uv.y = tokenizer.ReadFloat();
+						tokenizer.SkipTokens(1);
+						info.startWeight = tokenizer.ReadInt();
+						info.countWeight = tokenizer.ReadInt();
 					}
 				}
-				else if (currentLineSplitted[0] == "numtris")
+				else if (token.Equals("numtris"))
 				{
-					mesh->numTriangles = atoi(currentLineSplitted[1].c_str());
-					//mesh->triangles = new Triangle[this->meshes[i].numTriangles];
-					//mesh->indices	  = new int[this->meshes[i].numTriangles * 3];
+					mesh.numTriangles = tokenizer.ReadInt();
+					mesh.triangles.reserve(mesh.numTriangles);
+					mesh.indices.reserve(mesh.numTriangles * 3);
 
-					for (int j = 0; j < mesh->numTriangles; j++)
+					for (int j = 0; j < mesh.numTriangles; j++)
 					{
 						Triangle triangle;
-						int indices[3];
-
-						getline(fileStream, currentLine);
-						string *triLineSplitted = new string[5];
-						SplitString(currentLine, 5, triLineSplitted);
-						
-						triangle.triangleIndex = atoi(triLineSplitted[1].c_str());
-						indices[0] = triangle.vertexIndices[0] = atoi(triLineSplitted[2].c_str());
-						indices[1] = triangle.vertexIndices[1] = atoi(triLineSplitted[3].c_str());
-						indices[2] = triangle.vertexIndices[2] = atoi(triLineSplitted[4].c_str());
-
-						mesh->triangles.push_back(triangle);
-						mesh->indices.push_back(indices[0]);
-						mesh->indices.push_back(indices[1]);
-						mesh->indices.push_back(indices[2]);
+						tokenizer.NextLine();
+						tokenizer.SkipTokens(1);
+						triangle.triangleIndex = tokenizer.ReadInt();
+						triangle.vertexIndices[0] = tokenizer.ReadInt();
+						triangle.vertexIndices[1] = tokenizer.ReadInt();
+						triangle.vertexIndices[2] = tokenizer.ReadInt();
+
+						mesh.triangles.push_back(triangle);
+						mesh.indices.push_back(triangle.vertexIndices[0]);
+						mesh.indices.push_back(triangle.vertexIndices[1]);
+						mesh.indices.push_back(triangle.vertexIndices[2]);
 					}
 				}
-				else if (currentLineSplitted[0] == "numweights")
+				else if (token.Equals("numweights"))
 				{
-					mesh->numWeights = atoi(currentLineSplitted[1].c_str());
-					//this->meshes[i].weights = new Weight[this->meshes[i].numWeights];
+					mesh.numWeights = tokenizer.ReadInt();
+					mesh.weights.reserve(mesh.numWeights);
 
-					for (int j = 0; j < mesh->numWeights; j++)
+					for (int j = 0; j < mesh.numWeights; j++)
 					{
 						Weight weight;
-						getline(fileStream, currentLine);
-						string *weightLineSplitted = new string[9];
-						SplitString(currentLine, 9, weightLineSplitted);
-
-						weight.weightIndex = atoi(weightLineSplitted[1].c_str());
-						weight.joint = atoi(weightLineSplitted[2].c_str());
-						weight.bias = (float)atof(weightLineSplitted[3].c_str());
-						weight.position.x = (float)atof(weightLineSplitted[5].c_str());
-						weight.position.z = (float)atof(weightLineSplitted[6].c_str());
-						weight.position.y = (float)atof(weightLineSplitted[7].c_str());
-
-						mesh->weights.push_back(weight);
+						tokenizer.NextLine();
+						tokenizer.SkipTokens(1);
+						weight.weightIndex = tokenizer.ReadInt();
+						weight.joint = tokenizer.ReadInt();
+						weight.bias = tokenizer.ReadFloat();
+						tokenizer.SkipTokens(1);
+						weight.position.x = tokenizer.ReadFloat();
+						weight.position.z = tokenizer.ReadFloat();
+						weight.position.y = tokenizer.ReadFloat();
+
+						mesh.weights.push_back(weight);
 					}
 				}
+
+				tokenizer.NextLine();
 			}
-			else
-			{
-				if (currentLine == "mesh {")
-					isMeshesZone = true;
-			}
+
+			this->meshes.push_back(mesh);
 		}
 	}
 
+#pragma endregion
+
+#pragma region Parallel tasks
+
+	class SkinningTask : public ParallelTask
+	{
+		MD5Mesh *model;
+		const PoseBuffer *pose;
+
+	public:
+		SkinningTask(MD5Mesh *model, const PoseBuffer *pose)
+		{
+			this->model = model;
+			this->pose = pose;
+		}
+
+		void Execute(int index)
+		{
+			model->SkinChunk(model->skinningChunks[index], *pose);
+		}
+	};
+
+	// Run no es reentrante, asi que cada modelo hace su skinning sin el pool
+	class ModelUpdateTask : public ParallelTask
+	{
+		MD5Mesh **models;
+		float deltaTime;
+
+	public:
+		ModelUpdateTask(MD5Mesh **models, float deltaTime)
+		{
+			this->models = models;
+			this->deltaTime = deltaTime;
+		}
+
+		void Execute(int index)
+		{
+			models[index]->AnimateModel(deltaTime, false);
+		}
+	};
+
 #pragma endregion
 };
 
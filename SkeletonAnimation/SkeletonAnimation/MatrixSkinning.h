@@ -0,0 +1,360 @@
+#ifndef _MATRIXSKINNING_H_INCLUDED
+#define _MATRIXSKINNING_H_INCLUDED
+
+#pragma region Includes
+
+#include <algorithm>
+#include <vector>
+#include <xnamath.h>
+#include "Structs.h"
+#include "Pose.h"
+#include "SkinningKernels.h"
+#include "TangentFrames.h"
+#include "MeshOptimization.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Skinning lineal por paleta de matrices. Cada frame convierte la pose
+*	en una matriz por joint ya multiplicada por la inversa de la bind pose,
+*	asi que un vertice solo mezcla sus matrices y transforma su posicion y
+*	normal de bind pose una vez, en lugar de rotar cada peso con dos
+*	productos de cuaterniones.
+*
+*	Las rotaciones siguen la misma convencion que el skinning por pesos
+*	(q^-1 * v * q), por lo que ambos caminos producen los mismos vertices
+*	salvo por redondeo cuando los pesos de cada vertice coinciden en la
+*	bind pose, como en cualquier malla exportada.
+*
+*	Los vertices se transforman con el kernel del mejor conjunto de
+*	instrucciones disponible (ver SkinningKernels.h); SetISA permite
+*	forzar uno menor para compararlos.
+**/
+class MatrixPalette
+{
+	vector<SkinMatrix> inverseBindPose;
+	vector<SkinMatrix> matrices;
+	SkinningISA isa;
+
+public:
+	MatrixPalette()
+	{
+		isa = GetSupportedSkinningISA();
+	}
+
+	SkinningISA GetISA() const { return isa; }
+
+	// Un conjunto que el CPU no soporta se reemplaza por el mejor disponible
+	void SetISA(SkinningISA isa)
+	{
+		this->isa = isa <= GetSupportedSkinningISA() ? isa : GetSupportedSkinningISA();
+	}
+
+	void ComputeInverseBindPose(const vector<Joint> &joints)
+	{
+		inverseBindPose.resize(joints.size());
+		matrices.resize(joints.size());
+
+		for (int i = 0; i < (int)joints.size(); i++)
+		{
+			SkinMatrix bindPose = MakeJointMatrix(joints[i].position.x, joints[i].position.y, joints[i].position.z,
+												  joints[i].orientation.x, joints[i].orientation.y, joints[i].orientation.z, joints[i].orientation.w);
+			inverseBindPose[i] = InvertRigid(bindPose);
+		}
+	}
+
+	// Regresa false si la pose no corresponde al esqueleto de la malla
+	bool ComputePalette(const PoseBuffer &pose)
+	{
+		if (pose.GetNumJoints() != (int)inverseBindPose.size())
+			return false;
+
+		const XMFLOAT4A *positions = pose.GetPositions(0);
+		const XMFLOAT4A *orientations = pose.GetOrientations(0);
+
+		for (int i = 0; i < (int)matrices.size(); i++)
+		{
+			SkinMatrix jointPose = MakeJointMatrix(positions[i].x, positions[i].y, positions[i].z,
+												   orientations[i].x, orientations[i].y, orientations[i].z, orientations[i].w);
+			matrices[i] = Multiply(jointPose, inverseBindPose[i]);
+		}
+
+		return true;
+	}
+
+	int GetNumJoints() const { return (int)matrices.size(); }
+	const SkinMatrix* GetMatrices() const { return matrices.empty() ? NULL : &matrices[0]; }
+
+	// Escribe en output todos los vertices de las streams
+	void SkinVertices(const InfluenceStreams &influences, Vertex *output) const
+	{
+		SkinVertexRange(influences, 0, influences.numVertices, output);
+	}
+
+	// first debe ser multiplo de SKINNING_STREAM_PADDING; sin withNormals las normales quedan en cero
+	void SkinVertexRange(const InfluenceStreams &influences, int first, int count, Vertex *output, bool withNormals = true) const
+	{
+		if (count <= 0 || matrices.empty())
+			return;
+
+		SkinVertexRuns(isa, &matrices[0], influences, first, count, output, withNormals);
+	}
+
+	/**
+	*	Reordena los vertices de la malla de menos a mas influencias (sin
+	*	cambiar el orden dentro de cada grupo, asi que se conserva el de
+	*	OptimizeVertexFetchOrder) con RemapVertices, para que BuildInfluences
+	*	deje pocos tramos y cada uno use el kernel de su numero de
+	*	influencias. Cuenta las influencias como las deja BuildInfluences con
+	*	el mismo maxInfluences. Si la malla ya esta ordenada no hace nada.
+	**/
+	static void SortVerticesByInfluences(Mesh *mesh, int maxInfluences = MAX_BONE_INFLUENCES)
+	{
+		if (maxInfluences < 1 || maxInfluences > MAX_BONE_INFLUENCES)
+			maxInfluences = MAX_BONE_INFLUENCES;
+
+		int numVertices = mesh->vertices.size();
+		vector<int> counts(numVertices);
+		vector<int> joints;
+		vector<float> weights;
+		bool isSorted = true;
+
+		for (int i = 0; i < numVertices; i++)
+		{
+			int numInfluences = GatherInfluences(*mesh, i, &joints, &weights);
+			counts[i] = numInfluences < maxInfluences ? numInfluences : maxInfluences;
+			isSorted = isSorted && (i == 0 || counts[i] >= counts[i - 1]);
+		}
+
+		if (isSorted)
+			return;
+
+		// Ordenamiento por conteo: bucketStart[n] es la primera posicion de los vertices con n influencias
+		int bucketStart[MAX_BONE_INFLUENCES + 2] = { 0 };
+		for (int i = 0; i < numVertices; i++)
+			bucketStart[counts[i] + 1]++;
+		for (int n = 1; n <= MAX_BONE_INFLUENCES + 1; n++)
+			bucketStart[n] += bucketStart[n - 1];
+
+		vector<int> newIndex(numVertices);
+		for (int i = 0; i < numVertices; i++)
+			newIndex[i] = bucketStart[counts[i]]++;
+
+		RemapVertices(mesh, newIndex);
+	}
+
+	/**
+	*	Convierte los pesos MD5 de la malla en influencias por vertice. Los
+	*	pesos del mismo joint se suman; si quedan mas de maxInfluences (a lo
+	*	mas MAX_BONE_INFLUENCES) se conservan los mas pesados y se
+	*	renormalizan para que sigan sumando lo mismo. Toma la posicion y
+	*	normal de mesh.vertices, asi que se llama con la malla en bind pose.
+	*	Tambien arma los tramos de InfluenceStreams::runs y los marcos
+	*	tangentes de bind pose a partir de staticVertices[i].tangent.
+	**/
+	static void BuildInfluences(Mesh *mesh, int maxInfluences = MAX_BONE_INFLUENCES)
+	{
+		if (maxInfluences < 1 || maxInfluences > MAX_BONE_INFLUENCES)
+			maxInfluences = MAX_BONE_INFLUENCES;
+
+		InfluenceStreams &streams = mesh->influences;
+		int numVertices = mesh->vertices.size();
+		int paddedVertices = (numVertices + SKINNING_STREAM_PADDING - 1) / SKINNING_STREAM_PADDING * SKINNING_STREAM_PADDING;
+
+		streams.numVertices = numVertices;
+		streams.numInfluences = 0;
+		streams.numPrunedVertices = 0;
+		streams.positionX.assign(paddedVertices, 0.0f);
+		streams.positionY.assign(paddedVertices, 0.0f);
+		streams.positionZ.assign(paddedVertices, 0.0f);
+		streams.normalX.assign(paddedVertices, 0.0f);
+		streams.normalY.assign(paddedVertices, 0.0f);
+		streams.normalZ.assign(paddedVertices, 0.0f);
+		streams.frameX.assign(paddedVertices, 0.0f);
+		streams.frameY.assign(paddedVertices, 0.0f);
+		streams.frameZ.assign(paddedVertices, 0.0f);
+		streams.frameW.assign(paddedVertices, 1.0f);
+
+		for (int k = 0; k < MAX_BONE_INFLUENCES; k++)
+		{
+			streams.joints[k].assign(paddedVertices, 0);
+			streams.weights[k].assign(paddedVertices, 0.0f);
+		}
+
+		vector<int> joints;
+		vector<float> weights;
+		vector<int> counts(numVertices);
+
+		for (int i = 0; i < numVertices; i++)
+		{
+			const Vertex &vertex = mesh->vertices[i];
+			GatherInfluences(*mesh, i, &joints, &weights);
+
+			int numInfluences = (int)joints.size() < maxInfluences ? joints.size() : maxInfluences;
+			float scale = 1.0f;
+
+			if ((int)joints.size() > maxInfluences)
+			{
+				float total = 0, kept = 0;
+				for (int k = 0; k < (int)weights.size(); k++)
+				{
+					total += weights[k];
+					if (k < maxInfluences)
+						kept += weights[k];
+				}
+
+				if (kept > 0)
+					scale = total / kept;
+
+				streams.numPrunedVertices++;
+			}
+
+			for (int k = 0; k < numInfluences; k++)
+			{
+				streams.joints[k][i] = joints[k];
+				streams.weights[k][i] = weights[k] * scale;
+			}
+
+			if (numInfluences > streams.numInfluences)
+				streams.numInfluences = numInfluences;
+
+			counts[i] = numInfluences;
+
+			// El skinning por pesos resta las normales rotadas, asi que la de bind pose se guarda invertida
+			streams.positionX[i] = vertex.position.x;
+			streams.positionY[i] = vertex.position.y;
+			streams.positionZ[i] = vertex.position.z;
+			streams.normalX[i] = -vertex.normal.x;
+			streams.normalY[i] = -vertex.normal.y;
+			streams.normalZ[i] = -vertex.normal.z;
+
+			XMFLOAT4 frame = MakeTangentFrame(XMFLOAT3(-vertex.normal.x, -vertex.normal.y, -vertex.normal.z), mesh->staticVertices[i].tangent);
+			streams.frameX[i] = frame.x;
+			streams.frameY[i] = frame.y;
+			streams.frameZ[i] = frame.z;
+			streams.frameW[i] = frame.w;
+		}
+
+		BuildInfluenceRuns(counts, &streams);
+	}
+
+private:
+	// Suma los pesos de la malla por joint y los ordena de mayor a menor; regresa cuantos joints distintos hay
+	static int GatherInfluences(const Mesh &mesh, int vertex, vector<int> *joints, vector<float> *weights)
+	{
+		const VertexInfo &info = mesh.vertexInfo[vertex];
+		joints->clear();
+		weights->clear();
+
+		for (int k = 0; k < info.countWeight; k++)
+		{
+			const Weight &weight = mesh.weights[info.startWeight + k];
+			int slot = 0;
+
+			while (slot < (int)joints->size() && (*joints)[slot] != weight.joint)
+				slot++;
+
+			if (slot == (int)joints->size())
+			{
+				joints->push_back(weight.joint);
+				weights->push_back(0.0f);
+			}
+
+			(*weights)[slot] += weight.bias;
+		}
+
+		// Ordenamiento por insercion de mayor a menor peso: casi nunca hay mas de 4
+		for (int a = 1; a < (int)weights->size(); a++)
+		{
+			for (int b = a; b > 0 && (*weights)[b] > (*weights)[b - 1]; b--)
+			{
+				swap((*weights)[b], (*weights)[b - 1]);
+				swap((*joints)[b], (*joints)[b - 1]);
+			}
+		}
+
+		return joints->size();
+	}
+
+	/**
+	*	Cada bloque de SKINNING_STREAM_PADDING vertices usa el mayor numero
+	*	de influencias de sus vertices (al menos 1; las ranuras sobrantes
+	*	tienen peso 0) y los bloques consecutivos con el mismo numero se
+	*	juntan en un tramo. Con la malla ordenada queda un tramo por numero
+	*	de influencias.
+	**/
+	static void BuildInfluenceRuns(const vector<int> &counts, InfluenceStreams *streams)
+	{
+		streams->runs.clear();
+
+		for (int first = 0; first < streams->numVertices; first += SKINNING_STREAM_PADDING)
+		{
+			int end = first + SKINNING_STREAM_PADDING < streams->numVertices ? first + SKINNING_STREAM_PADDING : streams->numVertices;
+			int numInfluences = 1;
+
+			for (int i = first; i < end; i++)
+				numInfluences = counts[i] > numInfluences ? counts[i] : numInfluences;
+
+			if (!streams->runs.empty() && streams->runs.back().numInfluences == numInfluences)
+				streams->runs.back().count += end - first;
+			else
+			{
+				InfluenceRun run;
+				run.first = first;
+				run.count = end - first;
+				run.numInfluences = numInfluences;
+				streams->runs.push_back(run);
+			}
+		}
+	}
+
+	// Matriz de la rotacion q^-1 * v * q seguida de la traslacion (x, y, z)
+	static SkinMatrix MakeJointMatrix(float x, float y, float z, float qx, float qy, float qz, float qw)
+	{
+		SkinMatrix matrix;
+
+		matrix.rows[0] = XMFLOAT4(1 - 2 * (qy * qy + qz * qz), 2 * (qx * qy + qw * qz), 2 * (qx * qz - qw * qy), x);
+		matrix.rows[1] = XMFLOAT4(2 * (qx * qy - qw * qz), 1 - 2 * (qx * qx + qz * qz), 2 * (qy * qz + qw * qx), y);
+		matrix.rows[2] = XMFLOAT4(2 * (qx * qz + qw * qy), 2 * (qy * qz - qw * qx), 1 - 2 * (qx * qx + qy * qy), z);
+
+		return matrix;
+	}
+
+	// Inversa de una transformacion rigida: rotacion transpuesta y traslacion -R^T * t
+	static SkinMatrix InvertRigid(const SkinMatrix &matrix)
+	{
+		const XMFLOAT4 *r = matrix.rows;
+		SkinMatrix inverse;
+
+		inverse.rows[0] = XMFLOAT4(r[0].x, r[1].x, r[2].x, -(r[0].x * r[0].w + r[1].x * r[1].w + r[2].x * r[2].w));
+		inverse.rows[1] = XMFLOAT4(r[0].y, r[1].y, r[2].y, -(r[0].y * r[0].w + r[1].y * r[1].w + r[2].y * r[2].w));
+		inverse.rows[2] = XMFLOAT4(r[0].z, r[1].z, r[2].z, -(r[0].z * r[0].w + r[1].z * r[1].w + r[2].z * r[2].w));
+
+		return inverse;
+	}
+
+	static SkinMatrix Multiply(const SkinMatrix &a, const SkinMatrix &b)
+	{
+		SkinMatrix result;
+
+		for (int r = 0; r < 3; r++)
+		{
+			const XMFLOAT4 &row = a.rows[r];
+
+			result.rows[r].x = row.x * b.rows[0].x + row.y * b.rows[1].x + row.z * b.rows[2].x;
+			result.rows[r].y = row.x * b.rows[0].y + row.y * b.rows[1].y + row.z * b.rows[2].y;
+			result.rows[r].z = row.x * b.rows[0].z + row.y * b.rows[1].z + row.z * b.rows[2].z;
+			result.rows[r].w = row.x * b.rows[0].w + row.y * b.rows[1].w + row.z * b.rows[2].w + row.w;
+		}
+
+		return result;
+	}
+};
+
+#endif
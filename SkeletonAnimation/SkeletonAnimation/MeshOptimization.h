@@ -0,0 +1,1107 @@
+#ifndef _MESHOPTIMIZATION_H_INCLUDED
+#define _MESHOPTIMIZATION_H_INCLUDED
+
+#pragma region Includes
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <queue>
+#include <set>
+#include <vector>
+#include "Structs.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+// Entradas de la cache LRU que modela el ordenamiento de triangulos
+#define VERTEX_CACHE_OPTIMIZE_SIZE	32
+
+// Linea de cache con la que se simula la lectura de vertices
+#define VERTEX_FETCH_LINE_BYTES		64
+
+#pragma region Cache simulation
+
+/**
+*	Cache post-transform FIFO de cacheSize vertices, como la de la mayoria
+*	del hardware: regresa cuantos vertices se transforman al dibujar los
+*	indices en orden. ACMR = fallas / triangulos (0.5 es el minimo en una
+*	malla grande) y ATVR = fallas / vertices usados (1.0 es el minimo).
+**/
+int SimulateVertexCache(const vector<int> &indices, int numVertices, int cacheSize)
+{
+	vector<int> timestamps(numVertices, -1);
+	int misses = 0;
+
+	// Un vertice sigue en la FIFO si entro hace menos de cacheSize fallas
+	for (int i = 0; i < (int)indices.size(); i++)
+	{
+		int vertex = indices[i];
+
+		if (timestamps[vertex] < 0 || misses - timestamps[vertex] >= cacheSize)
+		{
+			timestamps[vertex] = misses;
+			misses++;
+		}
+	}
+
+	return misses;
+}
+
+/**
+*	Bytes que se leen del vertex buffer al dibujar, con una cache FIFO de
+*	cacheBytes en lineas de VERTEX_FETCH_LINE_BYTES, divididos entre los
+*	bytes de los vertices usados: 1.0 quiere decir que cada linea se lee
+*	una sola vez.
+**/
+float SimulateVertexFetch(const vector<int> &indices, int numVertices, int vertexStride, int cacheBytes)
+{
+	int numLines = (numVertices * vertexStride + VERTEX_FETCH_LINE_BYTES - 1) / VERTEX_FETCH_LINE_BYTES;
+	int cacheLines = cacheBytes / VERTEX_FETCH_LINE_BYTES;
+	vector<int> timestamps(numLines, -1);
+	vector<bool> isUsed(numVertices, false);
+	int fetchedLines = 0, numUsed = 0;
+
+	for (int i = 0; i < (int)indices.size(); i++)
+	{
+		int vertex = indices[i];
+		int firstLine = vertex * vertexStride / VERTEX_FETCH_LINE_BYTES;
+		int lastLine = (vertex * vertexStride + vertexStride - 1) / VERTEX_FETCH_LINE_BYTES;
+
+		if (!isUsed[vertex])
+		{
+			isUsed[vertex] = true;
+			numUsed++;
+		}
+
+		for (int line = firstLine; line <= lastLine; line++)
+		{
+			if (timestamps[line] < 0 || fetchedLines - timestamps[line] >= cacheLines)
+			{
+				timestamps[line] = fetchedLines;
+				fetchedLines++;
+			}
+		}
+	}
+
+	return numUsed > 0 ? (float)fetchedLines * VERTEX_FETCH_LINE_BYTES / ((float)numUsed * vertexStride) : 0.0f;
+}
+
+#pragma endregion
+
+#pragma region Triangle order
+
+// Puntaje de un vertice segun su lugar en la cache LRU y cuantos triangulos le faltan (Forsyth)
+float GetVertexCacheScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	// Los tres del ultimo triangulo valen lo mismo para no favorecer un orden dentro de el
+	if (cachePosition >= 0 && cachePosition < 3)
+		score = 0.75f;
+	else if (cachePosition >= 3)
+		score = powf(1.0f - (cachePosition - 3) / (float)(VERTEX_CACHE_OPTIMIZE_SIZE - 3), 1.5f);
+
+	// Los vertices con pocos triangulos pendientes se terminan primero
+	return score + 2.0f / sqrtf((float)remainingTriangles);
+}
+
+/**
+*	Reordena los triangulos para la cache post-transform con el algoritmo
+*	de Tom Forsyth: despues de cada triangulo se escoge el de mayor puntaje
+*	entre los que tocan la cache simulada, y solo cuando ninguno queda se
+*	busca en toda la malla. Reescribe triangles e indices; los vertices no
+*	cambian de lugar ni de orden dentro de cada triangulo.
+**/
+void OptimizeTriangleOrder(Mesh *mesh)
+{
+	int numTriangles = mesh->triangles.size();
+	int numVertices = mesh->vertices.size();
+
+	if (numTriangles == 0)
+		return;
+
+	// Triangulos de cada vertice; los primeros remaining[v] son los que faltan
+	vector<int> firstTriangle(numVertices + 1, 0);
+	vector<int> remaining(numVertices, 0);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			remaining[mesh->triangles[i].vertexIndices[k]]++;
+	}
+
+	for (int v = 0; v < numVertices; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+
+	vector<int> vertexTriangles(firstTriangle[numVertices]);
+	vector<int> filled(numVertices, 0);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int vertex = mesh->triangles[i].vertexIndices[k];
+			vertexTriangles[firstTriangle[vertex] + filled[vertex]++] = i;
+		}
+	}
+
+	vector<int> cachePosition(numVertices, -1);
+	vector<float> vertexScores(numVertices);
+	vector<float> triangleScores(numTriangles, 0.0f);
+	vector<bool> isEmitted(numTriangles, false);
+
+	for (int v = 0; v < numVertices; v++)
+		vertexScores[v] = GetVertexCacheScore(-1, remaining[v]);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			triangleScores[i] += vertexScores[mesh->triangles[i].vertexIndices[k]];
+	}
+
+	vector<int> cache, newCache;
+	vector<Triangle> triangles;
+	triangles.reserve(numTriangles);
+
+	int bestTriangle = -1;
+
+	while ((int)triangles.size() < numTriangles)
+	{
+		if (bestTriangle < 0)
+		{
+			float bestScore = -1.0f;
+
+			for (int i = 0; i < numTriangles; i++)
+			{
+				if (!isEmitted[i] && triangleScores[i] > bestScore)
+				{
+					bestScore = triangleScores[i];
+					bestTriangle = i;
+				}
+			}
+		}
+
+		const Triangle &triangle = mesh->triangles[bestTriangle];
+		triangles.push_back(triangle);
+		isEmitted[bestTriangle] = true;
+
+		// Se quita el triangulo de los pendientes de sus vertices y estos pasan al frente de la cache
+		newCache.clear();
+
+		for (int k = 0; k < 3; k++)
+		{
+			int vertex = triangle.vertexIndices[k];
+			int *triangleList = &vertexTriangles[firstTriangle[vertex]];
+
+			for (int j = 0; j < remaining[vertex]; j++)
+			{
+				if (triangleList[j] == bestTriangle)
+				{
+					triangleList[j] = triangleList[remaining[vertex] - 1];
+					remaining[vertex]--;
+					break;
+				}
+			}
+
+			newCache.push_back(vertex);
+		}
+
+		for (int i = 0; i < (int)cache.size(); i++)
+		{
+			int vertex = cache[i];
+
+			if (vertex != triangle.vertexIndices[0] && vertex != triangle.vertexIndices[1] && vertex != triangle.vertexIndices[2])
+				newCache.push_back(vertex);
+		}
+
+		for (int i = 0; i < (int)newCache.size(); i++)
+		{
+			int vertex = newCache[i];
+			cachePosition[vertex] = i < VERTEX_CACHE_OPTIMIZE_SIZE ? i : -1;
+			vertexScores[vertex] = GetVertexCacheScore(cachePosition[vertex], remaining[vertex]);
+		}
+
+		// Solo cambian los puntajes de los triangulos que tocan la cache (o lo que salio de ella)
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (int i = 0; i < (int)newCache.size(); i++)
+		{
+			int vertex = newCache[i];
+
+			for (int j = 0; j < remaining[vertex]; j++)
+			{
+				int candidate = vertexTriangles[firstTriangle[vertex] + j];
+				const int *indices = mesh->triangles[candidate].vertexIndices;
+				float score = vertexScores[indices[0]] + vertexScores[indices[1]] + vertexScores[indices[2]];
+
+				triangleScores[candidate] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = candidate;
+				}
+			}
+		}
+
+		if (newCache.size() > VERTEX_CACHE_OPTIMIZE_SIZE)
+			newCache.resize(VERTEX_CACHE_OPTIMIZE_SIZE);
+
+		cache.swap(newCache);
+	}
+
+	mesh->triangles.swap(triangles);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			mesh->indices[i * 3 + k] = mesh->triangles[i].vertexIndices[k];
+	}
+}
+
+#pragma endregion
+
+#pragma region Vertex order
+
+/**
+*	Mueve el vertice i a newIndex[i] en vertices, staticVertices y
+*	vertexInfo, y corrige triangles e indices. Los pesos se copian en el
+*	orden nuevo de los vertices, asi que el skinning por pesos los lee
+*	hacia adelante; los que ya no usa ningun vertice se quitan.
+*	VertexInfo::vertexIndex conserva el indice del archivo. Si varios
+*	vertices van al mismo indice (WeldVertices) se queda el primero; los
+*	que van a -1 se quitan (ningun triangulo debe usarlos).
+**/
+void RemapVertices(Mesh *mesh, const vector<int> &newIndex)
+{
+	int numVertices = 0;
+	for (int i = 0; i < (int)newIndex.size(); i++)
+		numVertices = newIndex[i] + 1 > numVertices ? newIndex[i] + 1 : numVertices;
+
+	vector<Vertex> vertices(numVertices);
+	vector<StaticVertex> staticVertices(numVertices);
+	vector<VertexInfo> vertexInfo(numVertices);
+	vector<bool> isAssigned(numVertices, false);
+
+	for (int i = 0; i < (int)newIndex.size(); i++)
+	{
+		if (newIndex[i] < 0 || isAssigned[newIndex[i]])
+			continue;
+
+		vertices[newIndex[i]] = mesh->vertices[i];
+		staticVertices[newIndex[i]] = mesh->staticVertices[i];
+		vertexInfo[newIndex[i]] = mesh->vertexInfo[i];
+		isAssigned[newIndex[i]] = true;
+	}
+
+	// Hay archivos (boy) donde varios vertices comparten pesos: un rango que ya se copio
+	// completo y seguido se reutiliza, y solo uno que quedo partido se duplica
+	vector<Weight> weights;
+	vector<int> newWeight(mesh->weights.size(), -1);
+	weights.reserve(mesh->weights.size());
+
+	for (int i = 0; i < numVertices; i++)
+	{
+		VertexInfo &info = vertexInfo[i];
+		bool isCopied = info.countWeight > 0 && newWeight[info.startWeight] >= 0;
+
+		for (int k = 1; isCopied && k < info.countWeight; k++)
+			isCopied = newWeight[info.startWeight + k] == newWeight[info.startWeight] + k;
+
+		if (isCopied)
+		{
+			info.startWeight = newWeight[info.startWeight];
+			continue;
+		}
+
+		int startWeight = weights.size();
+
+		for (int k = 0; k < info.countWeight; k++)
+		{
+			if (newWeight[info.startWeight + k] < 0)
+				newWeight[info.startWeight + k] = weights.size();
+
+			weights.push_back(mesh->weights[info.startWeight + k]);
+		}
+
+		info.startWeight = startWeight;
+	}
+
+	mesh->vertices.swap(vertices);
+	mesh->staticVertices.swap(staticVertices);
+	mesh->vertexInfo.swap(vertexInfo);
+	mesh->weights.swap(weights);
+	mesh->numVertices = mesh->vertices.size();
+	mesh->numWeights = mesh->weights.size();
+
+	for (int i = 0; i < (int)mesh->indices.size(); i++)
+		mesh->indices[i] = newIndex[mesh->indices[i]];
+
+	for (int i = 0; i < (int)mesh->triangles.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+			mesh->triangles[i].vertexIndices[k] = newIndex[mesh->triangles[i].vertexIndices[k]];
+	}
+}
+
+/**
+*	Numera los vertices en el orden en que los pide el index buffer, para
+*	que el input assembler y el skinning recorran la memoria hacia
+*	adelante. Los vertices que ningun triangulo usa van al final. Se llama
+*	despues de OptimizeTriangleOrder.
+**/
+void OptimizeVertexFetchOrder(Mesh *mesh)
+{
+	int numVertices = mesh->vertices.size();
+	vector<int> newIndex(numVertices, -1);
+	int next = 0;
+
+	for (int i = 0; i < (int)mesh->indices.size(); i++)
+	{
+		if (newIndex[mesh->indices[i]] < 0)
+			newIndex[mesh->indices[i]] = next++;
+	}
+
+	for (int i = 0; i < numVertices; i++)
+	{
+		if (newIndex[i] < 0)
+			newIndex[i] = next++;
+	}
+
+	RemapVertices(mesh, newIndex);
+}
+
+#pragma endregion
+
+#pragma region Duplicates
+
+/**
+*	Compara joint, bias y posicion, sin la normal (antes de ComputeNormals
+*	no esta inicializada). Con memcmp, asi que -0 y 0 cuentan como
+*	distintos.
+**/
+int CompareWeightContents(const Weight &a, const Weight &b)
+{
+	return memcmp(&a.joint, &b.joint, offsetof(Weight, normal) - offsetof(Weight, joint));
+}
+
+// Orden de los rangos de pesos (inicio, cuenta) por su contenido
+struct WeightRunLess
+{
+	const vector<Weight> *weights;
+
+	bool operator()(const pair<int, int> &a, const pair<int, int> &b) const
+	{
+		if (a.second != b.second)
+			return a.second < b.second;
+
+		for (int k = 0; k < a.second; k++)
+		{
+			int comparison = CompareWeightContents((*weights)[a.first + k], (*weights)[b.first + k]);
+
+			if (comparison != 0)
+				return comparison < 0;
+		}
+
+		return false;
+	}
+};
+
+// Orden de los vertices por coordenada de textura y contenido de sus pesos
+struct WeldVertexLess
+{
+	const Mesh *mesh;
+	WeightRunLess runLess;
+
+	bool operator()(int a, int b) const
+	{
+		const XMFLOAT2 &uvA = mesh->staticVertices[a].uv;
+		const XMFLOAT2 &uvB = mesh->staticVertices[b].uv;
+
+		if (uvA.x != uvB.x)	return uvA.x < uvB.x;
+		if (uvA.y != uvB.y)	return uvA.y < uvB.y;
+
+		const VertexInfo &infoA = mesh->vertexInfo[a];
+		const VertexInfo &infoB = mesh->vertexInfo[b];
+
+		return runLess(make_pair(infoA.startWeight, infoA.countWeight), make_pair(infoB.startWeight, infoB.countWeight));
+	}
+};
+
+/**
+*	Une los vertices con la misma coordenada de textura y los mismos
+*	pesos (joint, bias y posicion de cada uno, en el mismo orden): quedan
+*	en la misma posicion en cualquier pose, asi que basta transformarlos
+*	una vez. Se llama antes de ComputeNormals, para que la normal del
+*	vertice unido promedie los triangulos de todas sus copias. Los demas
+*	vertices conservan su orden.
+*
+*	Los vertices que quedan con los mismos pesos del archivo (las copias
+*	de una costura de textura) no pueden compartir su rango: ComputeNormals
+*	guarda en cada peso la normal del vertice en espacio del joint, y las
+*	copias de una costura tienen normales distintas.
+**/
+void WeldVertices(Mesh *mesh)
+{
+	WeldVertexLess vertexLess;
+	vertexLess.mesh = mesh;
+	vertexLess.runLess.weights = &mesh->weights;
+
+	set<int, WeldVertexLess> firstVertices(vertexLess);
+	vector<int> newIndex(mesh->vertices.size());
+	int next = 0;
+
+	for (int i = 0; i < (int)mesh->vertices.size(); i++)
+	{
+		int first = *firstVertices.insert(i).first;
+		newIndex[i] = first == i ? next++ : newIndex[first];
+	}
+
+	RemapVertices(mesh, newIndex);
+}
+
+#pragma endregion
+
+#pragma region Simplification
+
+// Cuadrica de error de Garland y Heckbert: suma de distancias al cuadrado a planos (matriz simetrica de 4x4)
+struct Quadric
+{
+	double a[10];
+};
+
+void AddPlaneQuadric(Quadric *quadric, double x, double y, double z, double w)
+{
+	double plane[4] = { x, y, z, w };
+	int k = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = i; j < 4; j++)
+			quadric->a[k++] += plane[i] * plane[j];
+	}
+}
+
+void AddQuadric(Quadric *quadric, const Quadric &other)
+{
+	for (int k = 0; k < 10; k++)
+		quadric->a[k] += other.a[k];
+}
+
+double EvaluateQuadric(const Quadric &quadric, const XMFLOAT3 &position)
+{
+	double point[4] = { position.x, position.y, position.z, 1.0 };
+	double error = 0;
+	int k = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = i; j < 4; j++)
+			error += (i == j ? 1.0 : 2.0) * quadric.a[k++] * point[i] * point[j];
+	}
+
+	return error > 0 ? error : 0;
+}
+
+// Como se puede mover cada vertice al simplificar
+enum SimplifyVertexKind
+{
+	SIMPLIFY_MANIFOLD,	// Rodeado de triangulos: se mueve sobre cualquier vecino
+	SIMPLIFY_BORDER,	// En un borde abierto: solo a lo largo del borde
+	SIMPLIFY_SEAM,		// Una de las dos copias de una costura de textura: con su gemela, a lo largo de la costura
+	SIMPLIFY_LOCKED		// Esquinas, uniones de bordes y costuras y lados compartidos por mas de dos triangulos
+};
+
+// Colapso candidato de vertex sobre target; stamp descarta los que quedaron viejos
+struct EdgeCollapse
+{
+	float error;
+	int vertex;
+	int target;
+	int stamp;
+
+	bool operator<(const EdgeCollapse &other) const { return error > other.error; }
+};
+
+/**
+*	Simplificacion de una malla por colapsos de medio lado: el vertice que
+*	se quita se mueve sobre uno de sus vecinos, asi que cada nivel usa solo
+*	vertices (y pesos) de la malla original y los que quedan se deforman
+*	exactamente igual. Las cuadricas se acumulan por posicion (las dos
+*	copias de una costura comparten la suya) en la bind pose y en cada
+*	pose de poses, y el error de un colapso es el peor entre ellas, asi
+*	que no se unen vertices que el skinning separa. Los lados de bordes y
+*	costuras agregan un plano perpendicular para que no se encojan.
+**/
+class MeshSimplifier
+{
+	const Mesh *mesh;
+	vector<const Vertex*> posePositions;
+	vector<Triangle> triangles;
+	vector<bool> isTriangleAlive;
+	int numAliveTriangles;
+
+	vector<vector<int> > vertexTriangles;
+	vector<int> positionGroup;
+	vector<int> twins;
+	vector<SimplifyVertexKind> kinds;
+	// numPoses cuadricas por grupo de posicion
+	vector<Quadric> groupQuadrics;
+	vector<int> stamps;
+	priority_queue<EdgeCollapse> collapses;
+	float maxError;
+
+public:
+	MeshSimplifier(const Mesh *mesh, const vector<vector<Vertex> > &poses)
+	{
+		this->mesh = mesh;
+		this->triangles = mesh->triangles;
+		this->isTriangleAlive.assign(triangles.size(), true);
+		this->numAliveTriangles = triangles.size();
+		this->maxError = 0;
+
+		int numVertices = mesh->vertices.size();
+		posePositions.push_back(numVertices > 0 ? &mesh->vertices[0] : NULL);
+
+		for (int p = 0; p < (int)poses.size(); p++)
+			posePositions.push_back(numVertices > 0 ? &poses[p][0] : NULL);
+
+		vertexTriangles.resize(numVertices);
+		stamps.assign(numVertices, 0);
+
+		for (int t = 0; t < (int)triangles.size(); t++)
+		{
+			for (int k = 0; k < 3; k++)
+				vertexTriangles[triangles[t].vertexIndices[k]].push_back(t);
+		}
+
+		BuildPositionGroups();
+		ClassifyVertices();
+
+		for (int v = 0; v < numVertices; v++)
+			PushCollapse(v);
+	}
+
+	int GetNumTriangles() const { return numAliveTriangles; }
+
+	// Raiz de la cuadrica del peor colapso hecho, en la peor pose: cota de la distancia a los planos originales
+	float GetMaxError() const { return maxError; }
+
+	// Colapsa del menor error al mayor hasta dejar targetTriangles o hasta que no quede un colapso valido
+	void Simplify(int targetTriangles)
+	{
+		while (numAliveTriangles > targetTriangles && !collapses.empty())
+		{
+			EdgeCollapse collapse = collapses.top();
+			collapses.pop();
+
+			if (collapse.stamp != stamps[collapse.vertex])
+				continue;
+
+			int vertex = collapse.vertex, target = collapse.target;
+
+			// Los vecinos del destino pudieron cambiar sin tocar al vertice
+			if (!IsCollapseAllowed(vertex, target))
+			{
+				stamps[vertex]++;
+				PushCollapse(vertex);
+				continue;
+			}
+
+			int twin = kinds[vertex] == SIMPLIFY_SEAM ? twins[vertex] : -1;
+			int twinTarget = twin >= 0 ? FindTwinTarget(vertex, target) : -1;
+
+			// Las copias de una costura comparten cuadrica, asi que se suma una sola vez
+			for (int p = 0; p < (int)posePositions.size(); p++)
+				AddQuadric(&GetQuadric(positionGroup[target], p), GetQuadric(positionGroup[vertex], p));
+
+			Collapse(vertex, target);
+
+			if (twin >= 0)
+				Collapse(twin, twinTarget);
+
+			RefreshAround(target);
+
+			if (twin >= 0)
+				RefreshAround(twinTarget);
+
+			maxError = collapse.error > maxError ? collapse.error : maxError;
+		}
+	}
+
+	/**
+	*	Copia de la malla con los triangulos que quedan y solo los vertices
+	*	que usan, en el mismo orden relativo; los triangulos conservan su
+	*	triangleIndex. Las influencias no se copian: hay que construirlas.
+	**/
+	void GetSimplifiedMesh(Mesh *result) const
+	{
+		*result = *mesh;
+		result->triangles.clear();
+		result->indices.clear();
+		result->quantizedVertices.clear();
+		result->tangentFrameVertices.clear();
+		result->influences = InfluenceStreams();
+
+		vector<int> newIndex(mesh->vertices.size(), -1);
+
+		for (int t = 0; t < (int)triangles.size(); t++)
+		{
+			if (!isTriangleAlive[t])
+				continue;
+
+			result->triangles.push_back(triangles[t]);
+
+			for (int k = 0; k < 3; k++)
+			{
+				result->indices.push_back(triangles[t].vertexIndices[k]);
+				newIndex[triangles[t].vertexIndices[k]] = 0;
+			}
+		}
+
+		int next = 0;
+		for (int v = 0; v < (int)newIndex.size(); v++)
+		{
+			if (newIndex[v] == 0)
+				newIndex[v] = next++;
+		}
+
+		result->numTriangles = result->triangles.size();
+		RemapVertices(result, newIndex);
+	}
+
+private:
+	const XMFLOAT3& GetPosition(int vertex, int pose = 0) const { return posePositions[pose][vertex].position; }
+	Quadric& GetQuadric(int group, int pose) { return groupQuadrics[group * posePositions.size() + pose]; }
+
+	// Vertices en la misma posicion exacta de bind pose comparten grupo; twins enlaza las dos copias de una costura
+	void BuildPositionGroups()
+	{
+		map<pair<float, pair<float, float> >, int> groups;
+		vector<int> firstMembers;
+		int numVertices = mesh->vertices.size();
+
+		positionGroup.resize(numVertices);
+		twins.assign(numVertices, -1);
+
+		for (int v = 0; v < numVertices; v++)
+		{
+			const XMFLOAT3 &position = GetPosition(v);
+			pair<float, pair<float, float> > key(position.x, make_pair(position.y, position.z));
+			map<pair<float, pair<float, float> >, int>::iterator group = groups.find(key);
+
+			if (group == groups.end())
+			{
+				group = groups.insert(make_pair(key, (int)firstMembers.size())).first;
+				firstMembers.push_back(v);
+			}
+			else
+			{
+				int first = firstMembers[group->second];
+
+				// Con mas de dos copias ninguna tiene gemela (-2) y todas quedan fijas
+				if (twins[first] == -1)
+				{
+					twins[first] = v;
+					twins[v] = first;
+				}
+				else
+				{
+					if (twins[first] >= 0)
+						twins[twins[first]] = -2;
+
+					twins[first] = twins[v] = -2;
+				}
+			}
+
+			positionGroup[v] = group->second;
+		}
+
+		Quadric zero;
+		memset(&zero, 0, sizeof(zero));
+		groupQuadrics.assign(firstMembers.size() * posePositions.size(), zero);
+	}
+
+	/**
+	*	Cuenta los lados de cada vertice que usa un solo triangulo: si del
+	*	otro lado no hay nada (por posicion) es un borde abierto y si hay
+	*	otra copia es una costura. Tambien suma las cuadricas de los
+	*	triangulos y de los planos de esos lados.
+	**/
+	void ClassifyVertices()
+	{
+		int numVertices = mesh->vertices.size();
+		map<pair<int, int>, int> vertexEdges, positionEdges;
+
+		for (int t = 0; t < (int)triangles.size(); t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				int a = triangles[t].vertexIndices[k], b = triangles[t].vertexIndices[(k + 1) % 3];
+				int groupA = positionGroup[a], groupB = positionGroup[b];
+
+				vertexEdges[a < b ? make_pair(a, b) : make_pair(b, a)]++;
+				positionEdges[groupA < groupB ? make_pair(groupA, groupB) : make_pair(groupB, groupA)]++;
+			}
+		}
+
+		vector<int> openEdges(numVertices, 0), seamEdges(numVertices, 0);
+		vector<bool> isNonManifold(numVertices, false);
+
+		for (map<pair<int, int>, int>::iterator edge = vertexEdges.begin(); edge != vertexEdges.end(); ++edge)
+		{
+			int a = edge->first.first, b = edge->first.second;
+			int groupA = positionGroup[a], groupB = positionGroup[b];
+			int positionCount = positionEdges[groupA < groupB ? make_pair(groupA, groupB) : make_pair(groupB, groupA)];
+
+			if (edge->second > 2 || positionCount > 2)
+				isNonManifold[a] = isNonManifold[b] = true;
+			else if (edge->second == 1 && positionCount == 1)
+			{
+				openEdges[a]++;
+				openEdges[b]++;
+			}
+			else if (edge->second == 1)
+			{
+				seamEdges[a]++;
+				seamEdges[b]++;
+			}
+		}
+
+		kinds.resize(numVertices);
+
+		for (int v = 0; v < numVertices; v++)
+		{
+			if (isNonManifold[v])
+				kinds[v] = SIMPLIFY_LOCKED;
+			else if (twins[v] == -1 && openEdges[v] == 0 && seamEdges[v] == 0)
+				kinds[v] = SIMPLIFY_MANIFOLD;
+			else if (twins[v] == -1 && openEdges[v] == 2 && seamEdges[v] == 0)
+				kinds[v] = SIMPLIFY_BORDER;
+			else if (twins[v] >= 0 && openEdges[v] == 0 && seamEdges[v] == 2)
+				kinds[v] = SIMPLIFY_SEAM;
+			else
+				kinds[v] = SIMPLIFY_LOCKED;
+		}
+
+		// Una copia se mueve solo si su gemela tambien puede
+		for (int v = 0; v < numVertices; v++)
+		{
+			if (kinds[v] == SIMPLIFY_SEAM && kinds[twins[v]] != SIMPLIFY_SEAM)
+				kinds[v] = SIMPLIFY_LOCKED;
+		}
+
+		for (int p = 0; p < (int)posePositions.size(); p++)
+		{
+			for (int t = 0; t < (int)triangles.size(); t++)
+			{
+				const int *indices = triangles[t].vertexIndices;
+				XMVECTOR corners[3];
+
+				for (int k = 0; k < 3; k++)
+					corners[k] = XMLoadFloat3(&GetPosition(indices[k], p));
+
+				XMVECTOR normal = XMVector3Cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+				if (XMVectorGetX(XMVector3LengthSq(normal)) <= 0)
+					continue;
+
+				normal = XMVector3Normalize(normal);
+				AddPlane(indices, 3, normal, corners[0], p);
+
+				for (int k = 0; k < 3; k++)
+				{
+					int a = indices[k], b = indices[(k + 1) % 3];
+
+					if (vertexEdges[a < b ? make_pair(a, b) : make_pair(b, a)] != 1)
+						continue;
+
+					XMVECTOR edge = corners[(k + 1) % 3] - corners[k];
+					XMVECTOR edgeNormal = XMVector3Cross(edge, normal);
+
+					if (XMVectorGetX(XMVector3LengthSq(edgeNormal)) > 0)
+					{
+						int edgeIndices[2] = { a, b };
+						AddPlane(edgeIndices, 2, XMVector3Normalize(edgeNormal), corners[k], p);
+					}
+				}
+			}
+		}
+	}
+
+	// Suma el plano a los grupos de los vertices, una vez por grupo
+	void AddPlane(const int *vertices, int numVertices, XMVECTOR normal, XMVECTOR point, int pose)
+	{
+		Quadric plane;
+		memset(&plane, 0, sizeof(plane));
+		AddPlaneQuadric(&plane, XMVectorGetX(normal), XMVectorGetY(normal), XMVectorGetZ(normal), -XMVectorGetX(XMVector3Dot(normal, point)));
+
+		for (int k = 0; k < numVertices; k++)
+		{
+			bool isRepeated = false;
+
+			for (int j = 0; j < k; j++)
+				isRepeated = isRepeated || positionGroup[vertices[j]] == positionGroup[vertices[k]];
+
+			if (!isRepeated)
+				AddQuadric(&GetQuadric(positionGroup[vertices[k]], pose), plane);
+		}
+	}
+
+	// Vecinos de vertex por los triangulos que quedan, sin repetir
+	void GetNeighbors(int vertex, vector<int> *neighbors) const
+	{
+		neighbors->clear();
+
+		for (int i = 0; i < (int)vertexTriangles[vertex].size(); i++)
+		{
+			const int *indices = triangles[vertexTriangles[vertex][i]].vertexIndices;
+
+			for (int k = 0; k < 3; k++)
+			{
+				if (indices[k] != vertex && find(neighbors->begin(), neighbors->end(), indices[k]) == neighbors->end())
+					neighbors->push_back(indices[k]);
+			}
+		}
+	}
+
+	// Triangulos que quedan con los dos vertices
+	int CountEdgeTriangles(int a, int b) const
+	{
+		int count = 0;
+
+		for (int i = 0; i < (int)vertexTriangles[a].size(); i++)
+		{
+			const int *indices = triangles[vertexTriangles[a][i]].vertexIndices;
+			count += indices[0] == b || indices[1] == b || indices[2] == b;
+		}
+
+		return count;
+	}
+
+	// Destino de la gemela de vertex cuando vertex va a target: la otra copia de target del otro lado de la costura
+	int FindTwinTarget(int vertex, int target) const
+	{
+		int twin = twins[vertex], twinTarget = twins[target];
+
+		if (twin < 0 || twinTarget < 0 || CountEdgeTriangles(twin, twinTarget) != 1)
+			return -1;
+
+		return twinTarget;
+	}
+
+	/**
+	*	El colapso no debe voltear ni aplastar triangulos, y los vecinos en
+	*	comun de los dos vertices deben ser solo los terceros vertices de los
+	*	triangulos del lado (si no la malla deja de ser una superficie).
+	**/
+	bool IsCollapseValid(int vertex, int target) const
+	{
+		vector<int> vertexNeighbors, targetNeighbors;
+		GetNeighbors(vertex, &vertexNeighbors);
+		GetNeighbors(target, &targetNeighbors);
+
+		if (find(vertexNeighbors.begin(), vertexNeighbors.end(), target) == vertexNeighbors.end())
+			return false;
+
+		int numShared = 0, numEdgeTriangles = 0;
+
+		for (int i = 0; i < (int)vertexNeighbors.size(); i++)
+		{
+			if (find(targetNeighbors.begin(), targetNeighbors.end(), vertexNeighbors[i]) != targetNeighbors.end())
+				numShared++;
+		}
+
+		XMVECTOR targetPosition = XMLoadFloat3(&GetPosition(target));
+
+		for (int i = 0; i < (int)vertexTriangles[vertex].size(); i++)
+		{
+			const int *indices = triangles[vertexTriangles[vertex][i]].vertexIndices;
+
+			if (indices[0] == target || indices[1] == target || indices[2] == target)
+			{
+				numEdgeTriangles++;
+				continue;
+			}
+
+			XMVECTOR corners[3], moved[3];
+			for (int k = 0; k < 3; k++)
+			{
+				corners[k] = XMLoadFloat3(&GetPosition(indices[k]));
+				moved[k] = indices[k] == vertex ? targetPosition : corners[k];
+			}
+
+			XMVECTOR before = XMVector3Cross(corners[1] - corners[0], corners[2] - corners[0]);
+			XMVECTOR after = XMVector3Cross(moved[1] - moved[0], moved[2] - moved[0]);
+			float area = XMVectorGetX(XMVector3Length(after));
+
+			// Mas de 60 grados de giro cuenta como volteado
+			if (area <= 0 || XMVectorGetX(XMVector3Dot(before, after)) < 0.5f * area * XMVectorGetX(XMVector3Length(before)))
+				return false;
+		}
+
+		return numShared == numEdgeTriangles;
+	}
+
+	// Segun el tipo del vertice: los de borde y costura solo se mueven por un lado de un solo triangulo
+	bool IsCollapseAllowed(int vertex, int target) const
+	{
+		switch (kinds[vertex])
+		{
+		case SIMPLIFY_MANIFOLD:
+			return IsCollapseValid(vertex, target);
+		case SIMPLIFY_BORDER:
+			return CountEdgeTriangles(vertex, target) == 1 && IsCollapseValid(vertex, target);
+		case SIMPLIFY_SEAM:
+			if (CountEdgeTriangles(vertex, target) != 1 || !IsCollapseValid(vertex, target))
+				return false;
+
+			return FindTwinTarget(vertex, target) >= 0 && IsCollapseValid(twins[vertex], FindTwinTarget(vertex, target));
+		default:
+			return false;
+		}
+	}
+
+	// Peor error entre las poses de mover vertex a target con las cuadricas de los dos
+	float GetCollapseError(int vertex, int target)
+	{
+		double error = 0;
+
+		for (int p = 0; p < (int)posePositions.size(); p++)
+		{
+			Quadric quadric = GetQuadric(positionGroup[vertex], p);
+			AddQuadric(&quadric, GetQuadric(positionGroup[target], p));
+
+			double poseError = EvaluateQuadric(quadric, GetPosition(target, p));
+			error = poseError > error ? poseError : error;
+		}
+
+		return (float)sqrt(error);
+	}
+
+	// Mejor destino permitido para vertex
+	void PushCollapse(int vertex)
+	{
+		if (kinds[vertex] == SIMPLIFY_LOCKED || vertexTriangles[vertex].empty())
+			return;
+
+		vector<int> neighbors;
+		GetNeighbors(vertex, &neighbors);
+
+		EdgeCollapse best;
+		best.vertex = vertex;
+		best.target = -1;
+		best.stamp = stamps[vertex];
+
+		for (int i = 0; i < (int)neighbors.size(); i++)
+		{
+			int target = neighbors[i];
+			float error = GetCollapseError(vertex, target);
+
+			if ((best.target < 0 || error < best.error) && IsCollapseAllowed(vertex, target))
+			{
+				best.target = target;
+				best.error = error;
+			}
+		}
+
+		if (best.target >= 0)
+			collapses.push(best);
+	}
+
+	// Cambia la topologia; las cuadricas ya se sumaron
+	void Collapse(int vertex, int target)
+	{
+		vector<int> &targetTriangles = vertexTriangles[target];
+
+		for (int i = 0; i < (int)vertexTriangles[vertex].size(); i++)
+		{
+			int t = vertexTriangles[vertex][i];
+			int *indices = triangles[t].vertexIndices;
+
+			if (indices[0] == target || indices[1] == target || indices[2] == target)
+			{
+				// El triangulo del lado desaparece de sus otros vertices
+				isTriangleAlive[t] = false;
+				numAliveTriangles--;
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (indices[k] != vertex)
+					{
+						vector<int> &cornerTriangles = vertexTriangles[indices[k]];
+						cornerTriangles.erase(find(cornerTriangles.begin(), cornerTriangles.end(), t));
+					}
+				}
+			}
+			else
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					if (indices[k] == vertex)
+						indices[k] = target;
+				}
+
+				targetTriangles.push_back(t);
+			}
+		}
+
+		vertexTriangles[vertex].clear();
+		stamps[vertex]++;
+	}
+
+	// Cambio la cuadrica del destino y los vecinos de todos los de alrededor
+	void RefreshAround(int target)
+	{
+		vector<int> neighbors;
+		GetNeighbors(target, &neighbors);
+		neighbors.push_back(target);
+
+		for (int i = 0; i < (int)neighbors.size(); i++)
+		{
+			stamps[neighbors[i]]++;
+			PushCollapse(neighbors[i]);
+		}
+	}
+};
+
+/**
+*	Simplifica la malla hasta cada numero de triangulos de targetTriangles,
+*	de mayor a menor; cada nivel sigue colapsando el anterior. poses son
+*	los vertices de la malla transformados en otras poses (puede estar
+*	vacio: solo cuenta la bind pose). levels[i] es una copia con solo sus
+*	triangulos y vertices (ver MeshSimplifier::GetSimplifiedMesh) y
+*	errors[i] la cota de error de su peor colapso, en unidades del modelo.
+*	Si no quedan colapsos validos los niveles restantes quedan como el
+*	ultimo.
+**/
+void SimplifyMesh(const Mesh &mesh, const vector<vector<Vertex> > &poses, const vector<int> &targetTriangles, vector<Mesh> *levels, vector<float> *errors)
+{
+	MeshSimplifier simplifier(&mesh, poses);
+
+	levels->resize(targetTriangles.size());
+	errors->resize(targetTriangles.size());
+
+	for (int i = 0; i < (int)targetTriangles.size(); i++)
+	{
+		simplifier.Simplify(targetTriangles[i]);
+		simplifier.GetSimplifiedMesh(&(*levels)[i]);
+		(*errors)[i] = simplifier.GetMaxError();
+	}
+}
+
+#pragma endregion
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef _POSE_H_INCLUDED
+#define _POSE_H_INCLUDED
+
+#pragma region Includes
+
+#include <malloc.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <xnamath.h>
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Descripcion del esqueleto compartida por todas las poses de un clip:
+*	los nombres y padres de los joints se guardan una sola vez en lugar
+*	de copiarse en cada frame.
+**/
+struct SkeletonDescription
+{
+	vector<string> names;
+	vector<int> parents;
+
+	int GetNumJoints() const { return (int)parents.size(); }
+};
+
+/**
+*	Conjunto de poses guardado como arreglos paralelos y contiguos de
+*	posiciones y orientaciones. Cada elemento ocupa 16 bytes alineados
+*	(la w de las posiciones siempre es 0), asi que se pueden cargar
+*	directamente con XMLoadFloat4A. La pose p ocupa los elementos
+*	[p * numJoints, (p + 1) * numJoints).
+**/
+class PoseBuffer
+{
+	int numPoses;
+	int numJoints;
+	XMFLOAT4A *positions;
+	XMFLOAT4A *orientations;
+
+public:
+	PoseBuffer()
+	{
+		numPoses = 0;
+		numJoints = 0;
+		positions = NULL;
+		orientations = NULL;
+	}
+
+	~PoseBuffer()
+	{
+		Release();
+	}
+
+	void Allocate(int numPoses, int numJoints)
+	{
+		if (numPoses == this->numPoses && numJoints == this->numJoints)
+			return;
+
+		Release();
+
+		if (numPoses <= 0 || numJoints <= 0)
+			return;
+
+		size_t bytes = sizeof(XMFLOAT4A) * numPoses * numJoints;
+		positions = (XMFLOAT4A*)_aligned_malloc(bytes, 16);
+		orientations = (XMFLOAT4A*)_aligned_malloc(bytes, 16);
+		memset(positions, 0, bytes);
+		memset(orientations, 0, bytes);
+
+		this->numPoses = numPoses;
+		this->numJoints = numJoints;
+	}
+
+	void Release()
+	{
+		if (positions != NULL)		_aligned_free(positions);
+		if (orientations != NULL)	_aligned_free(orientations);
+
+		numPoses = 0;
+		numJoints = 0;
+		positions = NULL;
+		orientations = NULL;
+	}
+
+	int GetNumPoses() const { return numPoses; }
+	int GetNumJoints() const { return numJoints; }
+	size_t GetSizeInBytes() const { return sizeof(XMFLOAT4A) * 2 * numPoses * numJoints; }
+
+	XMFLOAT4A* GetPositions(int pose) { return positions + pose * numJoints; }
+	XMFLOAT4A* GetOrientations(int pose) { return orientations + pose * numJoints; }
+	const XMFLOAT4A* GetPositions(int pose) const { return positions + pose * numJoints; }
+	const XMFLOAT4A* GetOrientations(int pose) const { return orientations + pose * numJoints; }
+
+private:
+	// Las poses pueden ocupar varios megabytes; no se copian por accidente
+	PoseBuffer(const PoseBuffer&);
+	PoseBuffer& operator=(const PoseBuffer&);
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef _SKINNINGCACHE_H_INCLUDED
+#define _SKINNINGCACHE_H_INCLUDED
+
+#pragma region Includes
+
+#include <Windows.h>
+#include <math.h>
+#include <list>
+#include <map>
+#include <vector>
+#include "Structs.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+// Un frame a 60 Hz: dos instancias comparten resultado si su tiempo cae en el mismo sesentavo de segundo
+#define SKINNING_CACHE_DEFAULT_BUCKET	(1.0f / 60.0f)
+#define SKINNING_CACHE_DEFAULT_BUDGET	(32 * 1024 * 1024)
+
+/**
+*	Identifica un resultado de skinning: el modelo (archivo, orden de
+*	vertices e influencias, ver MD5Mesh::SetSkinningCache), el clip
+*	(MD5Anim::GetClipKey, no su direccion: un clip nuevo puede ocupar la
+*	de uno liberado y heredaria sus entradas), el metodo de skinning, el
+*	nivel de detalle y el intervalo de tiempo del clip.
+**/
+struct SkinningCacheKey
+{
+	unsigned long long model;
+	unsigned long long clip;
+	int method;
+	int level;
+	int bucket;
+
+	bool operator<(const SkinningCacheKey &other) const
+	{
+		if (model != other.model)	return model < other.model;
+		if (clip != other.clip)		return clip < other.clip;
+		if (method != other.method)	return method < other.method;
+		if (level != other.level)	return level < other.level;
+		return bucket < other.bucket;
+	}
+};
+
+// Vertices en float de todas las mallas del modelo, una tras otra
+struct SkinningCacheEntry
+{
+	SkinningCacheKey key;
+	vector<Vertex> vertices;
+	int pins;
+};
+
+struct SkinningCacheStats
+{
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	int numEntries;
+	size_t memoryUsage;
+};
+
+/**
+*	Cache de resultados de skinning compartido entre instancias. Cada
+*	entrada se transforma en el inicio de su intervalo, asi que no depende
+*	de que instancia la calculo; el error visual queda acotado por el
+*	movimiento del clip en un intervalo. Cuando los vertices pasan de
+*	memoryBudget se desalojan las entradas usadas hace mas tiempo.
+*
+*	Es seguro entre hilos: UpdateModels anima modelos en paralelo. Una
+*	entrada que se esta copiando (Acquire sin Release) no se desaloja,
+*	asi que la memoria puede pasar un poco del limite mientras tanto.
+**/
+class SkinningCache
+{
+	typedef list<SkinningCacheEntry>::iterator EntryIterator;
+
+	// Al frente las usadas mas recientemente
+	list<SkinningCacheEntry> entries;
+	map<SkinningCacheKey, EntryIterator> entryIndex;
+
+	float bucketSize;
+	size_t memoryBudget;
+	SkinningCacheStats stats;
+	CRITICAL_SECTION lock;
+
+public:
+	SkinningCache(float bucketSize = SKINNING_CACHE_DEFAULT_BUCKET, size_t memoryBudget = SKINNING_CACHE_DEFAULT_BUDGET)
+	{
+		InitializeCriticalSection(&lock);
+		ZeroMemory(&stats, sizeof(stats));
+		this->bucketSize = bucketSize > 0 ? bucketSize : SKINNING_CACHE_DEFAULT_BUCKET;
+		this->memoryBudget = memoryBudget;
+	}
+
+	~SkinningCache()
+	{
+		DeleteCriticalSection(&lock);
+	}
+
+	// Cambiar el intervalo invalida todas las entradas; no debe haber modelos actualizandose
+	float GetBucketSize() const { return bucketSize; }
+	void SetBucketSize(float bucketSize)
+	{
+		this->bucketSize = bucketSize > 0 ? bucketSize : SKINNING_CACHE_DEFAULT_BUCKET;
+		Clear();
+	}
+
+	size_t GetMemoryBudget() const { return memoryBudget; }
+	void SetMemoryBudget(size_t memoryBudget)
+	{
+		EnterCriticalSection(&lock);
+		this->memoryBudget = memoryBudget;
+		Evict();
+		LeaveCriticalSection(&lock);
+	}
+
+	int GetBucket(float time) const { return (int)floorf(time / bucketSize); }
+	float GetBucketTime(int bucket) const { return bucket * bucketSize; }
+
+	/**
+	*	Regresa la entrada fijada (hay que llamar Release al terminar de
+	*	copiarla) o NULL si no esta; en ese caso quien llama la transforma
+	*	y la agrega con Insert.
+	**/
+	const SkinningCacheEntry* Acquire(const SkinningCacheKey &key)
+	{
+		SkinningCacheEntry *entry = NULL;
+
+		EnterCriticalSection(&lock);
+
+		map<SkinningCacheKey, EntryIterator>::iterator it = entryIndex.find(key);
+
+		if (it != entryIndex.end())
+		{
+			entries.splice(entries.begin(), entries, it->second);
+			entry = &*it->second;
+			entry->pins++;
+			stats.hits++;
+		}
+		else
+			stats.misses++;
+
+		LeaveCriticalSection(&lock);
+
+		return entry;
+	}
+
+	void Release(const SkinningCacheEntry *entry)
+	{
+		EnterCriticalSection(&lock);
+		const_cast<SkinningCacheEntry*>(entry)->pins--;
+		Evict();
+		LeaveCriticalSection(&lock);
+	}
+
+	/**
+	*	Toma los vertices (vertices queda vacio). Si otro hilo agrego la
+	*	misma llave primero se queda la suya, que es identica.
+	**/
+	void Insert(const SkinningCacheKey &key, vector<Vertex> *vertices)
+	{
+		EnterCriticalSection(&lock);
+
+		if (entryIndex.find(key) == entryIndex.end())
+		{
+			entries.push_front(SkinningCacheEntry());
+
+			SkinningCacheEntry &entry = entries.front();
+			entry.key = key;
+			entry.pins = 0;
+			entry.vertices.swap(*vertices);
+
+			entryIndex[key] = entries.begin();
+			stats.numEntries++;
+			stats.memoryUsage += GetEntryBytes(entry);
+
+			Evict();
+		}
+
+		LeaveCriticalSection(&lock);
+	}
+
+	// Desaloja todo lo que no este fijado; los contadores se conservan
+	void Clear()
+	{
+		EnterCriticalSection(&lock);
+
+		for (EntryIterator it = entries.begin(); it != entries.end(); )
+		{
+			if (it->pins == 0)
+				it = Remove(it);
+			else
+				++it;
+		}
+
+		LeaveCriticalSection(&lock);
+	}
+
+	SkinningCacheStats GetStats()
+	{
+		EnterCriticalSection(&lock);
+		SkinningCacheStats current = stats;
+		LeaveCriticalSection(&lock);
+
+		return current;
+	}
+
+	// Reinicia aciertos, fallos y desalojos; las entradas se quedan
+	void ResetStats()
+	{
+		EnterCriticalSection(&lock);
+		stats.hits = stats.misses = stats.evictions = 0;
+		LeaveCriticalSection(&lock);
+	}
+
+private:
+	static size_t GetEntryBytes(const SkinningCacheEntry &entry)
+	{
+		return sizeof(SkinningCacheEntry) + entry.vertices.capacity() * sizeof(Vertex);
+	}
+
+	EntryIterator Remove(EntryIterator it)
+	{
+		stats.numEntries--;
+		stats.memoryUsage -= GetEntryBytes(*it);
+		entryIndex.erase(it->key);
+
+		return entries.erase(it);
+	}
+
+	// Desde la usada hace mas tiempo, saltando las fijadas; se llama con el candado tomado
+	void Evict()
+	{
+		EntryIterator it = entries.end();
+
+		while (stats.memoryUsage > memoryBudget && it != entries.begin())
+		{
+			--it;
+
+			if (it->pins == 0)
+			{
+				it = Remove(it);
+				stats.evictions++;
+			}
+		}
+	}
+};
+
+#endif
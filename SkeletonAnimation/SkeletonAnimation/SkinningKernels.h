@@ -0,0 +1,364 @@
+#ifndef _SKINNINGKERNELS_H_INCLUDED
+#define _SKINNINGKERNELS_H_INCLUDED
+
+#pragma region Includes
+
+#include <intrin.h>
+#include <emmintrin.h>
+#include "Structs.h"
+
+// Los intrinsics de AVX y _xgetbv llegaron con el SP1 de Visual Studio 2010;
+// sin el solo se compilan el kernel escalar y el de SSE2
+#if (defined(_MSC_FULL_VER) && _MSC_FULL_VER >= 160040219) || defined(__AVX__)
+#define SKINNING_HAS_AVX
+#include <immintrin.h>
+#endif
+
+#pragma endregion
+
+enum SkinningISA
+{
+	SKINNING_ISA_SCALAR,
+	SKINNING_ISA_SSE2,
+	SKINNING_ISA_AVX
+};
+
+/**
+*	Transformacion afin de 3x4 guardada por renglones: los tres primeros
+*	terminos de cada renglon son la rotacion y w es la traslacion. Son 12
+*	floats contiguos y cada renglon cabe en un registro de SSE.
+**/
+struct SkinMatrix
+{
+	XMFLOAT4 rows[3];
+};
+
+#pragma region CPU detection
+
+const char* GetSkinningISAName(SkinningISA isa)
+{
+	switch (isa)
+	{
+	case SKINNING_ISA_SSE2:		return "sse2";
+	case SKINNING_ISA_AVX:		return "avx";
+	default:					return "scalar";
+	}
+}
+
+SkinningISA DetectSkinningISA()
+{
+	int info[4];
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+
+	if (!hasSSE2)
+		return SKINNING_ISA_SCALAR;
+
+#ifdef SKINNING_HAS_AVX
+	// Ademas del CPU, el sistema operativo debe guardar los registros YMM al cambiar de hilo
+	if (hasOSXSAVE && hasAVX && (_xgetbv(0) & 6) == 6)
+		return SKINNING_ISA_AVX;
+#endif
+
+	return SKINNING_ISA_SSE2;
+}
+
+// La deteccion se hace una sola vez; si dos hilos llegan a la vez ambos escriben el mismo valor
+SkinningISA GetSupportedSkinningISA()
+{
+	static int supportedISA = -1;
+
+	if (supportedISA < 0)
+		supportedISA = DetectSkinningISA();
+
+	return (SkinningISA)supportedISA;
+}
+
+#pragma endregion
+
+#pragma region Kernels
+
+/**
+*	Los tres kernels calculan lo mismo en el mismo orden (sin FMA), asi que
+*	producen vertices identicos. Procesan los vertices [first, first + count)
+*	de las streams; first debe ser multiplo de SKINNING_STREAM_PADDING para
+*	que los bloques de 4 u 8 vertices no se salgan del relleno. Escriben
+*	la posicion y normal transformadas en output[first..].
+*
+*	Cada kernel se instancia para 1 a MAX_BONE_INFLUENCES influencias: con
+*	el numero fijo en compilacion el ciclo de influencias se desenrolla y
+*	no hay saltos que dependan de los datos. SkinVertexRuns elige la
+*	instancia de cada tramo de InfluenceStreams::runs. Sin withNormals
+*	solo se transforma la posicion y la normal queda en cero; la salida de
+*	marcos tangentes calcula su propia normal.
+**/
+
+template <int numInfluences, bool withNormals>
+void SkinVerticesScalar(const SkinMatrix *matrices, const InfluenceStreams &streams, int first, int count, Vertex *output)
+{
+	for (int i = first; i < first + count; i++)
+	{
+		float blended[3][4] = { { 0 } };
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			const SkinMatrix &matrix = matrices[streams.joints[k][i]];
+			float weight = streams.weights[k][i];
+
+			for (int r = 0; r < 3; r++)
+			{
+				blended[r][0] += matrix.rows[r].x * weight;
+				blended[r][1] += matrix.rows[r].y * weight;
+				blended[r][2] += matrix.rows[r].z * weight;
+				blended[r][3] += matrix.rows[r].w * weight;
+			}
+		}
+
+		float px = streams.positionX[i], py = streams.positionY[i], pz = streams.positionZ[i];
+		Vertex vertex;
+
+		vertex.position.x = blended[0][0] * px + blended[0][1] * py + blended[0][2] * pz + blended[0][3];
+		vertex.position.y = blended[1][0] * px + blended[1][1] * py + blended[1][2] * pz + blended[1][3];
+		vertex.position.z = blended[2][0] * px + blended[2][1] * py + blended[2][2] * pz + blended[2][3];
+		vertex.normal = XMFLOAT3(0, 0, 0);
+
+		if (withNormals)
+		{
+			float nx = streams.normalX[i], ny = streams.normalY[i], nz = streams.normalZ[i];
+
+			vertex.normal.x = blended[0][0] * nx + blended[0][1] * ny + blended[0][2] * nz;
+			vertex.normal.y = blended[1][0] * nx + blended[1][1] * ny + blended[1][2] * nz;
+			vertex.normal.z = blended[2][0] * nx + blended[2][1] * ny + blended[2][2] * nz;
+		}
+
+		output[i] = vertex;
+	}
+}
+
+/**
+*	Escribe los vertices de un bloque. Cada uno se arma en la pila y se
+*	escribe de una vez, porque output puede ser un vertex buffer mapeado
+*	(memoria write-combined) que no conviene leer ni escribir por partes.
+*	El ultimo bloque puede venir incompleto. Sin withNormals no se leen
+*	los renglones 3 a 5 y la normal se escribe en cero.
+**/
+void StoreSkinnedLanes(const float lanes[6][8], int numLanes, Vertex *output, bool withNormals = true)
+{
+	for (int l = 0; l < numLanes; l++)
+	{
+		Vertex vertex;
+		vertex.position = XMFLOAT3(lanes[0][l], lanes[1][l], lanes[2][l]);
+		vertex.normal = withNormals ? XMFLOAT3(lanes[3][l], lanes[4][l], lanes[5][l]) : XMFLOAT3(0, 0, 0);
+		output[l] = vertex;
+	}
+}
+
+/**
+*	Cuatro vertices por iteracion. Cada vertice mezcla sus renglones de
+*	matriz completos (un registro por renglon) y al final se transponen
+*	los de los 4 vertices para transformar posiciones y normales en SoA.
+*	Transponer una vez por bloque en lugar de una vez por influencia es lo
+*	que hace a este kernel mas rapido que leer las matrices por columnas.
+**/
+template <int numInfluences, bool withNormals>
+void SkinVerticesSSE2(const SkinMatrix *matrices, const InfluenceStreams &streams, int first, int count, Vertex *output)
+{
+	int end = first + count;
+
+	for (int i = first; i < end; i += 4)
+	{
+		__m128 rows[4][3];
+		for (int v = 0; v < 4; v++)
+			rows[v][0] = rows[v][1] = rows[v][2] = _mm_setzero_ps();
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			const int *joints = &streams.joints[k][i];
+			const float *weights = &streams.weights[k][i];
+
+			for (int v = 0; v < 4; v++)
+			{
+				const SkinMatrix &matrix = matrices[joints[v]];
+				__m128 weight = _mm_set1_ps(weights[v]);
+
+				rows[v][0] = _mm_add_ps(rows[v][0], _mm_mul_ps(_mm_loadu_ps(&matrix.rows[0].x), weight));
+				rows[v][1] = _mm_add_ps(rows[v][1], _mm_mul_ps(_mm_loadu_ps(&matrix.rows[1].x), weight));
+				rows[v][2] = _mm_add_ps(rows[v][2], _mm_mul_ps(_mm_loadu_ps(&matrix.rows[2].x), weight));
+			}
+		}
+
+		__m128 px = _mm_loadu_ps(&streams.positionX[i]);
+		__m128 py = _mm_loadu_ps(&streams.positionY[i]);
+		__m128 pz = _mm_loadu_ps(&streams.positionZ[i]);
+		__m128 nx = _mm_setzero_ps(), ny = nx, nz = nx;
+
+		if (withNormals)
+		{
+			nx = _mm_loadu_ps(&streams.normalX[i]);
+			ny = _mm_loadu_ps(&streams.normalY[i]);
+			nz = _mm_loadu_ps(&streams.normalZ[i]);
+		}
+
+		float lanes[6][8];
+
+		for (int r = 0; r < 3; r++)
+		{
+			__m128 column0 = rows[0][r], column1 = rows[1][r], column2 = rows[2][r], column3 = rows[3][r];
+			_MM_TRANSPOSE4_PS(column0, column1, column2, column3);
+
+			__m128 position = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, px), _mm_mul_ps(column1, py)), _mm_mul_ps(column2, pz)), column3);
+			_mm_storeu_ps(lanes[r], position);
+
+			if (withNormals)
+			{
+				__m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, nx), _mm_mul_ps(column1, ny)), _mm_mul_ps(column2, nz));
+				_mm_storeu_ps(lanes[r + 3], normal);
+			}
+		}
+
+		StoreSkinnedLanes(lanes, end - i < 4 ? end - i : 4, &output[i], withNormals);
+	}
+}
+
+#ifdef SKINNING_HAS_AVX
+
+/**
+*	Ocho vertices por iteracion con el mismo esquema que el kernel SSE2:
+*	cada registro de 256 bits lleva el renglon del vertice v en la mitad
+*	baja y el del vertice v + 4 en la alta. Las transposiciones de AVX
+*	trabajan por mitades, asi que las columnas quedan en el orden de las
+*	streams sin permutaciones extra. Leer las matrices con gathers de AVX2
+*	resulto mas lento que estas cargas de 128 bits.
+**/
+template <int numInfluences, bool withNormals>
+void SkinVerticesAVX(const SkinMatrix *matrices, const InfluenceStreams &streams, int first, int count, Vertex *output)
+{
+	int end = first + count;
+
+	for (int i = first; i < end; i += 8)
+	{
+		__m256 rows[4][3];
+		for (int v = 0; v < 4; v++)
+			rows[v][0] = rows[v][1] = rows[v][2] = _mm256_setzero_ps();
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			const int *joints = &streams.joints[k][i];
+			__m256 weights = _mm256_loadu_ps(&streams.weights[k][i]);
+			__m256 weight[4];
+
+			// Peso del vertice v en la mitad baja y del v + 4 en la alta
+			weight[0] = _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(0, 0, 0, 0));
+			weight[1] = _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(1, 1, 1, 1));
+			weight[2] = _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(2, 2, 2, 2));
+			weight[3] = _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(3, 3, 3, 3));
+
+			for (int v = 0; v < 4; v++)
+			{
+				const SkinMatrix &low = matrices[joints[v]];
+				const SkinMatrix &high = matrices[joints[v + 4]];
+
+				for (int r = 0; r < 3; r++)
+				{
+					__m256 row = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&low.rows[r].x)), _mm_loadu_ps(&high.rows[r].x), 1);
+					rows[v][r] = _mm256_add_ps(rows[v][r], _mm256_mul_ps(row, weight[v]));
+				}
+			}
+		}
+
+		__m256 px = _mm256_loadu_ps(&streams.positionX[i]);
+		__m256 py = _mm256_loadu_ps(&streams.positionY[i]);
+		__m256 pz = _mm256_loadu_ps(&streams.positionZ[i]);
+		__m256 nx = _mm256_setzero_ps(), ny = nx, nz = nx;
+
+		if (withNormals)
+		{
+			nx = _mm256_loadu_ps(&streams.normalX[i]);
+			ny = _mm256_loadu_ps(&streams.normalY[i]);
+			nz = _mm256_loadu_ps(&streams.normalZ[i]);
+		}
+
+		float lanes[6][8];
+
+		for (int r = 0; r < 3; r++)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(rows[0][r], rows[1][r]);
+			__m256 t1 = _mm256_unpackhi_ps(rows[0][r], rows[1][r]);
+			__m256 t2 = _mm256_unpacklo_ps(rows[2][r], rows[3][r]);
+			__m256 t3 = _mm256_unpackhi_ps(rows[2][r], rows[3][r]);
+
+			__m256 column0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 column1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 column2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 column3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+			__m256 position = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(column0, px), _mm256_mul_ps(column1, py)), _mm256_mul_ps(column2, pz)), column3);
+			_mm256_storeu_ps(lanes[r], position);
+
+			if (withNormals)
+			{
+				__m256 normal = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(column0, nx), _mm256_mul_ps(column1, ny)), _mm256_mul_ps(column2, nz));
+				_mm256_storeu_ps(lanes[r + 3], normal);
+			}
+		}
+
+		StoreSkinnedLanes(lanes, end - i < 8 ? end - i : 8, &output[i], withNormals);
+	}
+
+	// Evita la penalizacion de mezclar AVX con el codigo SSE que sigue
+	_mm256_zeroupper();
+}
+
+#endif
+
+template <int numInfluences>
+void SkinVerticesWithISA(SkinningISA isa, const SkinMatrix *matrices, const InfluenceStreams &streams, int first, int count, Vertex *output, bool withNormals)
+{
+	switch (isa)
+	{
+#ifdef SKINNING_HAS_AVX
+	case SKINNING_ISA_AVX:
+		if (withNormals)	SkinVerticesAVX<numInfluences, true>(matrices, streams, first, count, output);
+		else				SkinVerticesAVX<numInfluences, false>(matrices, streams, first, count, output);
+		break;
+#endif
+	case SKINNING_ISA_SSE2:
+		if (withNormals)	SkinVerticesSSE2<numInfluences, true>(matrices, streams, first, count, output);
+		else				SkinVerticesSSE2<numInfluences, false>(matrices, streams, first, count, output);
+		break;
+	default:
+		if (withNormals)	SkinVerticesScalar<numInfluences, true>(matrices, streams, first, count, output);
+		else				SkinVerticesScalar<numInfluences, false>(matrices, streams, first, count, output);
+		break;
+	}
+}
+
+// Parte [first, first + count) en los tramos de streams.runs; cada tramo empieza en un multiplo de SKINNING_STREAM_PADDING
+void SkinVertexRuns(SkinningISA isa, const SkinMatrix *matrices, const InfluenceStreams &streams, int first, int count, Vertex *output, bool withNormals = true)
+{
+	int end = first + count;
+
+	for (int i = 0; i < (int)streams.runs.size(); i++)
+	{
+		const InfluenceRun &run = streams.runs[i];
+		int runFirst = run.first > first ? run.first : first;
+		int runEnd = run.first + run.count < end ? run.first + run.count : end;
+
+		if (runFirst >= runEnd)
+			continue;
+
+		switch (run.numInfluences)
+		{
+		case 1:		SkinVerticesWithISA<1>(isa, matrices, streams, runFirst, runEnd - runFirst, output, withNormals); break;
+		case 2:		SkinVerticesWithISA<2>(isa, matrices, streams, runFirst, runEnd - runFirst, output, withNormals); break;
+		case 3:		SkinVerticesWithISA<3>(isa, matrices, streams, runFirst, runEnd - runFirst, output, withNormals); break;
+		default:	SkinVerticesWithISA<MAX_BONE_INFLUENCES>(isa, matrices, streams, runFirst, runEnd - runFirst, output, withNormals); break;
+		}
+	}
+}
+
+#pragma endregion
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _SKINNINGSINK_H_INCLUDED
+#define _SKINNINGSINK_H_INCLUDED
+
+#pragma region Includes
+
+#include <d3d11.h>
+#include <map>
+#include <vector>
+#include "Structs.h"
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+/**
+*	Destino de los vertices de skinning. BeginMesh regresa donde escribir
+*	los mesh->vertices.size() vertices de una malla y EndMesh indica que
+*	ya estan completos. Segun el formato de salida del modelo se escriben
+*	Vertex, QuantizedVertex o TangentFrameVertex, asi que el destino debe
+*	tener espacio para Vertex, el mas grande. Ambos se llaman desde el
+*	hilo que actualiza el modelo, antes y despues de repartir el skinning
+*	entre los hilos del pool. Los kernels escriben cada Vertex completo,
+*	asi que el destino puede empezar con basura. Si BeginMesh regresa
+*	NULL la malla no se procesa.
+**/
+class SkinningSink
+{
+public:
+	virtual ~SkinningSink() {}
+	virtual void* BeginMesh(Mesh *mesh) = 0;
+	virtual void EndMesh(Mesh *mesh) = 0;
+};
+
+// Escribe directamente en el vertex buffer dinamico de cada malla, sin pasar por una copia en memoria
+class D3D11VertexSink : public SkinningSink
+{
+	ID3D11DeviceContext *deviceContext;
+
+public:
+	D3D11VertexSink(ID3D11DeviceContext *deviceContext)
+	{
+		this->deviceContext = deviceContext;
+	}
+
+	void* BeginMesh(Mesh *mesh)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedVertexBuffer;
+
+		if (deviceContext == NULL || FAILED(deviceContext->Map(mesh->vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedVertexBuffer)))
+			return NULL;
+
+		return mappedVertexBuffer.pData;
+	}
+
+	void EndMesh(Mesh *mesh)
+	{
+		deviceContext->Unmap(mesh->vertexBuffer, 0);
+	}
+};
+
+// Backend solo de CPU para pruebas y herramientas: guarda los vertices de cada malla en su propio arreglo
+class CPUVertexSink : public SkinningSink
+{
+	map<const Mesh*, vector<Vertex> > outputs;
+	int numCompletedMeshes;
+
+public:
+	CPUVertexSink()
+	{
+		numCompletedMeshes = 0;
+	}
+
+	void* BeginMesh(Mesh *mesh)
+	{
+		vector<Vertex> &output = outputs[mesh];
+		output.resize(mesh->vertices.size());
+
+		return output.empty() ? NULL : &output[0];
+	}
+
+	void EndMesh(Mesh *mesh)
+	{
+		numCompletedMeshes++;
+	}
+
+	int GetNumCompletedMeshes() const { return numCompletedMeshes; }
+
+	// NULL si la malla nunca paso por este destino
+	const vector<Vertex>* GetVertices(const Mesh *mesh) const
+	{
+		map<const Mesh*, vector<Vertex> >::const_iterator output = outputs.find(mesh);
+		return output == outputs.end() ? NULL : &output->second;
+	}
+
+	// Los mismos bytes vistos como salida cuantizada
+	const QuantizedVertex* GetQuantizedVertices(const Mesh *mesh) const
+	{
+		const vector<Vertex> *output = GetVertices(mesh);
+		return output == NULL || output->empty() ? NULL : (const QuantizedVertex*)&(*output)[0];
+	}
+
+	// O como salida de marcos tangentes
+	const TangentFrameVertex* GetTangentFrameVertices(const Mesh *mesh) const
+	{
+		const vector<Vertex> *output = GetVertices(mesh);
+		return output == NULL || output->empty() ? NULL : (const TangentFrameVertex*)&(*output)[0];
+	}
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define _STRUCTS_H_INCLUDED
 
 #include <string>
+#include <vector>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <xnamath.h>
@@ -18,13 +19,41 @@ struct Joint
 	XMFLOAT4 orientation;
 };
 
+// Stream dinamico de la GPU (slot 0): lo escribe el skinning y se sube en cada frame animado
 struct Vertex
 {
 	XMFLOAT3 position;
-	XMFLOAT2 uv;
 	XMFLOAT3 normal;
-	XMFLOAT3 tangent;
+};
+
+// Stream estatico de la GPU (slot 1): se sube una sola vez al crear los vertex buffers.
+// tangent es la tangente de bind pose segun las coordenadas de textura; w es el signo de la bitangente.
+struct StaticVertex
+{
+	XMFLOAT2 uv;
+	XMFLOAT4 tangent;
+};
+
+// Stream dinamico compacto: posicion UNORM de 16 bits dentro de los bounds del frame (w sin usar)
+// y normal en codificacion octaedrica como dos SNORM de 16 bits. Mide la mitad de Vertex.
+struct QuantizedVertex
+{
+	unsigned short position[4];
+	short normal[2];
+};
+
+// Stream dinamico con el marco tangente completo: posicion y un cuaternion SNORM de 16 bits que
+// lleva x, y, z a la tangente, la bitangente y la normal. El signo de w es el de la bitangente.
+struct TangentFrameVertex
+{
+	XMFLOAT3 position;
+	short tangentFrame[4];
+};
 
+// Datos del archivo MD5 que solo usa el CPU; nunca se suben. vertexIndex es el indice en el
+// .md5mesh y se conserva aunque los vertices se reordenen al cargar.
+struct VertexInfo
+{
 	int vertexIndex;
 	int startWeight;
 	int countWeight;
@@ -46,6 +75,88 @@ struct Weight
 	XMFLOAT3 normal;
 };
 
+#define MAX_BONE_INFLUENCES 4
+
+// SKINNING_WEIGHTS rota cada peso del MD5 con la orientacion de su joint.
+// SKINNING_MATRIX_PALETTE mezcla hasta MAX_BONE_INFLUENCES matrices de 3x4 por vertice.
+// SKINNING_DUAL_QUATERNION mezcla las mismas influencias como cuaterniones duales unitarios: la
+// transformacion de cada vertice queda rigida (sin joints colapsados) a cambio de una normalizacion.
+enum SkinningMethod
+{
+	SKINNING_WEIGHTS,
+	SKINNING_MATRIX_PALETTE,
+	SKINNING_DUAL_QUATERNION
+};
+
+// VERTEX_OUTPUT_FLOAT escribe Vertex (floats de 32 bits) en el stream dinamico.
+// VERTEX_OUTPUT_QUANTIZED escribe QuantizedVertex, que decodifica VS_Main_Quantized en TestShader.fx.
+// VERTEX_OUTPUT_TANGENT_FRAME escribe TangentFrameVertex para normal mapping (VS_Main_TangentFrame).
+enum VertexOutputFormat
+{
+	VERTEX_OUTPUT_FLOAT,
+	VERTEX_OUTPUT_QUANTIZED,
+	VERTEX_OUTPUT_TANGENT_FRAME
+};
+
+// Vertices de bind pose con sus joints mas pesados, en streams paralelos (SoA) para que los
+// kernels de skinning lean varios vertices a la vez. Las influencias van de mayor a menor peso
+// y las que sobran tienen peso 0. Los streams se rellenan con vertices de peso 0 hasta un
+// multiplo de SKINNING_STREAM_PADDING; numVertices es el numero real.
+#define SKINNING_STREAM_PADDING 8
+
+// Vertices consecutivos con el mismo numero de influencias. first es multiplo de
+// SKINNING_STREAM_PADDING; un bloque que abarca dos numeros de influencias usa el mayor.
+struct InfluenceRun
+{
+	int first;
+	int count;
+	int numInfluences;
+};
+
+struct InfluenceStreams
+{
+	int numVertices;
+	int numInfluences;
+	vector<float> positionX, positionY, positionZ;
+	vector<float> normalX, normalY, normalZ;
+	vector<int> joints[MAX_BONE_INFLUENCES];
+	vector<float> weights[MAX_BONE_INFLUENCES];
+	vector<InfluenceRun> runs;
+	int numPrunedVertices;
+
+	// Marco tangente de bind pose de cada vertice como cuaternion unitario (ver TangentFrameVertex)
+	vector<float> frameX, frameY, frameZ, frameW;
+
+	InfluenceStreams()
+	{
+		numVertices = 0;
+		numInfluences = 0;
+		numPrunedVertices = 0;
+	}
+};
+
+// Desplazamiento de los vertices al limitar las influencias, medido en todos los frames de un
+// clip contra el skinning con todos los pesos del MD5. Las distancias estan en unidades del modelo.
+struct InfluencePruningStats
+{
+	int maxInfluences;
+	int numVertices;
+	int numPrunedVertices;
+	int numFrames;
+	float maxDisplacement;
+	float averageDisplacement;
+};
+
+// Un nivel de detalle de un modelo (todas sus mallas). error acota cuanto se aleja la superficie
+// del nivel de la bind pose del nivel 0, en unidades del modelo; el nivel 0 tiene error 0.
+struct DetailLevelStats
+{
+	int numVertices;
+	int numTriangles;
+	int numWeights;
+	float error;
+};
+
 struct Mesh
 {
 	string shader;
@@ -53,17 +164,30 @@ struct Mesh
 	int numTriangles;
 	int numWeights;
 	vector<Vertex> vertices;
+	vector<QuantizedVertex> quantizedVertices;
+	vector<TangentFrameVertex> tangentFrameVertices;
+	vector<StaticVertex> staticVertices;
+	vector<VertexInfo> vertexInfo;
 	vector<Triangle> triangles;
 	vector<Weight> weights;
 	vector<int> indices;
+	InfluenceStreams influences;
 
 	ID3D11Buffer *vertexBuffer;
+	ID3D11Buffer *staticVertexBuffer;
 	ID3D11Buffer *indexBuffer;
+	// DXGI_FORMAT_R16_UINT si todos los indices caben en 16 bits, si no DXGI_FORMAT_R32_UINT
+	DXGI_FORMAT indexFormat;
 	ID3D11ShaderResourceView *colorMap;
+	ID3D11ShaderResourceView *normalMap;
 
 	~Mesh()
 	{
 		vertices.clear();
+		quantizedVertices.clear();
+		tangentFrameVertices.clear();
+		staticVertices.clear();
+		vertexInfo.clear();
 		triangles.clear();
 		weights.clear();
 	}
@@ -80,6 +204,34 @@ struct MatrixBuffer
 
 #pragma region Animation Substructures
 
+// MD5_LOAD_PARALLEL lee los bloques de frames y arma los esqueletos de los frames en el pool compartido.
+// MD5_LOAD_SKIP_CACHE siempre lee los textos y nunca lee ni escribe los binarios compilados.
+// MD5_LOAD_SAMPLE_LOCAL guarda solo los componentes animados y arma cada pose al muestrearla.
+// MD5_LOAD_MAX_INFLUENCES(k) deja los k joints mas pesados de cada vertice (1 a MAX_BONE_INFLUENCES)
+// y renormaliza sus pesos; sin el, un vertice conserva hasta MAX_BONE_INFLUENCES.
+// MD5_LOAD_KEEP_FILE_ORDER no reordena los triangulos y vertices del .md5mesh para el vertex cache
+// y la lectura (tampoco usa el binario compilado, que guarda el orden optimizado).
+// MD5_LOAD_KEEP_DUPLICATES deja separados los vertices con la misma UV y los mismos pesos
+// (tampoco usa el binario compilado).
+// MD5_LOAD_VERIFY_SOURCE tambien calcula el hash del .md5anim antes de confiar en un .md5animbin;
+// por omision solo se comparan su tamano y su fecha de modificacion.
+// MD5_LOAD_TRUST_SOURCE_STAMP no calcula el hash de los textos detras de un .md5meshbin o un
+// .md5bake, que si no siempre se calcula, y compara solo su tamano y su fecha de modificacion.
+enum MD5LoadFlags
+{
+	MD5_LOAD_SERIAL				= 0,
+	MD5_LOAD_PARALLEL			= 1,
+	MD5_LOAD_SKIP_CACHE			= 2,
+	MD5_LOAD_SAMPLE_LOCAL		= 4,
+	MD5_LOAD_KEEP_FILE_ORDER	= 8,
+	MD5_LOAD_KEEP_DUPLICATES	= 16,
+	MD5_LOAD_VERIFY_SOURCE		= 32,
+	MD5_LOAD_TRUST_SOURCE_STAMP	= 64
+};
+
+#define MD5_LOAD_MAX_INFLUENCES(k)			((unsigned int)(k) << 8)
+#define MD5_LOAD_GET_MAX_INFLUENCES(flags)	(((flags) >> 8) & 0xF)
+
 struct HierarchyInfo
 {
 	string name;
@@ -104,7 +256,6 @@ struct Frame
 {
 	int frameIndex;
 	vector<float> parameters;
-	vector<Joint> skeleton;
 };
 
 
@@ -0,0 +1,365 @@
+#ifndef _TANGENTFRAMES_H_INCLUDED
+#define _TANGENTFRAMES_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <xnamath.h>
+#include "Structs.h"
+#include "DualQuaternionSkinning.h"
+#include "VertexQuantization.h"
+
+#pragma endregion
+
+// Menor |w| que se escribe: con 16 bits un w de 0 perderia el signo de la bitangente
+#define TANGENT_FRAME_MIN_W		(1.0f / QUANTIZED_NORMAL_STEPS)
+
+#pragma region Load time
+
+/**
+*	Tangente de cada vertice en bind pose a partir de las coordenadas de
+*	textura, ortogonalizada contra la normal que producen los skinnings
+*	(la opuesta a mesh->vertices[i].normal, ver BuildInfluences). En w
+*	queda el signo de la bitangente para las caras con la textura
+*	espejeada. Se llama despues de ComputeNormals.
+**/
+void ComputeTangents(Mesh *mesh)
+{
+	int numVertices = mesh->vertices.size();
+	vector<XMFLOAT3> tangents(numVertices, XMFLOAT3(0, 0, 0));
+	vector<XMFLOAT3> bitangents(numVertices, XMFLOAT3(0, 0, 0));
+
+	for (int i = 0; i < (int)mesh->triangles.size(); i++)
+	{
+		const int *indices = mesh->triangles[i].vertexIndices;
+		const XMFLOAT3 &p0 = mesh->vertices[indices[0]].position;
+		const XMFLOAT3 &p1 = mesh->vertices[indices[1]].position;
+		const XMFLOAT3 &p2 = mesh->vertices[indices[2]].position;
+		const XMFLOAT2 &uv0 = mesh->staticVertices[indices[0]].uv;
+		const XMFLOAT2 &uv1 = mesh->staticVertices[indices[1]].uv;
+		const XMFLOAT2 &uv2 = mesh->staticVertices[indices[2]].uv;
+
+		XMFLOAT3 edge1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		XMFLOAT3 edge2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+		float du1 = uv1.x - uv0.x, dv1 = uv1.y - uv0.y;
+		float du2 = uv2.x - uv0.x, dv2 = uv2.y - uv0.y;
+		float determinant = du1 * dv2 - du2 * dv1;
+
+		// Triangulo sin area en la textura: no aporta direccion
+		if (fabsf(determinant) < 1e-12f)
+			continue;
+
+		float r = 1.0f / determinant;
+		XMFLOAT3 tangent((edge1.x * dv2 - edge2.x * dv1) * r, (edge1.y * dv2 - edge2.y * dv1) * r, (edge1.z * dv2 - edge2.z * dv1) * r);
+		XMFLOAT3 bitangent((edge2.x * du1 - edge1.x * du2) * r, (edge2.y * du1 - edge1.y * du2) * r, (edge2.z * du1 - edge1.z * du2) * r);
+
+		for (int k = 0; k < 3; k++)
+		{
+			XMFLOAT3 &vertexTangent = tangents[indices[k]];
+			XMFLOAT3 &vertexBitangent = bitangents[indices[k]];
+			vertexTangent = XMFLOAT3(vertexTangent.x + tangent.x, vertexTangent.y + tangent.y, vertexTangent.z + tangent.z);
+			vertexBitangent = XMFLOAT3(vertexBitangent.x + bitangent.x, vertexBitangent.y + bitangent.y, vertexBitangent.z + bitangent.z);
+		}
+	}
+
+	for (int i = 0; i < numVertices; i++)
+	{
+		XMVECTOR normal = XMVector3Normalize(XMVectorNegate(XMLoadFloat3(&mesh->vertices[i].normal)));
+		XMVECTOR tangent = XMLoadFloat3(&tangents[i]);
+
+		// Gram-Schmidt; si no quedo tangente se usa cualquier perpendicular a la normal
+		tangent = XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent)));
+
+		if (XMVectorGetX(XMVector3LengthSq(tangent)) < 1e-12f)
+		{
+			XMVECTOR axis = fabsf(XMVectorGetX(normal)) < 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+			tangent = XMVector3Cross(axis, normal);
+		}
+
+		tangent = XMVector3Normalize(tangent);
+
+		float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), XMLoadFloat3(&bitangents[i]))) < 0 ? -1.0f : 1.0f;
+		XMStoreFloat4(&mesh->staticVertices[i].tangent, XMVectorSetW(tangent, handedness));
+	}
+}
+
+/**
+*	Cuaternion que lleva x, y, z a la tangente, la bitangente y la normal
+*	(misma convencion que DualQuaternion). w se deja con el signo de la
+*	bitangente y nunca por debajo de TANGENT_FRAME_MIN_W, como lo espera
+*	VS_Main_TangentFrame.
+**/
+XMFLOAT4 MakeTangentFrame(const XMFLOAT3 &normal, const XMFLOAT4 &tangent)
+{
+	XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normal));
+	XMVECTOR t = XMVector3Normalize(XMVectorSubtract(XMLoadFloat4(&tangent), XMVectorMultiply(n, XMVector3Dot(n, XMLoadFloat4(&tangent)))));
+	XMVECTOR b = XMVector3Cross(n, t);
+
+	XMFLOAT3 tx, by, nz;
+	XMStoreFloat3(&tx, t);
+	XMStoreFloat3(&by, b);
+	XMStoreFloat3(&nz, n);
+
+	// Matriz con columnas t, b, n convertida a cuaternion por su componente dominante
+	float m00 = tx.x, m01 = by.x, m02 = nz.x;
+	float m10 = tx.y, m11 = by.y, m12 = nz.y;
+	float m20 = tx.z, m21 = by.z, m22 = nz.z;
+	float trace = m00 + m11 + m22;
+	XMFLOAT4 frame;
+
+	if (trace > 0)
+	{
+		float s = 0.5f / sqrtf(trace + 1.0f);
+		frame = XMFLOAT4((m21 - m12) * s, (m02 - m20) * s, (m10 - m01) * s, 0.25f / s);
+	}
+	else if (m00 > m11 && m00 > m22)
+	{
+		float s = 2.0f * sqrtf(1.0f + m00 - m11 - m22);
+		frame = XMFLOAT4(0.25f * s, (m01 + m10) / s, (m02 + m20) / s, (m21 - m12) / s);
+	}
+	else if (m11 > m22)
+	{
+		float s = 2.0f * sqrtf(1.0f + m11 - m00 - m22);
+		frame = XMFLOAT4((m01 + m10) / s, 0.25f * s, (m12 + m21) / s, (m02 - m20) / s);
+	}
+	else
+	{
+		float s = 2.0f * sqrtf(1.0f + m22 - m00 - m11);
+		frame = XMFLOAT4((m02 + m20) / s, (m12 + m21) / s, 0.25f * s, (m10 - m01) / s);
+	}
+
+	float sign = tangent.w < 0 ? -1.0f : 1.0f;
+
+	if (frame.w < 0)
+		frame = XMFLOAT4(-frame.x, -frame.y, -frame.z, -frame.w);
+
+	if (frame.w < TANGENT_FRAME_MIN_W)
+		frame.w = TANGENT_FRAME_MIN_W;
+
+	return XMFLOAT4(frame.x * sign, frame.y * sign, frame.z * sign, frame.w * sign);
+}
+
+#pragma endregion
+
+#pragma region Skinning
+
+/**
+*	Gira el marco de cada vertice con la mezcla normalizada de las
+*	rotaciones de sus joints (la parte real de los cuaterniones duales de
+*	la paleta) y lo escribe junto con la posicion ya transformada. Es un
+*	producto de cuaterniones por vertice en lugar de girar normal y
+*	tangente por separado. Con dualQuaternions NULL el marco se queda en
+*	bind pose.
+**/
+template <int numInfluences>
+void SkinTangentFrames(const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count,
+					   const Vertex *positions, TangentFrameVertex *output)
+{
+	for (int i = first; i < first + count; i++)
+	{
+		float fx = streams.frameX[i], fy = streams.frameY[i], fz = streams.frameZ[i], fw = streams.frameW[i];
+		float qx = fx, qy = fy, qz = fz, qw = fw;
+
+		if (dualQuaternions != NULL)
+		{
+			const XMFLOAT4 &pivot = dualQuaternions[streams.joints[0][i]].real;
+			float rx = 0, ry = 0, rz = 0, rw = 0;
+
+			for (int k = 0; k < numInfluences; k++)
+			{
+				const XMFLOAT4 &rotation = dualQuaternions[streams.joints[k][i]].real;
+				float weight = streams.weights[k][i];
+
+				if (rotation.x * pivot.x + rotation.y * pivot.y + rotation.z * pivot.z + rotation.w * pivot.w < 0)
+					weight = -weight;
+
+				rx += rotation.x * weight;
+				ry += rotation.y * weight;
+				rz += rotation.z * weight;
+				rw += rotation.w * weight;
+			}
+
+			float length = sqrtf(rx * rx + ry * ry + rz * rz + rw * rw);
+			float inverseLength = length > 0 ? 1.0f / length : 0.0f;
+			rx *= inverseLength;
+			ry *= inverseLength;
+			rz *= inverseLength;
+			rw *= inverseLength;
+
+			qx = rw * fx + rx * fw + ry * fz - rz * fy;
+			qy = rw * fy - rx * fz + ry * fw + rz * fx;
+			qz = rw * fz + rx * fy - ry * fx + rz * fw;
+			qw = rw * fw - rx * fx - ry * fy - rz * fz;
+
+			// El producto puede invertir el signo; se regresa al de la bitangente
+			if ((qw < 0) != (fw < 0))
+			{
+				qx = -qx;
+				qy = -qy;
+				qz = -qz;
+				qw = -qw;
+			}
+
+			if (fabsf(qw) < TANGENT_FRAME_MIN_W)
+				qw = fw < 0 ? -TANGENT_FRAME_MIN_W : TANGENT_FRAME_MIN_W;
+		}
+
+		TangentFrameVertex vertex;
+		vertex.position = positions[i].position;
+		vertex.tangentFrame[0] = QuantizeSnorm16(qx);
+		vertex.tangentFrame[1] = QuantizeSnorm16(qy);
+		vertex.tangentFrame[2] = QuantizeSnorm16(qz);
+		vertex.tangentFrame[3] = QuantizeSnorm16(qw);
+
+		output[i] = vertex;
+	}
+}
+
+/**
+*	Cuatro vertices por iteracion, con las mismas operaciones y en el mismo
+*	orden que SkinTangentFrames, asi que escribe los mismos bytes. Las
+*	vueltas de hemisferio y de signo se hacen con mascaras en lugar de
+*	saltos, que con vertices de articulaciones se predicen mal.
+**/
+template <int numInfluences>
+void SkinTangentFramesSSE2(const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count,
+						   const Vertex *positions, TangentFrameVertex *output)
+{
+	int end = first + count;
+	__m128 zero = _mm_setzero_ps();
+	__m128 signBit = _mm_set1_ps(-0.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 minimumW = _mm_set1_ps(TANGENT_FRAME_MIN_W);
+	__m128 steps = _mm_set1_ps(QUANTIZED_NORMAL_STEPS);
+	__m128 half = _mm_set1_ps(0.5f);
+
+	for (int i = first; i < end; i += 4)
+	{
+		__m128 pivot[4], rotation[4];
+		for (int c = 0; c < 4; c++)
+			rotation[c] = zero;
+
+		for (int k = 0; k < numInfluences; k++)
+		{
+			__m128 real[4], dual[4];
+			LoadDualQuaternionLanes(dualQuaternions, &streams.joints[k][i], real, dual);
+
+			if (k == 0)
+			{
+				for (int c = 0; c < 4; c++)
+					pivot[c] = real[c];
+			}
+
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(real[0], pivot[0]), _mm_mul_ps(real[1], pivot[1])),
+											   _mm_mul_ps(real[2], pivot[2])), _mm_mul_ps(real[3], pivot[3]));
+			__m128 weight = _mm_loadu_ps(&streams.weights[k][i]);
+			weight = _mm_xor_ps(weight, _mm_and_ps(_mm_cmplt_ps(dot, zero), signBit));
+
+			for (int c = 0; c < 4; c++)
+				rotation[c] = _mm_add_ps(rotation[c], _mm_mul_ps(real[c], weight));
+		}
+
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rotation[0], rotation[0]), _mm_mul_ps(rotation[1], rotation[1])),
+														  _mm_mul_ps(rotation[2], rotation[2])), _mm_mul_ps(rotation[3], rotation[3])));
+		__m128 inverseLength = _mm_and_ps(_mm_cmpgt_ps(length, zero), _mm_div_ps(one, length));
+
+		__m128 rx = _mm_mul_ps(rotation[0], inverseLength), ry = _mm_mul_ps(rotation[1], inverseLength);
+		__m128 rz = _mm_mul_ps(rotation[2], inverseLength), rw = _mm_mul_ps(rotation[3], inverseLength);
+		__m128 fx = _mm_loadu_ps(&streams.frameX[i]), fy = _mm_loadu_ps(&streams.frameY[i]);
+		__m128 fz = _mm_loadu_ps(&streams.frameZ[i]), fw = _mm_loadu_ps(&streams.frameW[i]);
+
+		__m128 frame[4] =
+		{
+			_mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, fx), _mm_mul_ps(rx, fw)), _mm_mul_ps(ry, fz)), _mm_mul_ps(rz, fy)),
+			_mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, fy), _mm_mul_ps(rx, fz)), _mm_mul_ps(ry, fw)), _mm_mul_ps(rz, fx)),
+			_mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(rw, fz), _mm_mul_ps(rx, fy)), _mm_mul_ps(ry, fx)), _mm_mul_ps(rz, fw)),
+			_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(rw, fw), _mm_mul_ps(rx, fx)), _mm_mul_ps(ry, fy)), _mm_mul_ps(rz, fz))
+		};
+
+		// Signo de w al de la bitangente y |w| no menor que TANGENT_FRAME_MIN_W
+		__m128 bitangentSign = _mm_and_ps(_mm_cmplt_ps(fw, zero), signBit);
+		__m128 flip = _mm_and_ps(_mm_xor_ps(_mm_cmplt_ps(frame[3], zero), _mm_cmplt_ps(fw, zero)), signBit);
+		for (int c = 0; c < 4; c++)
+			frame[c] = _mm_xor_ps(frame[c], flip);
+
+		__m128 isSmall = _mm_cmplt_ps(_mm_andnot_ps(signBit, frame[3]), minimumW);
+		frame[3] = _mm_or_ps(_mm_and_ps(isSmall, _mm_or_ps(minimumW, bitangentSign)), _mm_andnot_ps(isSmall, frame[3]));
+
+		// Mismo redondeo que QuantizeSnorm16
+		int encoded[4][4];
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 value = _mm_min_ps(_mm_max_ps(frame[c], _mm_set1_ps(-1.0f)), one);
+			__m128 rounding = _mm_or_ps(half, _mm_and_ps(_mm_cmplt_ps(value, zero), signBit));
+			_mm_storeu_si128((__m128i*)encoded[c], _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, steps), rounding)));
+		}
+
+		int numLanes = end - i < 4 ? end - i : 4;
+		for (int l = 0; l < numLanes; l++)
+		{
+			TangentFrameVertex vertex;
+			vertex.position = positions[i + l].position;
+			vertex.tangentFrame[0] = (short)encoded[0][l];
+			vertex.tangentFrame[1] = (short)encoded[1][l];
+			vertex.tangentFrame[2] = (short)encoded[2][l];
+			vertex.tangentFrame[3] = (short)encoded[3][l];
+
+			output[i + l] = vertex;
+		}
+	}
+}
+
+template <int numInfluences>
+void SkinTangentFramesWithISA(SkinningISA isa, const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count,
+							  const Vertex *positions, TangentFrameVertex *output)
+{
+	if (isa >= SKINNING_ISA_SSE2 && dualQuaternions != NULL)
+		SkinTangentFramesSSE2<numInfluences>(dualQuaternions, streams, first, count, positions, output);
+	else
+		SkinTangentFrames<numInfluences>(dualQuaternions, streams, first, count, positions, output);
+}
+
+void SkinTangentFrameRange(SkinningISA isa, const DualQuaternion *dualQuaternions, const InfluenceStreams &streams, int first, int count,
+						   const Vertex *positions, TangentFrameVertex *output)
+{
+	int end = first + count;
+
+	for (int i = 0; i < (int)streams.runs.size(); i++)
+	{
+		const InfluenceRun &run = streams.runs[i];
+		int runFirst = run.first > first ? run.first : first;
+		int runEnd = run.first + run.count < end ? run.first + run.count : end;
+
+		if (runFirst >= runEnd)
+			continue;
+
+		switch (run.numInfluences)
+		{
+		case 1:		SkinTangentFramesWithISA<1>(isa, dualQuaternions, streams, runFirst, runEnd - runFirst, positions, output); break;
+		case 2:		SkinTangentFramesWithISA<2>(isa, dualQuaternions, streams, runFirst, runEnd - runFirst, positions, output); break;
+		case 3:		SkinTangentFramesWithISA<3>(isa, dualQuaternions, streams, runFirst, runEnd - runFirst, positions, output); break;
+		default:	SkinTangentFramesWithISA<MAX_BONE_INFLUENCES>(isa, dualQuaternions, streams, runFirst, runEnd - runFirst, positions, output); break;
+		}
+	}
+}
+
+#pragma endregion
+
+#pragma region Decoding
+
+// Lo mismo que VS_Main_TangentFrame: regresa la normal y la tangente (w = signo de la bitangente)
+void DecodeTangentFrame(const short *encoded, XMFLOAT3 *normal, XMFLOAT4 *tangent)
+{
+	XMVECTOR frame = XMQuaternionNormalize(XMVectorSet(DequantizeSnorm16(encoded[0]), DequantizeSnorm16(encoded[1]),
+													   DequantizeSnorm16(encoded[2]), DequantizeSnorm16(encoded[3])));
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, frame);
+
+	// Columnas x y z de la matriz de rotacion de q
+	*normal = XMFLOAT3(2 * (q.x * q.z + q.w * q.y), 2 * (q.y * q.z - q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y));
+	*tangent = XMFLOAT4(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.w * q.z), 2 * (q.x * q.z - q.w * q.y), encoded[3] < 0 ? -1.0f : 1.0f);
+}
+
+#pragma endregion
+
+#endif
@@ -1,4 +1,5 @@
 Texture2D colorMap : register(t0);
+Texture2D normalMap : register(t1);
 SamplerState colorSampler : register(s0);
 
 cbuffer constantBuffer : register(b0)
@@ -8,12 +9,36 @@ cbuffer constantBuffer : register(b0)
 	matrix projMatrix;
 };
 
+// Caja del frame para VS_Main_Quantized: posicion = boundsMin + pos * boundsExtent
+cbuffer quantizationBuffer : register(b1)
+{
+	float4 boundsMin;
+	float4 boundsExtent;
+};
+
 struct VS_Input 
 {
 	float4 pos : POSITION0;
 	float2 tex0 : TEXCOORD0;
 	float3 normal : NORMAL0;
-	float3 tangent : TANGENT0;
+	float4 tangent : TANGENT0;
+};
+
+// QuantizedVertex: posicion R16G16B16A16_UNORM y normal octaedrica R16G16_SNORM
+struct VS_QuantizedInput 
+{
+	float4 pos : POSITION0;
+	float2 tex0 : TEXCOORD0;
+	float2 normal : NORMAL0;
+	float4 tangent : TANGENT0;
+};
+
+// TangentFrameVertex: posicion float y el marco tangente como cuaternion R16G16B16A16_SNORM
+struct VS_TangentFrameInput 
+{
+	float4 pos : POSITION0;
+	float2 tex0 : TEXCOORD0;
+	float4 frame : NORMAL0;
 };
 
 struct PS_Input 
@@ -40,15 +65,58 @@ PS_Input VS_Main(VS_Input vertex)
 	return vsOut;
 }
 
-float4 PS_Main(PS_Input pix) : SV_TARGET
+// Misma cuenta que DecodeOctahedral en VertexQuantization.h
+float3 DecodeOctahedral(float2 encoded)
+{
+	float3 normal = float3(encoded.xy, 1.0f - abs(encoded.x) - abs(encoded.y));
+
+	if (normal.z < 0)
+		normal.xy = (1.0f - abs(encoded.yx)) * (encoded.xy >= 0 ? 1.0f : -1.0f);
+
+	return normalize(normal);
+}
+
+PS_Input VS_Main_Quantized(VS_QuantizedInput vertex)
+{
+	VS_Input decoded;
+	decoded.pos = float4(boundsMin.xyz + vertex.pos.xyz * boundsExtent.xyz, 1.0f);
+	decoded.tex0 = vertex.tex0;
+	decoded.normal = DecodeOctahedral(vertex.normal);
+	decoded.tangent = vertex.tangent;
+
+	return VS_Main(decoded);
+}
+
+// Misma cuenta que DecodeTangentFrame en TangentFrames.h; el signo de w es el de la bitangente
+PS_Input VS_Main_TangentFrame(VS_TangentFrameInput vertex)
+{
+	float4 q = normalize(vertex.frame);
+	float3 tangent = float3(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.w * q.z), 2 * (q.x * q.z - q.w * q.y));
+	float3 binormal = float3(2 * (q.x * q.y - q.w * q.z), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.w * q.x));
+	float3 normal = float3(2 * (q.x * q.z + q.w * q.y), 2 * (q.y * q.z - q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y));
+
+	VS_Input decoded;
+	decoded.pos = float4(vertex.pos.xyz, 1.0f);
+	decoded.tex0 = vertex.tex0;
+	decoded.normal = normal;
+	decoded.tangent = 0;
+
+	PS_Input vsOut = VS_Main(decoded);
+	vsOut.tangent = normalize(mul(tangent, (float3x3)worldMatrix));
+	vsOut.binormal = normalize(mul(binormal * (vertex.frame.w < 0 ? -1.0f : 1.0f), (float3x3)worldMatrix));
+
+	return vsOut;
+}
+
+float4 Shade(float2 tex0, float3 normal)
 {
 	float3 ambient = float3(0.1f, 0.1f, 0.1f);
 
-	float4 text = colorMap.Sample(colorSampler, pix.tex0);
+	float4 text = colorMap.Sample(colorSampler, tex0);
 
 	float3 DiffuseDirection = float3(0.0f, -1.0f, 0.2f);
 	float4 DiffuseColor = float4(1.0f, 1.0f, 1.0f, 1.0f);
-	float3 diffuse = dot(DiffuseDirection, pix.normal);
+	float3 diffuse = dot(DiffuseDirection, normal);
 	diffuse = saturate(diffuse*DiffuseColor.rgb);
 	diffuse = saturate(diffuse+ambient);
 
@@ -56,3 +124,17 @@ float4 PS_Main(PS_Input pix) : SV_TARGET
 
 	return fColor;
 }
+
+float4 PS_Main(PS_Input pix) : SV_TARGET
+{
+	return Shade(pix.tex0, pix.normal);
+}
+
+// Con el marco de VS_Main_TangentFrame la normal sale del mapa _local en espacio tangente
+float4 PS_Main_NormalMap(PS_Input pix) : SV_TARGET
+{
+	float3 mapped = normalMap.Sample(colorSampler, pix.tex0).xyz * 2.0f - 1.0f;
+	float3 normal = normalize(mapped.x * pix.tangent + mapped.y * pix.binormal + mapped.z * normalize(pix.normal));
+
+	return Shade(pix.tex0, normal);
+}
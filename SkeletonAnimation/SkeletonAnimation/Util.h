@@ -8,54 +8,180 @@
 #include <d3dcompiler.h>
 #include <DxErr.h>
 #include <string>
-#include <sstream>
+#include <vector>
+#include <fstream>
+#include <string.h>
+#include <stdlib.h>
 #include <math.h>
 #include <xnamath.h>
 #include "Structs.h"
 
 using namespace std;
 
-void SplitString(string inputString, int parts, string *output)
+#pragma region MD5 Tokenizer
+
+struct MD5Token
 {
-	stringstream inputStringStream(inputString);
+	const char *start;
+	int length;
 
-	int i = 0;
-	while (inputStringStream.good() && i < parts)
+	bool Equals(const char *text)
 	{
-		inputStringStream >> output[i];
-		i++;
+		return length == (int)strlen(text) && strncmp(start, text, length) == 0;
 	}
-}
-
-float GetWComponent(XMFLOAT4 q)
+};
+
+/**
+*	Cursor sobre el contenido completo de un archivo MD5.
+*	El archivo se lee una sola vez a un buffer contiguo y los tokens
+*	se regresan como apuntadores dentro de ese buffer, por lo que
+*	leer numeros o comparar palabras clave no reserva memoria.
+*	El cursor nunca avanza de linea por si solo: eso se hace con NextLine.
+**/
+class MD5Tokenizer
 {
-	float w = 1.0f - (q.x * q.x) - (q.y * q.y) - (q.z * q.z);
-	return w < 0 ? 0 : -sqrt(w);
-}
+	vector<char> buffer;
+	const char *cursor;
+	const char *end;
 
-Joint BuildMeshJointWithAnimationInfo(HierarchyInfo *sourceHierarchy, BaseFrameInfo *sourceBaseFrameInfo)
-{
-	Joint targetJoint;
-	targetJoint.name = sourceHierarchy->name;
-	targetJoint.parent = sourceHierarchy->parent;
-	targetJoint.position = sourceBaseFrameInfo->position;
-	targetJoint.orientation = sourceBaseFrameInfo->orientation;
+public:
+	MD5Tokenizer()
+	{
+		cursor = 0;
+		end = 0;
+	}
 
-	return targetJoint;
-}
+	// Vista sobre un rango de otro tokenizer; el buffer sigue siendo del original
+	MD5Tokenizer(const char *start, const char *end)
+	{
+		this->cursor = start;
+		this->end = end;
+	}
 
-void TrimString(string &input, string trimChar)
-{
-	int startIndex = 0;
-	
-	while (true)
+	bool Open(string path)
+	{
+		ifstream fileStream(path.c_str(), ifstream::in | ifstream::binary);
+
+		if (!fileStream.is_open())
+			return false;
+
+		fileStream.seekg(0, ifstream::end);
+		size_t size = (size_t)fileStream.tellg();
+		fileStream.seekg(0, ifstream::beg);
+
+		// El '\0' final garantiza que strtod/strtol siempre se detengan dentro del buffer
+		buffer.resize(size + 1);
+		if (size > 0)
+			fileStream.read(&buffer[0], size);
+		buffer[size] = '\0';
+
+		cursor = &buffer[0];
+		end = cursor + size;
+
+		return true;
+	}
+
+	bool IsAtEnd() { return cursor >= end; }
+
+	const char* GetCursor() { return cursor; }
+	const char* GetEnd() { return end; }
+
+	bool NextLine()
+	{
+		while (cursor < end && *cursor != '\n')
+			cursor++;
+
+		if (cursor < end)
+			cursor++;
+
+		return !IsAtEnd();
+	}
+
+	// Compara el resto de la linea actual (sin el salto de linea) contra el texto dado
+	bool LineEquals(const char *text)
+	{
+		const char *lineEnd = cursor;
+		while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+			lineEnd++;
+
+		int length = (int)(lineEnd - cursor);
+		return length == (int)strlen(text) && strncmp(cursor, text, length) == 0;
+	}
+
+	// Avanza hasta la linea siguiente a la que sea igual al texto dado
+	bool SkipToLine(const char *text)
+	{
+		while (!IsAtEnd())
+		{
+			if (LineEquals(text))
+			{
+				NextLine();
+				return true;
+			}
+
+			NextLine();
+		}
+
+		return false;
+	}
+
+	// Regresa un token de longitud 0 cuando la linea actual ya no tiene mas tokens
+	MD5Token NextToken()
 	{
-		startIndex = input.find(trimChar);
-		if (startIndex == string::npos)
-			break;
+		while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+			cursor++;
 
-		input.replace(startIndex, startIndex + trimChar.length(), "");
+		MD5Token token;
+		token.start = cursor;
+
+		while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+			cursor++;
+
+		token.length = (int)(cursor - token.start);
+		return token;
+	}
+
+	void SkipTokens(int count)
+	{
+		for (int i = 0; i < count; i++)
+			NextToken();
+	}
+
+	// Mismo resultado que atoi/atof sobre el token: un token faltante se lee como 0
+	int ReadInt()
+	{
+		MD5Token token = NextToken();
+		return token.length > 0 ? (int)strtol(token.start, NULL, 10) : 0;
 	}
+
+	float ReadFloat()
+	{
+		MD5Token token = NextToken();
+		return token.length > 0 ? (float)strtod(token.start, NULL) : 0;
+	}
+
+	string ReadQuotedString()
+	{
+		MD5Token token = NextToken();
+
+		if (token.length > 0 && token.start[0] == '"')
+		{
+			token.start++;
+			token.length--;
+		}
+		if (token.length > 0 && token.start[token.length - 1] == '"')
+			token.length--;
+
+		return string(token.start, token.length);
+	}
+};
+
+#pragma endregion
+
+float GetWComponent(XMFLOAT4 q)
+{
+	float w = 1.0f - (q.x * q.x) - (q.y * q.y) - (q.z * q.z);
+	return w < 0 ? 0 : -sqrt(w);
 }
 
 void GetMonitorResolution(int *width, int *height)
@@ -0,0 +1,176 @@
+#ifndef _VERTEXQUANTIZATION_H_INCLUDED
+#define _VERTEXQUANTIZATION_H_INCLUDED
+
+#pragma region Includes
+
+#include <math.h>
+#include <xnamath.h>
+#include "Structs.h"
+
+#pragma endregion
+
+// Pasos de los formatos R16G16B16A16_UNORM (posicion) y R16G16_SNORM (normal)
+#define QUANTIZED_POSITION_STEPS	65535.0f
+#define QUANTIZED_NORMAL_STEPS		32767.0f
+
+// Holgura de la caja de cada frame, como fraccion de su tamano por eje: al
+// interpolar entre dos frames la malla puede salirse un poco de ambas cajas
+#define QUANTIZATION_BOUNDS_MARGIN	0.02f
+
+/**
+*	Caja contra la que se cuantizan las posiciones de un frame:
+*	posicion = min + q * extent, con q en [0, 1]. Es lo que recibe el
+*	shader en quantizationBuffer para decodificar.
+**/
+struct QuantizationBounds
+{
+	XMFLOAT4 min;
+	XMFLOAT4 extent;
+};
+
+#pragma region Bounds
+
+QuantizationBounds MakeQuantizationBounds(const Bound &bound)
+{
+	float minimum[3] = { bound.min.x, bound.min.y, bound.min.z };
+	float maximum[3] = { bound.max.x, bound.max.y, bound.max.z };
+	float origin[3], extent[3];
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float size = maximum[axis] - minimum[axis];
+		float margin = size * QUANTIZATION_BOUNDS_MARGIN + 1e-4f;
+
+		origin[axis] = minimum[axis] - margin;
+		extent[axis] = size + 2 * margin;
+	}
+
+	QuantizationBounds bounds;
+	bounds.min = XMFLOAT4(origin[0], origin[1], origin[2], 0.0f);
+	bounds.extent = XMFLOAT4(extent[0], extent[1], extent[2], 0.0f);
+
+	return bounds;
+}
+
+Bound MergeBounds(const Bound &a, const Bound &b)
+{
+	Bound merged;
+	merged.min = XMFLOAT3(a.min.x < b.min.x ? a.min.x : b.min.x, a.min.y < b.min.y ? a.min.y : b.min.y, a.min.z < b.min.z ? a.min.z : b.min.z);
+	merged.max = XMFLOAT3(a.max.x > b.max.x ? a.max.x : b.max.x, a.max.y > b.max.y ? a.max.y : b.max.y, a.max.z > b.max.z ? a.max.z : b.max.z);
+
+	return merged;
+}
+
+bool ContainsBound(const Bound &outer, const Bound &inner)
+{
+	return inner.min.x >= outer.min.x && inner.min.y >= outer.min.y && inner.min.z >= outer.min.z &&
+		   inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+#pragma endregion
+
+#pragma region Encoding
+
+// Valores fuera de [0, 1] se recortan; el error maximo dentro del rango es medio paso
+unsigned short QuantizeUnorm16(float value)
+{
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return (unsigned short)(value * QUANTIZED_POSITION_STEPS + 0.5f);
+}
+
+short QuantizeSnorm16(float value)
+{
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (short)(value * QUANTIZED_NORMAL_STEPS + (value >= 0 ? 0.5f : -0.5f));
+}
+
+float DequantizeSnorm16(short value)
+{
+	float decoded = value / QUANTIZED_NORMAL_STEPS;
+	return decoded < -1.0f ? -1.0f : decoded;
+}
+
+/**
+*	Codificacion octaedrica: la normal se proyecta sobre el octaedro
+*	|x| + |y| + |z| = 1 y la mitad inferior se dobla sobre la superior,
+*	asi que dos valores en [-1, 1] bastan. No hace falta que la normal
+*	venga normalizada; una normal nula se codifica como (0, 0, 1).
+**/
+void EncodeOctahedral(const XMFLOAT3 &normal, short *encoded)
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	float u = 0, v = 0;
+
+	if (length > 0)
+	{
+		u = normal.x / length;
+		v = normal.y / length;
+
+		if (normal.z < 0)
+		{
+			float foldedU = (1.0f - fabsf(v)) * (u >= 0 ? 1.0f : -1.0f);
+			float foldedV = (1.0f - fabsf(u)) * (v >= 0 ? 1.0f : -1.0f);
+			u = foldedU;
+			v = foldedV;
+		}
+	}
+
+	encoded[0] = QuantizeSnorm16(u);
+	encoded[1] = QuantizeSnorm16(v);
+}
+
+// Misma cuenta que DecodeOctahedral en TestShader.fx; regresa una normal unitaria
+XMFLOAT3 DecodeOctahedral(const short *encoded)
+{
+	float x = DequantizeSnorm16(encoded[0]);
+	float y = DequantizeSnorm16(encoded[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	if (z < 0)
+	{
+		float unfoldedX = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float unfoldedY = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float length = sqrtf(x * x + y * y + z * z);
+	return XMFLOAT3(x / length, y / length, z / length);
+}
+
+// Cada vertice se arma en la pila y se escribe de una vez, como en StoreSkinnedLanes
+void EncodeVertices(const Vertex *vertices, int count, const QuantizationBounds &bounds, QuantizedVertex *output)
+{
+	float scaleX = 1.0f / bounds.extent.x;
+	float scaleY = 1.0f / bounds.extent.y;
+	float scaleZ = 1.0f / bounds.extent.z;
+
+	for (int i = 0; i < count; i++)
+	{
+		QuantizedVertex quantized;
+
+		quantized.position[0] = QuantizeUnorm16((vertices[i].position.x - bounds.min.x) * scaleX);
+		quantized.position[1] = QuantizeUnorm16((vertices[i].position.y - bounds.min.y) * scaleY);
+		quantized.position[2] = QuantizeUnorm16((vertices[i].position.z - bounds.min.z) * scaleZ);
+		quantized.position[3] = 0;
+		EncodeOctahedral(vertices[i].normal, quantized.normal);
+
+		output[i] = quantized;
+	}
+}
+
+Vertex DecodeVertex(const QuantizedVertex &quantized, const QuantizationBounds &bounds)
+{
+	Vertex vertex;
+
+	vertex.position.x = bounds.min.x + quantized.position[0] / QUANTIZED_POSITION_STEPS * bounds.extent.x;
+	vertex.position.y = bounds.min.y + quantized.position[1] / QUANTIZED_POSITION_STEPS * bounds.extent.y;
+	vertex.position.z = bounds.min.z + quantized.position[2] / QUANTIZED_POSITION_STEPS * bounds.extent.z;
+	vertex.normal = DecodeOctahedral(quantized.normal);
+
+	return vertex;
+}
+
+#pragma endregion
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef _WORKERPOOL_H_INCLUDED
+#define _WORKERPOOL_H_INCLUDED
+
+#pragma region Includes
+
+#include <Windows.h>
+#include <vector>
+
+#pragma endregion
+
+#pragma region Namespaces
+
+using namespace std;
+
+#pragma endregion
+
+#define WORKERPOOL_MAX_THREADS 64
+
+/**
+*	Trabajo divisible en elementos independientes. Execute se llama
+*	una vez por cada indice en [0, count) desde cualquier hilo del pool,
+*	por lo que cada indice solo debe escribir en su propio resultado.
+**/
+class ParallelTask
+{
+public:
+	virtual ~ParallelTask() {}
+	virtual void Execute(int index) = 0;
+};
+
+/**
+*	Pool de hilos persistentes. Run reparte los indices de una tarea
+*	entre los hilos del pool y el hilo que llama, y regresa hasta que
+*	todos terminaron. Run no es reentrante: una tarea no debe llamar
+*	a Run sobre el mismo pool.
+**/
+class WorkerPool
+{
+	struct Worker
+	{
+		WorkerPool *pool;
+		HANDLE thread;
+		HANDLE startEvent;
+		HANDLE doneEvent;
+	};
+
+	vector<Worker> workers;
+	vector<HANDLE> doneEvents;
+
+	ParallelTask *task;
+	volatile LONG nextIndex;
+	LONG count;
+	volatile bool isExiting;
+
+public:
+	WorkerPool(int numThreads)
+	{
+		task = NULL;
+		nextIndex = 0;
+		count = 0;
+		isExiting = false;
+
+		if (numThreads > WORKERPOOL_MAX_THREADS)
+			numThreads = WORKERPOOL_MAX_THREADS;
+
+		workers.resize(numThreads > 0 ? numThreads : 0);
+
+		for (int i = 0; i < (int)workers.size(); i++)
+		{
+			workers[i].pool = this;
+			workers[i].startEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+			workers[i].doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+			doneEvents.push_back(workers[i].doneEvent);
+		}
+
+		for (int i = 0; i < (int)workers.size(); i++)
+			workers[i].thread = CreateThread(NULL, 0, WorkerMain, &workers[i], 0, NULL);
+	}
+
+	~WorkerPool()
+	{
+		isExiting = true;
+
+		for (int i = 0; i < (int)workers.size(); i++)
+			SetEvent(workers[i].startEvent);
+
+		for (int i = 0; i < (int)workers.size(); i++)
+		{
+			WaitForSingleObject(workers[i].thread, INFINITE);
+			CloseHandle(workers[i].thread);
+			CloseHandle(workers[i].startEvent);
+			CloseHandle(workers[i].doneEvent);
+		}
+	}
+
+	// Numero total de hilos que ejecutan trabajo, incluyendo el que llama a Run
+	int GetThreadCount() { return (int)workers.size() + 1; }
+
+	void Run(ParallelTask *task, int count)
+	{
+		if (count <= 0)
+			return;
+
+		// Con un solo elemento no vale la pena despertar a los demas hilos
+		if (workers.empty() || count == 1)
+		{
+			for (int i = 0; i < count; i++)
+				task->Execute(i);
+			return;
+		}
+
+		this->task = task;
+		this->count = count;
+		this->nextIndex = 0;
+
+		for (int i = 0; i < (int)workers.size(); i++)
+			SetEvent(workers[i].startEvent);
+
+		ExecutePending();
+
+		WaitForMultipleObjects(doneEvents.size(), doneEvents.data(), TRUE, INFINITE);
+		this->task = NULL;
+	}
+
+	// Pool compartido por los loaders y el skinning, con un hilo por procesador
+	static WorkerPool* GetShared()
+	{
+		static WorkerPool *sharedPool = NULL;
+
+		if (sharedPool == NULL)
+		{
+			SYSTEM_INFO systemInfo;
+			GetSystemInfo(&systemInfo);
+			sharedPool = new WorkerPool((int)systemInfo.dwNumberOfProcessors - 1);
+		}
+
+		return sharedPool;
+	}
+
+private:
+	void ExecutePending()
+	{
+		while (true)
+		{
+			LONG index = InterlockedIncrement(&nextIndex) - 1;
+			if (index >= count)
+				break;
+
+			task->Execute(index);
+		}
+	}
+
+	static DWORD WINAPI WorkerMain(LPVOID parameter)
+	{
+		Worker *worker = (Worker*)parameter;
+
+		while (true)
+		{
+			WaitForSingleObject(worker->startEvent, INFINITE);
+
+			if (worker->pool->isExiting)
+				break;
+
+			worker->pool->ExecutePending();
+			SetEvent(worker->doneEvent);
+		}
+
+		return 0;
+	}
+};
+
+#endif